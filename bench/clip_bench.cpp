@@ -0,0 +1,902 @@
+/**
+  * @file clip_bench.cpp
+  *
+  * @brief Measures each stage of the video pipeline on its own.
+  *
+  * Results are written to stdout as CSV:
+  *     stage,resolution,preset,frames,ns_per_frame,frames_per_s,bytes_per_s
+  *
+  * Stages that do not depend on the encoder preset report "-".
+  *
+  * The writer stages run the writers from clip/video_writer.h against a
+  * VideoOutput that encodes into memory, and report the time spent in each
+  * writer less the time its VideoOutput spent encoding.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "clip/audio_writer.h"
+#include "clip/circle_gradient.h"
+#include "clip/format.h"
+#include "clip/output_context.h"
+#include "clip/output_sink.h"
+#include "clip/reformat.h"
+#include "clip/rgb_to_yuv.h"
+#include "clip/stream.h"
+#include "clip/video_options.h"
+#include "clip/video_output.h"
+#include "clip/video_writer.h"
+
+
+using Clock = std::chrono::steady_clock;
+
+
+struct Settings
+{
+    int frameCount = 30;
+    std::string stage;
+    std::string resolution;
+    std::string preset;
+    std::filesystem::path outputDirectory =
+        std::filesystem::temp_directory_path();
+};
+
+
+struct NamedResolution
+{
+    const char *name;
+    clip::Resolution resolution;
+};
+
+
+static const NamedResolution resolutions[] = {
+    {"sd", clip::sd},
+    {"hd", clip::hd},
+    {"uhd4k", clip::uhd4k}};
+
+
+static const clip::Preset presets[] = {
+    clip::Preset::superfast,
+    clip::Preset::veryfast,
+    clip::Preset::faster,
+    clip::Preset::fast,
+    clip::Preset::medium,
+    clip::Preset::slow,
+    clip::Preset::slower,
+    clip::Preset::veryslow,
+    clip::Preset::placebo};
+
+
+static const char * GetPresetName(clip::Preset preset)
+{
+    return clip::presetStrings[static_cast<size_t>(preset)];
+}
+
+
+/**
+ ** Accumulates the time spent in one stage.
+ **/
+class Stopwatch
+{
+public:
+    Stopwatch()
+        :
+        elapsed_(Clock::duration::zero())
+    {
+
+    }
+
+    template<typename Function>
+    void operator()(Function &&function)
+    {
+        auto start = Clock::now();
+        function();
+        this->elapsed_ += Clock::now() - start;
+    }
+
+    void Subtract(Clock::duration duration)
+    {
+        this->elapsed_ -= duration;
+    }
+
+    double GetNanoseconds() const
+    {
+        return std::chrono::duration<double, std::nano>(
+            this->elapsed_).count();
+    }
+
+private:
+    Clock::duration elapsed_;
+};
+
+
+static void Report(
+    const std::string &stage,
+    const std::string &resolution,
+    const std::string &preset,
+    int frameCount,
+    const Stopwatch &stopwatch,
+    double byteCount)
+{
+    double seconds = stopwatch.GetNanoseconds() * 1e-9;
+
+    fmt::print(
+        "{},{},{},{},{:.0f},{:.2f},{:.0f}\n",
+        stage,
+        resolution,
+        preset,
+        frameCount,
+        stopwatch.GetNanoseconds() / frameCount,
+        frameCount / seconds,
+        byteCount / seconds);
+
+    std::fflush(stdout);
+}
+
+
+static bool IsSelected(const std::string &filter, const std::string &name)
+{
+    return filter.empty() || filter == name;
+}
+
+
+using Gradient = clip::CircleGradientColors<uint16_t>;
+
+
+static double GetRgbSizeBytes(const clip::Resolution &resolution)
+{
+    return 3.0 * resolution.width * resolution.height;
+}
+
+
+/**
+ ** A VideoOutput that encodes into memory, so that each writer is timed
+ ** through the same VideoOutput calls it makes in a real program.
+ **/
+class MemoryOutput
+{
+public:
+    MemoryOutput(const clip::VideoOptions &options)
+        :
+        options_(options),
+        codecOptions_(),
+        outputContext_(
+            std::make_shared<clip::OutputContext>(
+                clip::format::Mp4::Get(),
+                std::make_shared<clip::MemorySink>())),
+        videoOutput_(this->outputContext_, this->codecOptions_, this->options_)
+    {
+        this->outputContext_->Initialize(this->codecOptions_);
+    }
+
+    clip::VideoOutput & Get()
+    {
+        return this->videoOutput_;
+    }
+
+    /**
+     ** @return The time spent encoding, muxing, and converting to the
+     **     encoder's pixel format, which is not the writer's own work.
+     **/
+    Clock::duration GetOutputTime() const
+    {
+        auto statistics = this->videoOutput_.GetStatistics();
+
+        return std::chrono::duration_cast<Clock::duration>(
+            statistics.sendTime
+            + statistics.receiveTime
+            + statistics.writeTime
+            + statistics.reformatTime);
+    }
+
+    void Finalize()
+    {
+        this->videoOutput_.Flush();
+        this->outputContext_->Finalize();
+    }
+
+private:
+    clip::VideoOptions options_;
+    clip::Dictionary codecOptions_;
+    std::shared_ptr<clip::OutputContext> outputContext_;
+    clip::VideoOutput videoOutput_;
+};
+
+
+/**
+ ** The encoder's time is subtracted from the writer's, so the fastest preset
+ ** keeps the run short without changing the result.
+ **/
+static clip::VideoOptions MakeWriterOptions(
+    const clip::Resolution &resolution,
+    AVPixelFormat pixelFormat)
+{
+    auto options = clip::VideoOptions::MakeDefault(resolution);
+    options.inPixelFormat = pixelFormat;
+    options.preset = clip::Preset::superfast;
+
+    return options;
+}
+
+
+/**
+ ** Time each call to writer, less the time spent in output.
+ **/
+template<typename Writer, typename Values>
+static void BenchWriter(
+    const Settings &settings,
+    const NamedResolution &named,
+    const std::string &stage,
+    MemoryOutput &output,
+    Writer &writer,
+    const Values &values,
+    double frameSizeBytes)
+{
+    Stopwatch stopwatch;
+
+    for (int i = 0; i < settings.frameCount; ++i)
+    {
+        stopwatch(
+            [&]()
+            {
+                writer(values);
+            });
+    }
+
+    stopwatch.Subtract(output.GetOutputTime());
+    output.Finalize();
+
+    Report(
+        stage,
+        named.name,
+        "-",
+        settings.frameCount,
+        stopwatch,
+        frameSizeBytes * settings.frameCount);
+}
+
+
+/**
+ ** ColorMappedVideoWriter, FusedColorMappedVideoWriter, and
+ ** YuvColorMappedVideoWriter, from the same gradient values.
+ **/
+static void BenchColorMap(
+    const Settings &settings,
+    const NamedResolution &named)
+{
+    const auto &resolution = named.resolution;
+
+    clip::CircleGradient<uint16_t> gradient(
+        resolution.height,
+        resolution.width,
+        30);
+
+    auto colorMap = tau::turbo::MakeRgb8(gradient.GetMaximumValue());
+    using ColorMap = decltype(colorMap);
+
+    auto values = gradient.GetNext();
+    auto rgbSizeBytes = GetRgbSizeBytes(resolution);
+
+    {
+        MemoryOutput output(
+            MakeWriterOptions(resolution, AV_PIX_FMT_RGB24));
+
+        clip::ColorMappedVideoWriter writer(
+            clip::StrideVideoWriter(
+                static_cast<size_t>(resolution.height),
+                clip::GetDataWidth<ColorMap>(
+                    static_cast<size_t>(resolution.width)),
+                output.Get()),
+            colorMap);
+
+        BenchWriter(
+            settings,
+            named,
+            "color_mapped_video_writer",
+            output,
+            writer,
+            values,
+            rgbSizeBytes);
+    }
+
+    {
+        MemoryOutput output(
+            MakeWriterOptions(resolution, AV_PIX_FMT_RGB24));
+
+        clip::FusedColorMappedVideoWriter<ColorMap, uint16_t> writer(
+            output.Get(),
+            colorMap);
+
+        BenchWriter(
+            settings,
+            named,
+            "fused_color_mapped_video_writer",
+            output,
+            writer,
+            values,
+            rgbSizeBytes);
+    }
+
+    {
+        MemoryOutput output(
+            MakeWriterOptions(resolution, AV_PIX_FMT_YUV420P));
+
+        clip::YuvColorMappedVideoWriter<ColorMap, uint16_t> writer(
+            output.Get(),
+            colorMap);
+
+        BenchWriter(
+            settings,
+            named,
+            "yuv_color_mapped_video_writer",
+            output,
+            writer,
+            values,
+            1.5 * resolution.width * resolution.height);
+    }
+}
+
+
+/**
+ ** VideoWriter and StrideVideoWriter, copying RGB24 into the encoder's
+ ** frame.
+ **/
+static void BenchCopy(const Settings &settings, const NamedResolution &named)
+{
+    const auto &resolution = named.resolution;
+
+    Gradient generator(resolution.height, resolution.width, 30);
+    Gradient::Output colors;
+    generator.FillFrame(&colors);
+
+    auto dataWidth = static_cast<size_t>(generator.GetDataWidth());
+    auto rgbSizeBytes = GetRgbSizeBytes(resolution);
+
+    {
+        MemoryOutput output(
+            MakeWriterOptions(resolution, AV_PIX_FMT_RGB24));
+
+        // VideoWriter copies the data as one block, and is only correct
+        // when the encoder's rows are not padded.
+        if (dataWidth == output.Get().GetStride())
+        {
+            clip::VideoWriter writer(output.Get());
+
+            BenchWriter(
+                settings,
+                named,
+                "video_writer",
+                output,
+                writer,
+                colors,
+                rgbSizeBytes);
+        }
+    }
+
+    const std::pair<clip::StrideMode, const char *> modes[] = {
+        {clip::StrideMode::direct, "stride_video_writer_direct"},
+        {clip::StrideMode::buffered, "stride_video_writer_buffered"}};
+
+    for (auto [mode, stage]: modes)
+    {
+        MemoryOutput output(
+            MakeWriterOptions(resolution, AV_PIX_FMT_RGB24));
+
+        clip::StrideVideoWriter writer(
+            static_cast<size_t>(resolution.height),
+            dataWidth,
+            output.Get(),
+            mode);
+
+        BenchWriter(
+            settings,
+            named,
+            stage,
+            output,
+            writer,
+            colors,
+            rgbSizeBytes);
+    }
+}
+
+
+static void FillRgbFrame(clip::Frame &frame, Gradient &generator)
+{
+    Gradient::Output colors;
+    generator.FillFrame(&colors);
+
+    auto dataWidth = generator.GetDataWidth();
+
+    for (int row = 0; row < frame->height; ++row)
+    {
+        std::memcpy(
+            frame->data[0] + row * frame->linesize[0],
+            colors.data() + row * dataWidth,
+            static_cast<size_t>(dataWidth));
+    }
+}
+
+
+static void BenchReformat(
+    const Settings &settings,
+    const NamedResolution &named)
+{
+    const auto &resolution = named.resolution;
+
+    Gradient generator(resolution.height, resolution.width, 30);
+
+    clip::Frame source(
+        AV_PIX_FMT_RGB24,
+        resolution.height,
+        resolution.width);
+
+    FillRgbFrame(source, generator);
+
+    clip::Frame target(
+        AV_PIX_FMT_YUV420P,
+        resolution.height,
+        resolution.width);
+
+    clip::Reformat reformat(
+        resolution,
+        AV_PIX_FMT_RGB24,
+        resolution,
+        AV_PIX_FMT_YUV420P);
+
+    auto byteCount = GetRgbSizeBytes(resolution) * settings.frameCount;
+
+    Stopwatch swscaleStopwatch;
+
+    for (int i = 0; i < settings.frameCount; ++i)
+    {
+        swscaleStopwatch(
+            [&]()
+            {
+                reformat(source, target);
+            });
+    }
+
+    Report(
+        "reformat",
+        named.name,
+        "-",
+        settings.frameCount,
+        swscaleStopwatch,
+        byteCount);
+
+    clip::RgbToYuv rgbToYuv(AV_PIX_FMT_YUV420P, clip::ColorMatrix::bt601);
+    Stopwatch nativeStopwatch;
+
+    for (int i = 0; i < settings.frameCount; ++i)
+    {
+        nativeStopwatch(
+            [&]()
+            {
+                rgbToYuv(source, target);
+            });
+    }
+
+    Report(
+        "rgb_to_yuv",
+        named.name,
+        "-",
+        settings.frameCount,
+        nativeStopwatch,
+        byteCount);
+}
+
+
+/**
+ ** Configured like VideoOptions::MakeDefault, with the requested preset.
+ **/
+static void OpenEncoder(
+    const clip::Codec &codec,
+    const clip::Resolution &resolution,
+    clip::Preset preset,
+    clip::CodecContext &codecContext)
+{
+    auto options = clip::VideoOptions::MakeDefault(resolution);
+    options.preset = preset;
+
+    clip::Dictionary codecOptions;
+    clip::ConfigureVideoEncoder(codecContext, codecOptions, options);
+
+    // The mp4 muxer expects global headers.
+    codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    clip::OpenVideoEncoder(codecContext, codec, codecOptions);
+}
+
+
+/**
+ ** Encodes a moving gradient, keeping the packets for BenchMux.
+ **/
+static std::vector<clip::OutputPacket> BenchEncode(
+    const Settings &settings,
+    const NamedResolution &named,
+    clip::Preset preset,
+    clip::CodecContext &codecContext,
+    bool report)
+{
+    const auto &resolution = named.resolution;
+
+    Gradient generator(resolution.height, resolution.width, 30);
+
+    clip::Frame source(
+        AV_PIX_FMT_RGB24,
+        resolution.height,
+        resolution.width);
+
+    clip::Frame frame(
+        AV_PIX_FMT_YUV420P,
+        resolution.height,
+        resolution.width);
+
+    clip::RgbToYuv rgbToYuv(AV_PIX_FMT_YUV420P, clip::ColorMatrix::bt601);
+
+    std::vector<clip::OutputPacket> packets;
+    Stopwatch sendStopwatch;
+    Stopwatch receiveStopwatch;
+
+    auto receive = [&]()
+    {
+        while (true)
+        {
+            clip::OutputPacket packet;
+            int result;
+
+            receiveStopwatch(
+                [&]()
+                {
+                    result = avcodec_receive_packet(codecContext, packet);
+                });
+
+            if (result == AVERROR(EAGAIN) || result == AVERROR_EOF)
+            {
+                return;
+            }
+
+            if (result < 0)
+            {
+                throw clip::VideoError(
+                    clip::DescribeError("Error encoding a frame", result));
+            }
+
+            packets.push_back(std::move(packet));
+        }
+    };
+
+    auto send = [&](AVFrame *input)
+    {
+        int result;
+
+        sendStopwatch(
+            [&]()
+            {
+                result = avcodec_send_frame(codecContext, input);
+            });
+
+        if (result < 0)
+        {
+            throw clip::VideoError(
+                clip::DescribeError("Error sending a frame", result));
+        }
+
+        receive();
+    };
+
+    for (int i = 0; i < settings.frameCount; ++i)
+    {
+        FillRgbFrame(source, generator);
+        frame.MakeWritable();
+        rgbToYuv(source, frame);
+        frame->pts = i;
+        send(frame);
+    }
+
+    // Drain the encoder.
+    send(NULL);
+
+    if (!report)
+    {
+        return packets;
+    }
+
+    double inputBytes =
+        1.5 * resolution.width * resolution.height * settings.frameCount;
+
+    Report(
+        "avcodec_send_frame",
+        named.name,
+        GetPresetName(preset),
+        settings.frameCount,
+        sendStopwatch,
+        inputBytes);
+
+    Report(
+        "avcodec_receive_packet",
+        named.name,
+        GetPresetName(preset),
+        settings.frameCount,
+        receiveStopwatch,
+        inputBytes);
+
+    return packets;
+}
+
+
+static void BenchMux(
+    const Settings &settings,
+    const NamedResolution &named,
+    clip::Preset preset,
+    clip::CodecContext &codecContext,
+    std::vector<clip::OutputPacket> &packets)
+{
+    auto fileName = settings.outputDirectory / fmt::format(
+        "clip_bench_{}_{}.mp4",
+        named.name,
+        GetPresetName(preset));
+
+    double byteCount = 0.0;
+    Stopwatch stopwatch;
+
+    {
+        auto outputContext = std::make_shared<clip::OutputContext>(
+            clip::format::Mp4::Get(),
+            fileName.string());
+
+        clip::Stream stream(*outputContext);
+        stream->time_base = codecContext->time_base;
+
+        int result = avcodec_parameters_from_context(
+            stream->codecpar,
+            codecContext);
+
+        if (result < 0)
+        {
+            throw clip::VideoError("Could not copy the stream parameters");
+        }
+
+        clip::Dictionary formatOptions;
+        outputContext->Initialize(formatOptions);
+
+        for (auto &packet: packets)
+        {
+            byteCount += packet->size;
+
+            av_packet_rescale_ts(
+                packet,
+                codecContext->time_base,
+                stream->time_base);
+
+            packet->stream_index = stream->index;
+
+            stopwatch(
+                [&]()
+                {
+                    outputContext->WritePacket(packet);
+                });
+        }
+
+        stopwatch(
+            [&]()
+            {
+                outputContext->Finalize();
+            });
+    }
+
+    std::filesystem::remove(fileName);
+
+    Report(
+        "av_interleaved_write_frame",
+        named.name,
+        GetPresetName(preset),
+        settings.frameCount,
+        stopwatch,
+        byteCount);
+}
+
+
+static void BenchEncodeAndMux(
+    const Settings &settings,
+    const NamedResolution &named)
+{
+    bool doEncode = IsSelected(settings.stage, "encode");
+    bool doMux = IsSelected(settings.stage, "mux");
+
+    if (!doEncode && !doMux)
+    {
+        return;
+    }
+
+    clip::Codec codec(AV_CODEC_ID_H264);
+
+    for (auto preset: presets)
+    {
+        if (!IsSelected(settings.preset, GetPresetName(preset)))
+        {
+            continue;
+        }
+
+        clip::CodecContext codecContext(codec);
+        OpenEncoder(codec, named.resolution, preset, codecContext);
+
+        // The mux stage needs packets, so encoding always runs.
+        auto packets =
+            BenchEncode(settings, named, preset, codecContext, doEncode);
+
+        if (doMux)
+        {
+            BenchMux(settings, named, preset, codecContext, packets);
+        }
+    }
+}
+
+
+/**
+ ** One second of a mono signal copied to both channels of interleaved
+ ** 16-bit frames.
+ **/
+static void BenchAudioInterleave(const Settings &settings)
+{
+    using Options = clip::AudioOptions<AV_SAMPLE_FMT_S16>;
+    using Writer = clip::MonoAudioWriter<Options>;
+
+    static constexpr int sampleRate = 44100;
+    static constexpr int sampleCount = 1024;
+    static constexpr int channelCount = 2;
+
+    clip::Frame frame(
+        AV_SAMPLE_FMT_S16,
+        AV_CH_LAYOUT_STEREO,
+        sampleRate,
+        sampleCount);
+
+    using Signal = Eigen::Matrix<int16_t, Eigen::Dynamic, 1>;
+
+    Signal signal =
+        Signal::LinSpaced(
+            sampleCount,
+            -16000,
+            16000);
+
+    int frameCount = settings.frameCount * (sampleRate / sampleCount);
+    Stopwatch stopwatch;
+
+    for (int i = 0; i < frameCount; ++i)
+    {
+        stopwatch(
+            [&]()
+            {
+                Writer::Fill(signal, channelCount, frame);
+            });
+    }
+
+    Report(
+        "mono_audio_interleave",
+        "-",
+        "-",
+        frameCount,
+        stopwatch,
+        static_cast<double>(frameCount)
+            * sampleCount
+            * channelCount
+            * sizeof(int16_t));
+}
+
+
+static void PrintUsage(const char *name)
+{
+    std::cerr
+        << "Usage: " << name << " [options]\n"
+        << "    --frames N            Frames per measurement (30)\n"
+        << "    --stage NAME          color_map, copy, reformat, encode,\n"
+        << "                          mux, or audio\n"
+        << "    --resolution NAME     sd, hd, or uhd4k\n"
+        << "    --preset NAME         x264 preset, e.g. medium\n"
+        << "    --output DIRECTORY    Where to write temporary files\n";
+}
+
+
+int main(int argc, char **argv)
+{
+    Settings settings;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument(argv[i]);
+
+        if (i + 1 >= argc)
+        {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        std::string value(argv[++i]);
+
+        if (argument == "--frames")
+        {
+            settings.frameCount = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (argument == "--stage")
+        {
+            settings.stage = value;
+        }
+        else if (argument == "--resolution")
+        {
+            settings.resolution = value;
+        }
+        else if (argument == "--preset")
+        {
+            settings.preset = value;
+        }
+        else if (argument == "--output")
+        {
+            settings.outputDirectory = value;
+        }
+        else
+        {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    fmt::print(
+        "stage,resolution,preset,frames,ns_per_frame,frames_per_s,"
+        "bytes_per_s\n");
+
+    try
+    {
+        for (const auto &named: resolutions)
+        {
+            if (!IsSelected(settings.resolution, named.name))
+            {
+                continue;
+            }
+
+            if (IsSelected(settings.stage, "color_map"))
+            {
+                BenchColorMap(settings, named);
+            }
+
+            if (IsSelected(settings.stage, "copy"))
+            {
+                BenchCopy(settings, named);
+            }
+
+            if (IsSelected(settings.stage, "reformat"))
+            {
+                BenchReformat(settings, named);
+            }
+
+            BenchEncodeAndMux(settings, named);
+        }
+
+        if (IsSelected(settings.stage, "audio"))
+        {
+            BenchAudioInterleave(settings);
+        }
+    }
+    catch (clip::ClipError &error)
+    {
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -100,6 +100,9 @@ public:
 
         AVCodecContext *codecContext = this->codecContext_;
 
+        codecContext->thread_count =
+            static_cast<int>(this->threadLease_.GetShare());
+
         // AVCodecs must be explicitly opened, but they are only closed by the
         // owning AVCodecContext.
         int result = avcodec_open2(
@@ -33,8 +33,6 @@ public:
     template<typename T>
     void operator()(T &data)
     {
-        using Sample = typename Options::Format::type;
-
         int channelCount =
             this->audioOutput_.GetOptions().channelLayout.GetChannelCount();
 
@@ -44,14 +42,26 @@ public:
             static_cast<size_t>(frame->nb_samples)
             == this->audioOutput_.GetSampleCount());
 
-        assert(
-            static_cast<size_t>(data.size())
-            == this->audioOutput_.GetSampleCount());
+        Fill(data, channelCount, frame);
+
+        this->audioOutput_.WriteFrame();
+    }
+
+    /**
+     ** Copy the mono signal in data to every channel of frame.
+     **/
+    template<typename T>
+    static void Fill(const T &data, int channelCount, AVFrame *frame)
+    {
+        using Sample = typename Options::Format::type;
+
+        auto sampleCount = static_cast<size_t>(frame->nb_samples);
+
+        assert(static_cast<size_t>(data.size()) == sampleCount);
 
         if constexpr (Options::Format::isPlanar)
         {
-            size_t fieldSize =
-                sizeof(Sample) * this->audioOutput_.GetSampleCount();
+            size_t fieldSize = sizeof(Sample) * sampleCount;
 
             assert(frame->linesize[0] == static_cast<int>(fieldSize));
 
@@ -61,26 +71,20 @@ public:
             {
                 assert(frame->data[i] != NULL);
 
-                assert(
-                    frame->nb_samples
-                    == static_cast<int>(this->audioOutput_.GetSampleCount()));
-
                 memcpy(
                     frame->data[i],
                     data.data(),
                     fieldSize);
-
-                assert(
-                    frame->nb_samples
-                    == static_cast<int>(this->audioOutput_.GetSampleCount()));
             }
         }
         else
         {
             assert(
                 frame->linesize[0]
-                == static_cast<int>(
-                    this->audioOutput_.GetSampleCount() * sizeof(Sample)));
+                >= static_cast<int>(
+                    sampleCount
+                    * static_cast<size_t>(channelCount)
+                    * sizeof(Sample)));
 
             Sample *out = reinterpret_cast<Sample *>(frame->data[0]);
 
@@ -94,8 +98,6 @@ public:
                 }
             }
         }
-
-        this->audioOutput_.WriteFrame();
     }
 
     TimeStamp GetTimeStamp() const
@@ -12,10 +12,15 @@
 #pragma once
 
 
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <memory>
+#include <vector>
 #include "tau/angles.h"
 #include "tau/color_map.h"
 #include "tau/color_maps/turbo.h"
+#include "clip/thread_pool.h"
 
 
 namespace clip
@@ -33,7 +38,8 @@ public:
             int height,
             int width,
             int framesPerSecond,
-            double phase = 0.0)
+            double phase = 0.0,
+            unsigned threadCount = ThreadPool::GetDefaultThreadCount())
         :
         time_(0.0),
         pathStep_(tau::Angles<double>::tau / (6 * framesPerSecond)),
@@ -42,7 +48,8 @@ public:
         phase_(phase),
         center_{width / 2, height / 2},
         radius_(std::min(height, width) / 3),
-        values_(height, width)
+        values_(height, width),
+        threadPool_(std::make_shared<ThreadPool>(threadCount))
     {
 
     }
@@ -117,18 +124,95 @@ private:
         return result;
     }
 
-    void ComputeRawDistances_(Point point)
+    /**
+     ** Computes ceil(sqrt(dx * dx + dy * dy)) for dx in [0, profile.size()).
+     **
+     ** The squared distance only grows with dx, so the exact integer ceiling
+     ** of the root is found by stepping forward from the previous one.
+     **/
+    static void ComputeProfile_(int dy, std::vector<T> &profile)
     {
-        for (int i = 0; i < this->height_; ++i)
+        int64_t dySquared = static_cast<int64_t>(dy) * dy;
+        int64_t root = dy;
+
+        for (size_t dx = 0; dx < profile.size(); ++dx)
         {
-            for (int j = 0; j < this->width_; ++j)
+            int64_t squared =
+                static_cast<int64_t>(dx) * static_cast<int64_t>(dx)
+                + dySquared;
+
+            while (root * root < squared)
             {
-                this->values_(i, j) = static_cast<T>(
-                    GetDistance(j - point.x, i - point.y));
+                ++root;
             }
+
+            profile[dx] = static_cast<T>(root);
         }
     }
 
+    /**
+     ** The distance depends only on |dx| and |dy|, so each row is the
+     ** profile of its |dy| mirrored about point.x, and rows at the same
+     ** distance above and below point.y are identical.
+     **
+     ** Each unique |dy| is computed once, and rows are spread across the
+     ** thread pool.
+     **/
+    void ComputeRawDistances_(Point point)
+    {
+        // The path keeps the point inside the frame.
+        assert(point.x >= 0 && point.x < this->width_);
+        assert(point.y >= 0 && point.y < this->height_);
+
+        int px = point.x;
+        int py = point.y;
+
+        int left = px;
+        int right = this->width_ - 1 - px;
+        int above = py;
+        int below = this->height_ - 1 - py;
+
+        auto profileSize = static_cast<size_t>(std::max(left, right) + 1);
+        auto rowCount = static_cast<size_t>(std::max(above, below) + 1);
+
+        this->threadPool_->ParallelFor(
+            rowCount,
+            [&](size_t index)
+            {
+                thread_local std::vector<T> profile;
+                profile.resize(profileSize);
+
+                int dy = static_cast<int>(index);
+                ComputeProfile_(dy, profile);
+
+                auto write = [&](int row)
+                {
+                    T *target = this->values_.row(row).data();
+
+                    // Columns left of px count down to the profile's start.
+                    std::reverse_copy(
+                        profile.begin() + 1,
+                        profile.begin() + 1 + left,
+                        target);
+
+                    std::copy(
+                        profile.begin(),
+                        profile.begin() + 1 + right,
+                        target + px);
+                };
+
+                if (dy <= above)
+                {
+                    write(py - dy);
+                }
+
+                if (dy != 0 && dy <= below)
+                {
+                    write(py + dy);
+                }
+            });
+    }
+
 private:
     double time_;
     double pathStep_;
@@ -138,6 +222,9 @@ private:
     Point center_;
     int radius_;
     Values values_;
+
+    // Shared by copies, which take turns.
+    std::shared_ptr<ThreadPool> threadPool_;
 };
 
 
@@ -0,0 +1,136 @@
+/**
+  * @file color_lookup.h
+  *
+  * @brief Caches the output of a color map for every integral input value.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include "tau/eigen.h"
+
+
+namespace clip
+{
+
+
+/**
+ ** Values that index a table with an entry for every possible value.
+ ** Wider types would need tables of gigabytes.
+ **/
+template<typename Value>
+inline constexpr bool isLookupIndex =
+    std::is_unsigned_v<Value>
+    && !std::is_same_v<Value, bool>
+    && sizeof(Value) <= 2;
+
+
+/**
+ ** Color maps are applied element-wise, so the color of every possible
+ ** value can be computed once and reused for every pixel that has that
+ ** value.
+ **
+ ** The table is built at construction, and holds 2^16 colors for 16-bit
+ ** values, e.g. 192 KiB of RGB24.
+ **/
+template<typename ColorMap, typename Value>
+class ColorLookup
+{
+public:
+    using Colors = typename ColorMap::Colors;
+    using Color = typename Colors::Scalar;
+
+    static constexpr auto colorCount = tau::MatrixTraits<Colors>::columns;
+
+    static_assert(
+        colorCount != Eigen::Dynamic,
+        "Expected compile-time column count");
+
+    static_assert(
+        tau::MatrixTraits<Colors>::isRowMajor,
+        "Expected the colors of each pixel to be contiguous.");
+
+    static_assert(
+        isLookupIndex<Value>,
+        "Expected unsigned integral values of 16 bits or fewer.");
+
+    static constexpr size_t pixelSizeBytes =
+        sizeof(Color) * static_cast<size_t>(colorCount);
+
+    static constexpr size_t valueCount =
+        static_cast<size_t>(std::numeric_limits<Value>::max()) + 1;
+
+    ColorLookup(const ColorMap &colorMap)
+        :
+        table_()
+    {
+        Eigen::Matrix<Value, 1, Eigen::Dynamic> ramp(valueCount);
+
+        for (size_t i = 0; i < valueCount; ++i)
+        {
+            ramp(static_cast<Eigen::Index>(i)) = static_cast<Value>(i);
+        }
+
+        ColorMap mapColors(colorMap);
+        mapColors(ramp, &this->table_);
+    }
+
+    /**
+     ** Write the colors of `count` values to `target`.
+     **
+     ** Each value is read once, and each pixel is written once.
+     **/
+    void MapRow(const Value *values, Eigen::Index count, uint8_t *target)
+        const
+    {
+        const auto *table =
+            reinterpret_cast<const uint8_t *>(this->table_.data());
+
+        for (Eigen::Index i = 0; i < count; ++i)
+        {
+            std::memcpy(
+                target,
+                table + static_cast<size_t>(values[i]) * pixelSizeBytes,
+                pixelSizeBytes);
+
+            target += pixelSizeBytes;
+        }
+    }
+
+    /**
+     ** Write a row-major frame of values to target, with stride bytes
+     ** between the starts of rows. The padding after each row is not
+     ** written.
+     **/
+    void MapFrame(
+        const Value *values,
+        Eigen::Index height,
+        Eigen::Index width,
+        uint8_t *target,
+        Eigen::Index stride) const
+    {
+        for (Eigen::Index row = 0; row < height; ++row)
+        {
+            this->MapRow(values + row * width, width, target + row * stride);
+        }
+    }
+
+    const Colors & GetTable() const
+    {
+        return this->table_;
+    }
+
+private:
+    Colors table_;
+};
+
+
+} // end namespace clip
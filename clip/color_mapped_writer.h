@@ -34,8 +34,29 @@ void WriteColorMapped(
 {
     auto dataWidth = GetDataWidth<ColorMap>(reader.GetWidth_pixels());
     auto stride = output.GetStride();
-    
-    if (dataWidth == stride)
+
+    // Values of 16 bits or fewer index a table of every possible value.
+    constexpr bool isIndexed = isLookupIndex<typename Reader::Matrix::Scalar>;
+
+    if constexpr (isIndexed && isRgb24ColorMap<ColorMap>)
+    {
+        // Integral values index a lookup table, and the colors are written
+        // directly into the encoder's frame, with or without stride.
+        // Planar YUV frames are written without an RGB intermediate.
+        if (IsPlanarYuvOutput(output))
+        {
+            detail::WriteColorMappedYuv(reader, colorMap, output);
+        }
+        else
+        {
+            detail::WriteColorMappedFused(reader, colorMap, output);
+        }
+    }
+    else if constexpr (isIndexed)
+    {
+        detail::WriteColorMappedFused(reader, colorMap, output);
+    }
+    else if (dataWidth == stride)
     {
         detail::WriteColorMapped(reader, colorMap, output);
     }
@@ -0,0 +1,197 @@
+/**
+  * @file decoder.h
+  *
+  * @brief Decodes the packets of one input stream.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include "clip/ffmpeg_shim.h"
+FFMPEG_SHIM_PUSH_IGNORES
+extern "C"
+{
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+}
+FFMPEG_SHIM_POP_IGNORES
+
+
+#include "clip/codec_context.h"
+#include "clip/error.h"
+
+
+namespace clip
+{
+
+
+CREATE_EXCEPTION(DecoderError, VideoError);
+
+
+struct DecoderOptions
+{
+    // Zero lets the codec choose, usually one thread per core.
+    int threadCount;
+
+    // FF_THREAD_FRAME, FF_THREAD_SLICE, or both.
+    int threadType;
+
+    // Frames the decoder skips, e.g. AVDISCARD_NONKEY.
+    AVDiscard skipFrame;
+
+    static DecoderOptions MakeDefault()
+    {
+        return {
+            .threadCount = 0,
+            .threadType = FF_THREAD_FRAME | FF_THREAD_SLICE,
+            .skipFrame = AVDISCARD_DEFAULT};
+    }
+};
+
+
+class Decoder
+{
+public:
+    Decoder(
+        const AVStream *stream,
+        const DecoderOptions &options = DecoderOptions::MakeDefault())
+        :
+        codecContext_(FindDecoder_(stream)),
+        isDrained_(false)
+    {
+        int result = avcodec_parameters_to_context(
+            this->codecContext_,
+            stream->codecpar);
+
+        if (result < 0)
+        {
+            throw DecoderError(
+                DescribeError("Could not copy the stream parameters", result));
+        }
+
+        this->codecContext_->pkt_timebase = stream->time_base;
+        this->codecContext_->thread_count = options.threadCount;
+        this->codecContext_->thread_type = options.threadType;
+        this->codecContext_->skip_frame = options.skipFrame;
+
+        result = avcodec_open2(
+            this->codecContext_,
+            this->codecContext_->codec,
+            NULL);
+
+        if (result < 0)
+        {
+            throw DecoderError(
+                DescribeError("Could not open decoder", result));
+        }
+    }
+
+    Decoder(const Decoder &) = delete;
+    Decoder & operator=(const Decoder &) = delete;
+
+    operator AVCodecContext * () const
+    {
+        return this->codecContext_;
+    }
+
+    AVCodecContext * operator->() const
+    {
+        return this->codecContext_;
+    }
+
+    /**
+     ** Pass NULL once the input is exhausted, to drain the decoder.
+     **
+     ** Receive every available frame before sending the next packet.
+     **/
+    void Send(const AVPacket *packet)
+    {
+        int result = avcodec_send_packet(this->codecContext_, packet);
+
+        if (result == AVERROR_EOF)
+        {
+            // Already draining.
+            return;
+        }
+
+        if (result < 0)
+        {
+            throw DecoderError(
+                DescribeError("Error sending a packet to the decoder", result));
+        }
+    }
+
+    /**
+     ** @return false when the decoder needs another packet, or has been
+     ** drained.
+     **/
+    bool Receive(AVFrame *frame)
+    {
+        int result = avcodec_receive_frame(this->codecContext_, frame);
+
+        if (result == AVERROR(EAGAIN))
+        {
+            return false;
+        }
+
+        if (result == AVERROR_EOF)
+        {
+            this->isDrained_ = true;
+
+            return false;
+        }
+
+        if (result < 0)
+        {
+            throw DecoderError(
+                DescribeError("Error receiving a decoded frame", result));
+        }
+
+        return true;
+    }
+
+    /**
+     ** @return true once every frame has been received after draining.
+     **/
+    bool GetIsDrained() const
+    {
+        return this->isDrained_;
+    }
+
+    /**
+     ** Discard buffered frames, e.g. after seeking the input.
+     **/
+    void Reset()
+    {
+        avcodec_flush_buffers(this->codecContext_);
+        this->isDrained_ = false;
+    }
+
+private:
+    static const AVCodec * FindDecoder_(const AVStream *stream)
+    {
+        const AVCodec *codec = avcodec_find_decoder(stream->codecpar->codec_id);
+
+        if (!codec)
+        {
+            throw DecoderError(
+                std::string("Could not find decoder for ")
+                + avcodec_get_name(stream->codecpar->codec_id));
+        }
+
+        return codec;
+    }
+
+    CodecContext codecContext_;
+    bool isDrained_;
+};
+
+
+} // end namespace clip
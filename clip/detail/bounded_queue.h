@@ -0,0 +1,172 @@
+/**
+  * @file bounded_queue.h
+  *
+  * @brief Blocking queue with a fixed capacity, for connecting pipeline
+  *     stages.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+
+namespace clip
+{
+
+
+namespace detail
+{
+
+
+/**
+ ** Any number of threads may push and pop.
+ **
+ ** Close() ends the stream of values: producers stop, and consumers receive
+ ** the values that remain before Pop reports the end.
+ **/
+template<typename T>
+class BoundedQueue
+{
+public:
+    BoundedQueue(size_t capacity)
+        :
+        capacity_(capacity),
+        mutex_(),
+        notEmpty_(),
+        notFull_(),
+        queued_(),
+        isClosed_(false),
+        size_(0)
+    {
+
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue & operator=(const BoundedQueue &) = delete;
+
+    /**
+     ** Blocks while the queue is full.
+     **
+     ** @return false if the queue has been closed, and value was discarded.
+     **/
+    bool Push(T &&value)
+    {
+        std::unique_lock lock(this->mutex_);
+
+        this->notFull_.wait(
+            lock,
+            [this]()
+            {
+                return this->queued_.size() < this->capacity_
+                    || this->isClosed_;
+            });
+
+        if (this->isClosed_)
+        {
+            return false;
+        }
+
+        this->queued_.push_back(std::move(value));
+        this->size_.store(this->queued_.size(), std::memory_order_relaxed);
+
+        lock.unlock();
+        this->notEmpty_.notify_one();
+
+        return true;
+    }
+
+    /**
+     ** Blocks until a value is available, or the queue is closed.
+     **
+     ** @return Empty when the queue is closed and empty.
+     **/
+    std::optional<T> Pop()
+    {
+        std::unique_lock lock(this->mutex_);
+
+        this->notEmpty_.wait(
+            lock,
+            [this]()
+            {
+                return !this->queued_.empty() || this->isClosed_;
+            });
+
+        return this->Take_(lock);
+    }
+
+    /**
+     ** @return Empty if no value is waiting.
+     **/
+    std::optional<T> TryPop()
+    {
+        std::unique_lock lock(this->mutex_);
+
+        return this->Take_(lock);
+    }
+
+    void Close()
+    {
+        {
+            std::lock_guard lock(this->mutex_);
+            this->isClosed_ = true;
+        }
+
+        this->notEmpty_.notify_all();
+        this->notFull_.notify_all();
+    }
+
+    /**
+     ** Does not lock, so it may be polled without stalling the queue.
+     **/
+    size_t GetSize() const
+    {
+        return this->size_.load(std::memory_order_relaxed);
+    }
+
+    size_t GetCapacity() const
+    {
+        return this->capacity_;
+    }
+
+private:
+    std::optional<T> Take_(std::unique_lock<std::mutex> &lock)
+    {
+        if (this->queued_.empty())
+        {
+            return {};
+        }
+
+        std::optional<T> result(std::move(this->queued_.front()));
+        this->queued_.pop_front();
+        this->size_.store(this->queued_.size(), std::memory_order_relaxed);
+
+        lock.unlock();
+        this->notFull_.notify_one();
+
+        return result;
+    }
+
+    size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<T> queued_;
+    bool isClosed_;
+    std::atomic<size_t> size_;
+};
+
+
+} // end namespace detail
+
+
+} // end namespace clip
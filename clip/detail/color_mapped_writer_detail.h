@@ -2,6 +2,8 @@
   * @file color_mapped_writer_detail.h
   * 
   * @brief Implements writing color-mapped data with and without stride.
+  *     Unsigned integral data is mapped directly into the encoder's frame,
+  *     either as RGB or as YUV planes.
   * 
   * @author Jive Helix (jivehelix@gmail.com)
   * @date 11 Feb 2022
@@ -67,6 +69,46 @@ void WriteColorMapped(
 }
 
 
+template<typename Reader, typename ColorMap>
+void WriteColorMappedFused(
+    Reader &reader,
+    const ColorMap &colorMap,
+    VideoOutput &output)
+{
+    static_assert(
+        tau::MatrixTraits<typename Reader::Matrix>::isRowMajor,
+        "Expected row major data to match AVFrame.");
+
+    FusedColorMappedVideoWriter<ColorMap, typename Reader::Matrix::Scalar>
+        frameWriter(output, colorMap);
+
+    while (reader.HasFrame())
+    {
+        frameWriter(reader.GetNextFrameData());
+    }
+}
+
+
+template<typename Reader, typename ColorMap>
+void WriteColorMappedYuv(
+    Reader &reader,
+    const ColorMap &colorMap,
+    VideoOutput &output)
+{
+    static_assert(
+        tau::MatrixTraits<typename Reader::Matrix>::isRowMajor,
+        "Expected row major data to match AVFrame.");
+
+    YuvColorMappedVideoWriter<ColorMap, typename Reader::Matrix::Scalar>
+        frameWriter(output, colorMap);
+
+    while (reader.HasFrame())
+    {
+        frameWriter(reader.GetNextFrameData());
+    }
+}
+
+
 } // end namespace detail
 
 
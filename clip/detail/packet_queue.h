@@ -0,0 +1,192 @@
+/**
+  * @file packet_queue.h
+  *
+  * @brief Bounded queue of ref-counted packets waiting for the muxer.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include "clip/ffmpeg_shim.h"
+FFMPEG_SHIM_PUSH_IGNORES
+extern "C"
+{
+
+#include <libavcodec/packet.h>
+
+}
+FFMPEG_SHIM_POP_IGNORES
+
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "clip/error.h"
+
+
+namespace clip
+{
+
+
+namespace detail
+{
+
+
+/**
+ ** Any number of threads may push, and one thread pops.
+ **
+ ** Packets are moved by reference, so payloads are never copied. Emptied
+ ** AVPackets are recycled rather than freed.
+ **/
+class PacketQueue
+{
+public:
+    PacketQueue(size_t capacity)
+        :
+        capacity_(capacity),
+        mutex_(),
+        notEmpty_(),
+        notFull_(),
+        queued_(),
+        recycled_(),
+        isClosed_(false),
+        size_(0)
+    {
+
+    }
+
+    ~PacketQueue()
+    {
+        for (AVPacket *packet: this->queued_)
+        {
+            av_packet_free(&packet);
+        }
+
+        for (AVPacket *packet: this->recycled_)
+        {
+            av_packet_free(&packet);
+        }
+    }
+
+    PacketQueue(const PacketQueue &) = delete;
+    PacketQueue & operator=(const PacketQueue &) = delete;
+
+    /**
+     ** Blocks while the queue is full.
+     **
+     ** Takes ownership of the packet's contents, and leaves it blank.
+     **/
+    void Push(AVPacket *packet)
+    {
+        std::unique_lock lock(this->mutex_);
+
+        this->notFull_.wait(
+            lock,
+            [this]()
+            {
+                return this->queued_.size() < this->capacity_;
+            });
+
+        AVPacket *queued;
+
+        if (this->recycled_.empty())
+        {
+            queued = av_packet_alloc();
+
+            if (!queued)
+            {
+                throw VideoError("Could not allocate AVPacket");
+            }
+        }
+        else
+        {
+            queued = this->recycled_.back();
+            this->recycled_.pop_back();
+        }
+
+        av_packet_move_ref(queued, packet);
+        this->queued_.push_back(queued);
+        this->size_.store(this->queued_.size(), std::memory_order_relaxed);
+
+        lock.unlock();
+        this->notEmpty_.notify_one();
+    }
+
+    /**
+     ** Blocks until a packet is available, or the queue is closed.
+     **
+     ** @return false when the queue is closed and empty.
+     **/
+    bool Pop(AVPacket *target)
+    {
+        std::unique_lock lock(this->mutex_);
+
+        this->notEmpty_.wait(
+            lock,
+            [this]()
+            {
+                return !this->queued_.empty() || this->isClosed_;
+            });
+
+        if (this->queued_.empty())
+        {
+            return false;
+        }
+
+        AVPacket *queued = this->queued_.front();
+        this->queued_.pop_front();
+        this->size_.store(this->queued_.size(), std::memory_order_relaxed);
+
+        av_packet_move_ref(target, queued);
+        this->recycled_.push_back(queued);
+
+        lock.unlock();
+        this->notFull_.notify_one();
+
+        return true;
+    }
+
+    /**
+     ** Wake the consumer once the remaining packets have been popped.
+     **/
+    void Close()
+    {
+        {
+            std::lock_guard lock(this->mutex_);
+            this->isClosed_ = true;
+        }
+
+        this->notEmpty_.notify_all();
+    }
+
+    /**
+     ** Does not lock, so it may be polled without stalling the queue.
+     **/
+    size_t GetSize() const
+    {
+        return this->size_.load(std::memory_order_relaxed);
+    }
+
+private:
+    size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<AVPacket *> queued_;
+    std::vector<AVPacket *> recycled_;
+    bool isClosed_;
+    std::atomic<size_t> size_;
+};
+
+
+} // end namespace detail
+
+
+} // end namespace clip
@@ -0,0 +1,688 @@
+/**
+  * @file rgb_to_yuv_kernels.h
+  *
+  * @brief Row kernels that convert packed RGB24 to planar YUV.
+  *
+  * Every kernel uses the same 8-bit fixed-point arithmetic, so the SIMD
+  * kernels produce exactly the same bytes as the scalar kernels.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <cstdint>
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+#define CLIP_X86_KERNELS
+#define CLIP_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define CLIP_TARGET_AVX2 __attribute__((target("avx2")))
+
+#endif
+
+
+namespace clip
+{
+
+
+namespace detail
+{
+
+
+struct YuvCoefficients
+{
+    // Weights of red, green, and blue, scaled by 256.
+    int16_t y[3];
+    int16_t u[3];
+    int16_t v[3];
+};
+
+
+// Limited ("tv") range, matching swscale's defaults.
+inline constexpr YuvCoefficients bt601Coefficients{
+    {66, 129, 25},
+    {-38, -74, 112},
+    {112, -94, -18}};
+
+inline constexpr YuvCoefficients bt709Coefficients{
+    {47, 157, 16},
+    {-26, -87, 113},
+    {112, -102, -10}};
+
+
+// Offsets and rounding, scaled by 256.
+// Every weighted sum plus its bias fits in 16 unsigned bits, which lets the
+// SIMD kernels work in 16-bit lanes.
+inline constexpr int32_t lumaBias = (16 << 8) + 128;
+inline constexpr int32_t chromaBias = (128 << 8) + 128;
+
+
+inline uint8_t Weigh(
+    int32_t red,
+    int32_t green,
+    int32_t blue,
+    const int16_t *weights,
+    int32_t bias)
+{
+    return static_cast<uint8_t>(
+        (bias + weights[0] * red + weights[1] * green + weights[2] * blue)
+        >> 8);
+}
+
+
+// Rounded mean of a 2x2 block.
+inline int32_t Average4(int32_t a, int32_t b, int32_t c, int32_t d)
+{
+    return (a + b + c + d + 2) >> 2;
+}
+
+
+/**
+ ** Full resolution chroma.
+ **/
+inline void RgbToYuv444Scalar(
+    const uint8_t *rgb,
+    int width,
+    uint8_t *y,
+    uint8_t *u,
+    uint8_t *v,
+    const YuvCoefficients &coefficients)
+{
+    for (int i = 0; i < width; ++i)
+    {
+        int32_t red = rgb[0];
+        int32_t green = rgb[1];
+        int32_t blue = rgb[2];
+        rgb += 3;
+
+        y[i] = Weigh(red, green, blue, coefficients.y, lumaBias);
+        u[i] = Weigh(red, green, blue, coefficients.u, chromaBias);
+        v[i] = Weigh(red, green, blue, coefficients.v, chromaBias);
+    }
+}
+
+
+/**
+ ** Converts two rows at once. Chroma is computed from the mean color of
+ ** each 2x2 block. width must be even.
+ **/
+inline void RgbToYuv420Scalar(
+    const uint8_t *rgb0,
+    const uint8_t *rgb1,
+    int width,
+    uint8_t *y0,
+    uint8_t *y1,
+    uint8_t *u,
+    uint8_t *v,
+    const YuvCoefficients &coefficients)
+{
+    for (int i = 0; i < width; i += 2)
+    {
+        const uint8_t *a = rgb0 + 3 * i;
+        const uint8_t *b = rgb1 + 3 * i;
+
+        y0[i] = Weigh(a[0], a[1], a[2], coefficients.y, lumaBias);
+        y0[i + 1] = Weigh(a[3], a[4], a[5], coefficients.y, lumaBias);
+        y1[i] = Weigh(b[0], b[1], b[2], coefficients.y, lumaBias);
+        y1[i + 1] = Weigh(b[3], b[4], b[5], coefficients.y, lumaBias);
+
+        int32_t red = Average4(a[0], a[3], b[0], b[3]);
+        int32_t green = Average4(a[1], a[4], b[1], b[4]);
+        int32_t blue = Average4(a[2], a[5], b[2], b[5]);
+
+        u[i / 2] = Weigh(red, green, blue, coefficients.u, chromaBias);
+        v[i / 2] = Weigh(red, green, blue, coefficients.v, chromaBias);
+    }
+}
+
+
+#ifdef CLIP_X86_KERNELS
+
+
+/**
+ ** Split 16 packed RGB24 pixels into 16 bytes of each color.
+ **/
+CLIP_TARGET_SSE41
+inline void Deinterleave16(
+    const uint8_t *rgb,
+    __m128i &red,
+    __m128i &green,
+    __m128i &blue)
+{
+    __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb));
+
+    __m128i second =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb + 16));
+
+    __m128i third =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb + 32));
+
+    red = _mm_or_si128(
+        _mm_or_si128(
+            _mm_shuffle_epi8(
+                first,
+                _mm_setr_epi8(
+                    0, 3, 6, 9, 12, 15, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(
+                second,
+                _mm_setr_epi8(
+                    -1, -1, -1, -1, -1, -1, 2, 5,
+                    8, 11, 14, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(
+            third,
+            _mm_setr_epi8(
+                -1, -1, -1, -1, -1, -1, -1, -1,
+                -1, -1, -1, 1, 4, 7, 10, 13)));
+
+    green = _mm_or_si128(
+        _mm_or_si128(
+            _mm_shuffle_epi8(
+                first,
+                _mm_setr_epi8(
+                    1, 4, 7, 10, 13, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(
+                second,
+                _mm_setr_epi8(
+                    -1, -1, -1, -1, -1, 0, 3, 6,
+                    9, 12, 15, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(
+            third,
+            _mm_setr_epi8(
+                -1, -1, -1, -1, -1, -1, -1, -1,
+                -1, -1, -1, 2, 5, 8, 11, 14)));
+
+    blue = _mm_or_si128(
+        _mm_or_si128(
+            _mm_shuffle_epi8(
+                first,
+                _mm_setr_epi8(
+                    2, 5, 8, 11, 14, -1, -1, -1,
+                    -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(
+                second,
+                _mm_setr_epi8(
+                    -1, -1, -1, -1, -1, 1, 4, 7,
+                    10, 13, -1, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(
+            third,
+            _mm_setr_epi8(
+                -1, -1, -1, -1, -1, -1, -1, -1,
+                -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+
+/**
+ ** Weighted sum of eight 16-bit colors.
+ **
+ ** The true sum is always within 16 unsigned bits, so wrapping
+ ** intermediate results do not change it.
+ **/
+CLIP_TARGET_SSE41
+inline __m128i Weigh8(
+    __m128i red,
+    __m128i green,
+    __m128i blue,
+    const int16_t *weights,
+    int32_t bias)
+{
+    __m128i sum = _mm_set1_epi16(static_cast<int16_t>(bias));
+
+    sum = _mm_add_epi16(
+        sum,
+        _mm_mullo_epi16(red, _mm_set1_epi16(weights[0])));
+
+    sum = _mm_add_epi16(
+        sum,
+        _mm_mullo_epi16(green, _mm_set1_epi16(weights[1])));
+
+    sum = _mm_add_epi16(
+        sum,
+        _mm_mullo_epi16(blue, _mm_set1_epi16(weights[2])));
+
+    return _mm_srli_epi16(sum, 8);
+}
+
+
+/**
+ ** Weighted sum of sixteen 8-bit colors.
+ **/
+CLIP_TARGET_SSE41
+inline __m128i Weigh16(
+    __m128i red,
+    __m128i green,
+    __m128i blue,
+    const int16_t *weights,
+    int32_t bias)
+{
+    __m128i zero = _mm_setzero_si128();
+
+    __m128i low = Weigh8(
+        _mm_cvtepu8_epi16(red),
+        _mm_cvtepu8_epi16(green),
+        _mm_cvtepu8_epi16(blue),
+        weights,
+        bias);
+
+    __m128i high = Weigh8(
+        _mm_unpackhi_epi8(red, zero),
+        _mm_unpackhi_epi8(green, zero),
+        _mm_unpackhi_epi8(blue, zero),
+        weights,
+        bias);
+
+    return _mm_packus_epi16(low, high);
+}
+
+
+/**
+ ** Rounded means of the 2x2 blocks in two rows of 16 colors.
+ **
+ ** @return Eight 16-bit means.
+ **/
+CLIP_TARGET_SSE41
+inline __m128i Average2x2(__m128i first, __m128i second)
+{
+    __m128i ones = _mm_set1_epi8(1);
+
+    __m128i sum = _mm_add_epi16(
+        _mm_maddubs_epi16(first, ones),
+        _mm_maddubs_epi16(second, ones));
+
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+
+CLIP_TARGET_SSE41
+inline void RgbToYuv444Sse41(
+    const uint8_t *rgb,
+    int width,
+    uint8_t *y,
+    uint8_t *u,
+    uint8_t *v,
+    const YuvCoefficients &coefficients)
+{
+    int i = 0;
+
+    for (; i + 16 <= width; i += 16)
+    {
+        __m128i red;
+        __m128i green;
+        __m128i blue;
+
+        Deinterleave16(rgb + 3 * i, red, green, blue);
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(y + i),
+            Weigh16(red, green, blue, coefficients.y, lumaBias));
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(u + i),
+            Weigh16(red, green, blue, coefficients.u, chromaBias));
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(v + i),
+            Weigh16(red, green, blue, coefficients.v, chromaBias));
+    }
+
+    RgbToYuv444Scalar(
+        rgb + 3 * i,
+        width - i,
+        y + i,
+        u + i,
+        v + i,
+        coefficients);
+}
+
+
+CLIP_TARGET_SSE41
+inline void RgbToYuv420Sse41(
+    const uint8_t *rgb0,
+    const uint8_t *rgb1,
+    int width,
+    uint8_t *y0,
+    uint8_t *y1,
+    uint8_t *u,
+    uint8_t *v,
+    const YuvCoefficients &coefficients)
+{
+    int i = 0;
+
+    for (; i + 16 <= width; i += 16)
+    {
+        __m128i red0;
+        __m128i green0;
+        __m128i blue0;
+        __m128i red1;
+        __m128i green1;
+        __m128i blue1;
+
+        Deinterleave16(rgb0 + 3 * i, red0, green0, blue0);
+        Deinterleave16(rgb1 + 3 * i, red1, green1, blue1);
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(y0 + i),
+            Weigh16(red0, green0, blue0, coefficients.y, lumaBias));
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(y1 + i),
+            Weigh16(red1, green1, blue1, coefficients.y, lumaBias));
+
+        __m128i red = Average2x2(red0, red1);
+        __m128i green = Average2x2(green0, green1);
+        __m128i blue = Average2x2(blue0, blue1);
+
+        __m128i chromaU = Weigh8(red, green, blue, coefficients.u, chromaBias);
+        __m128i chromaV = Weigh8(red, green, blue, coefficients.v, chromaBias);
+
+        _mm_storel_epi64(
+            reinterpret_cast<__m128i *>(u + i / 2),
+            _mm_packus_epi16(chromaU, chromaU));
+
+        _mm_storel_epi64(
+            reinterpret_cast<__m128i *>(v + i / 2),
+            _mm_packus_epi16(chromaV, chromaV));
+    }
+
+    RgbToYuv420Scalar(
+        rgb0 + 3 * i,
+        rgb1 + 3 * i,
+        width - i,
+        y0 + i,
+        y1 + i,
+        u + i / 2,
+        v + i / 2,
+        coefficients);
+}
+
+
+/**
+ ** Weighted sum of sixteen 16-bit colors.
+ **/
+CLIP_TARGET_AVX2
+inline __m256i Weigh16x16(
+    __m256i red,
+    __m256i green,
+    __m256i blue,
+    const int16_t *weights,
+    int32_t bias)
+{
+    __m256i sum = _mm256_set1_epi16(static_cast<int16_t>(bias));
+
+    sum = _mm256_add_epi16(
+        sum,
+        _mm256_mullo_epi16(red, _mm256_set1_epi16(weights[0])));
+
+    sum = _mm256_add_epi16(
+        sum,
+        _mm256_mullo_epi16(green, _mm256_set1_epi16(weights[1])));
+
+    sum = _mm256_add_epi16(
+        sum,
+        _mm256_mullo_epi16(blue, _mm256_set1_epi16(weights[2])));
+
+    return _mm256_srli_epi16(sum, 8);
+}
+
+
+/**
+ ** Narrow sixteen 16-bit values to bytes, in order.
+ **/
+CLIP_TARGET_AVX2
+inline __m128i Pack16(__m256i values)
+{
+    return _mm_packus_epi16(
+        _mm256_castsi256_si128(values),
+        _mm256_extracti128_si256(values, 1));
+}
+
+
+CLIP_TARGET_AVX2
+inline __m128i Weigh16Avx2(
+    __m128i red,
+    __m128i green,
+    __m128i blue,
+    const int16_t *weights,
+    int32_t bias)
+{
+    return Pack16(
+        Weigh16x16(
+            _mm256_cvtepu8_epi16(red),
+            _mm256_cvtepu8_epi16(green),
+            _mm256_cvtepu8_epi16(blue),
+            weights,
+            bias));
+}
+
+
+CLIP_TARGET_AVX2
+inline void RgbToYuv444Avx2(
+    const uint8_t *rgb,
+    int width,
+    uint8_t *y,
+    uint8_t *u,
+    uint8_t *v,
+    const YuvCoefficients &coefficients)
+{
+    int i = 0;
+
+    for (; i + 16 <= width; i += 16)
+    {
+        __m128i red;
+        __m128i green;
+        __m128i blue;
+
+        Deinterleave16(rgb + 3 * i, red, green, blue);
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(y + i),
+            Weigh16Avx2(red, green, blue, coefficients.y, lumaBias));
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(u + i),
+            Weigh16Avx2(red, green, blue, coefficients.u, chromaBias));
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(v + i),
+            Weigh16Avx2(red, green, blue, coefficients.v, chromaBias));
+    }
+
+    RgbToYuv444Scalar(
+        rgb + 3 * i,
+        width - i,
+        y + i,
+        u + i,
+        v + i,
+        coefficients);
+}
+
+
+CLIP_TARGET_AVX2
+inline void RgbToYuv420Avx2(
+    const uint8_t *rgb0,
+    const uint8_t *rgb1,
+    int width,
+    uint8_t *y0,
+    uint8_t *y1,
+    uint8_t *u,
+    uint8_t *v,
+    const YuvCoefficients &coefficients)
+{
+    int i = 0;
+
+    for (; i + 32 <= width; i += 32)
+    {
+        __m128i red[4];
+        __m128i green[4];
+        __m128i blue[4];
+
+        // Two groups of sixteen pixels from each row.
+        Deinterleave16(rgb0 + 3 * i, red[0], green[0], blue[0]);
+        Deinterleave16(rgb0 + 3 * (i + 16), red[1], green[1], blue[1]);
+        Deinterleave16(rgb1 + 3 * i, red[2], green[2], blue[2]);
+        Deinterleave16(rgb1 + 3 * (i + 16), red[3], green[3], blue[3]);
+
+        for (int group = 0; group < 2; ++group)
+        {
+            _mm_storeu_si128(
+                reinterpret_cast<__m128i *>(y0 + i + 16 * group),
+                Weigh16Avx2(
+                    red[group],
+                    green[group],
+                    blue[group],
+                    coefficients.y,
+                    lumaBias));
+
+            _mm_storeu_si128(
+                reinterpret_cast<__m128i *>(y1 + i + 16 * group),
+                Weigh16Avx2(
+                    red[group + 2],
+                    green[group + 2],
+                    blue[group + 2],
+                    coefficients.y,
+                    lumaBias));
+        }
+
+        __m256i meanRed = _mm256_set_m128i(
+            Average2x2(red[1], red[3]),
+            Average2x2(red[0], red[2]));
+
+        __m256i meanGreen = _mm256_set_m128i(
+            Average2x2(green[1], green[3]),
+            Average2x2(green[0], green[2]));
+
+        __m256i meanBlue = _mm256_set_m128i(
+            Average2x2(blue[1], blue[3]),
+            Average2x2(blue[0], blue[2]));
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(u + i / 2),
+            Pack16(
+                Weigh16x16(
+                    meanRed,
+                    meanGreen,
+                    meanBlue,
+                    coefficients.u,
+                    chromaBias)));
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i *>(v + i / 2),
+            Pack16(
+                Weigh16x16(
+                    meanRed,
+                    meanGreen,
+                    meanBlue,
+                    coefficients.v,
+                    chromaBias)));
+    }
+
+    RgbToYuv420Sse41(
+        rgb0 + 3 * i,
+        rgb1 + 3 * i,
+        width - i,
+        y0 + i,
+        y1 + i,
+        u + i / 2,
+        v + i / 2,
+        coefficients);
+}
+
+
+#endif // CLIP_X86_KERNELS
+
+
+enum class SimdLevel: uint8_t
+{
+    scalar = 0,
+    sse41,
+    avx2
+};
+
+
+inline SimdLevel GetSimdLevel()
+{
+#ifdef CLIP_X86_KERNELS
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SimdLevel::avx2;
+    }
+
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        return SimdLevel::sse41;
+    }
+#endif
+
+    return SimdLevel::scalar;
+}
+
+
+using RgbToYuv444Kernel = void (*)(
+    const uint8_t *rgb,
+    int width,
+    uint8_t *y,
+    uint8_t *u,
+    uint8_t *v,
+    const YuvCoefficients &coefficients);
+
+
+using RgbToYuv420Kernel = void (*)(
+    const uint8_t *rgb0,
+    const uint8_t *rgb1,
+    int width,
+    uint8_t *y0,
+    uint8_t *y1,
+    uint8_t *u,
+    uint8_t *v,
+    const YuvCoefficients &coefficients);
+
+
+inline RgbToYuv444Kernel GetRgbToYuv444Kernel(SimdLevel simdLevel)
+{
+    switch (simdLevel)
+    {
+#ifdef CLIP_X86_KERNELS
+        case SimdLevel::avx2:
+            return &RgbToYuv444Avx2;
+
+        case SimdLevel::sse41:
+            return &RgbToYuv444Sse41;
+#endif
+
+        default:
+            return &RgbToYuv444Scalar;
+    }
+}
+
+
+inline RgbToYuv420Kernel GetRgbToYuv420Kernel(SimdLevel simdLevel)
+{
+    switch (simdLevel)
+    {
+#ifdef CLIP_X86_KERNELS
+        case SimdLevel::avx2:
+            return &RgbToYuv420Avx2;
+
+        case SimdLevel::sse41:
+            return &RgbToYuv420Sse41;
+#endif
+
+        default:
+            return &RgbToYuv420Scalar;
+    }
+}
+
+
+} // end namespace detail
+
+
+} // end namespace clip
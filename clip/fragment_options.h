@@ -0,0 +1,113 @@
+/**
+  * @file fragment_options.h
+  *
+  * @brief Options that make the mp4 and mov muxers write fragments.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include "clip/ffmpeg_shim.h"
+FFMPEG_SHIM_PUSH_IGNORES
+extern "C"
+{
+
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+
+}
+FFMPEG_SHIM_POP_IGNORES
+
+
+#include <chrono>
+#include <string>
+#include "clip/dictionary.h"
+#include "clip/error.h"
+
+
+namespace clip
+{
+
+
+/**
+ ** A fragmented mp4 starts with an empty moov, and follows it with
+ ** self-contained fragments (moof and mdat). The muxer only indexes the
+ ** current fragment, so memory use does not grow with the length of the
+ ** recording. Each completed fragment is flushed to the AVIOContext, so
+ ** the file can be read while it is written, and a crash only loses the
+ ** last fragment.
+ **/
+struct FragmentOptions
+{
+    // Start a fragment at each video keyframe.
+    bool fragmentOnKeyframe;
+
+    // Start a fragment when the current one is this long. Combined with
+    // fragmentOnKeyframe, fragments start at the first keyframe after
+    // fragmentDuration. Zero disables it.
+    std::chrono::microseconds fragmentDuration;
+
+    static FragmentOptions MakeDefault()
+    {
+        return {
+            .fragmentOnKeyframe = true,
+            .fragmentDuration = std::chrono::microseconds(0)};
+    }
+
+    /**
+     ** Add the muxer options to the dictionary passed to
+     ** OutputContext::Initialize.
+     **/
+    void AddTo(Dictionary &formatOptions) const
+    {
+        if (!this->fragmentOnKeyframe && this->fragmentDuration.count() <= 0)
+        {
+            throw ClipError(
+                "Fragments require fragmentOnKeyframe or a fragmentDuration.");
+        }
+
+        // default_base_moof makes each fragment's offsets relative to its
+        // own moof, so fragments can be read without the ones before them.
+        std::string flags = "empty_moov+default_base_moof";
+
+        if (this->fragmentOnKeyframe)
+        {
+            flags += "+frag_keyframe";
+        }
+
+        formatOptions.Set("movflags", flags);
+
+        if (this->fragmentDuration.count() > 0)
+        {
+            formatOptions.Set(
+                "frag_duration",
+                std::to_string(this->fragmentDuration.count()));
+        }
+    }
+
+    /**
+     ** @return true if the output format understands these options.
+     **/
+    static bool IsSupported(const AVOutputFormat *outputFormat)
+    {
+        if (!outputFormat->priv_class)
+        {
+            return false;
+        }
+
+        return NULL != av_opt_find(
+            const_cast<const AVClass **>(&outputFormat->priv_class),
+            "frag_duration",
+            NULL,
+            0,
+            AV_OPT_SEARCH_FAKE_OBJ);
+    }
+};
+
+
+} // end namespace clip
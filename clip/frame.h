@@ -88,6 +88,21 @@ public:
         }
     }
 
+    /**
+     ** A frame without buffers, to be filled by a decoder.
+     **/
+    static Frame MakeEmpty()
+    {
+        AVFrame *frame = av_frame_alloc();
+
+        if (!frame)
+        {
+            throw VideoError("Error allocating a frame");
+        }
+
+        return Frame(frame);
+    }
+
     ~Frame()
     {
         if (this->frame_)
@@ -127,6 +142,11 @@ public:
         return this->frame_;
     }
 
+    operator const AVFrame * () const
+    {
+        return this->frame_;
+    }
+
     const AVFrame * operator->() const
     {
         return this->frame_;
@@ -161,6 +181,8 @@ public:
     }
 
 private:
+    explicit Frame(AVFrame *frame): frame_(frame) {}
+
     AVFrame * frame_;
 };
 
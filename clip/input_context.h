@@ -0,0 +1,330 @@
+/**
+  * @file input_context.h
+  *
+  * @brief Wrapper around AVFormatContext for reading media files.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+#include "clip/ffmpeg_shim.h"
+FFMPEG_SHIM_PUSH_IGNORES
+extern "C"
+{
+
+#include <libavformat/avformat.h>
+
+}
+FFMPEG_SHIM_POP_IGNORES
+
+
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+#include "clip/error.h"
+#include "clip/dictionary.h"
+#include "clip/packet.h"
+
+
+namespace clip
+{
+
+
+CREATE_EXCEPTION(InputError, VideoError);
+
+
+class InputContext
+{
+public:
+    /**
+     ** Iterates the packets of every stream that is not discarded, in the
+     ** order they are stored.
+     **
+     ** Each packet refers to the demuxer's buffer, so the payload is never
+     ** copied. A packet is only valid until the iterator is incremented.
+     **/
+    class PacketIterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = InputPacket;
+        using difference_type = std::ptrdiff_t;
+        using pointer = InputPacket *;
+        using reference = InputPacket &;
+
+        PacketIterator()
+            :
+            inputContext_(NULL),
+            packet_()
+        {
+
+        }
+
+        explicit PacketIterator(InputContext &inputContext)
+            :
+            inputContext_(&inputContext),
+            packet_(inputContext.ReadPacket_())
+        {
+
+        }
+
+        InputPacket & operator*()
+        {
+            return this->packet_;
+        }
+
+        InputPacket * operator->()
+        {
+            return &this->packet_;
+        }
+
+        PacketIterator & operator++()
+        {
+            // Release the current packet before the demuxer reuses it.
+            this->packet_ = InputPacket();
+            this->packet_ = this->inputContext_->ReadPacket_();
+
+            return *this;
+        }
+
+        // Iterators are only equal at the end of the input.
+        bool operator==(const PacketIterator &other) const
+        {
+            return this->IsEnd_() && other.IsEnd_();
+        }
+
+        bool operator!=(const PacketIterator &other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        bool IsEnd_() const
+        {
+            return static_cast<AVPacket *>(this->packet_) == NULL;
+        }
+
+        InputContext *inputContext_;
+        InputPacket packet_;
+    };
+
+    class Packets
+    {
+    public:
+        explicit Packets(InputContext &inputContext)
+            :
+            inputContext_(inputContext)
+        {
+
+        }
+
+        PacketIterator begin()
+        {
+            return PacketIterator(this->inputContext_);
+        }
+
+        PacketIterator end()
+        {
+            return PacketIterator();
+        }
+
+    private:
+        InputContext &inputContext_;
+    };
+
+    /**
+     ** options are passed to avformat_open_input.
+     **/
+    explicit InputContext(
+        const std::string &fileName,
+        Dictionary options = Dictionary())
+        :
+        context_(NULL),
+        packet_(av_packet_alloc())
+    {
+        if (!this->packet_)
+        {
+            throw InputError("Could not allocate AVPacket");
+        }
+
+        int result = avformat_open_input(
+            &this->context_,
+            fileName.c_str(),
+            NULL,
+            options.Get());
+
+        if (result < 0)
+        {
+            av_packet_free(&this->packet_);
+
+            throw InputError(
+                DescribeError("Failed to open " + fileName, result));
+        }
+
+        result = avformat_find_stream_info(this->context_, NULL);
+
+        if (result < 0)
+        {
+            avformat_close_input(&this->context_);
+            av_packet_free(&this->packet_);
+
+            throw InputError(
+                DescribeError("Failed to find stream info", result));
+        }
+    }
+
+    InputContext(const InputContext &) = delete;
+    InputContext & operator=(const InputContext &) = delete;
+
+    ~InputContext()
+    {
+        if (this->packet_)
+        {
+            av_packet_free(&this->packet_);
+        }
+
+        if (this->context_)
+        {
+            avformat_close_input(&this->context_);
+        }
+    }
+
+    operator AVFormatContext * () const
+    {
+        return this->context_;
+    }
+
+    AVFormatContext * operator->() const
+    {
+        return this->context_;
+    }
+
+    int GetStreamCount() const
+    {
+        return static_cast<int>(this->context_->nb_streams);
+    }
+
+    const AVStream * GetStream(int streamIndex) const
+    {
+        return this->context_->streams[this->RequireStream_(streamIndex)];
+    }
+
+    /**
+     ** @return The stream ffmpeg considers the best of its type, if any.
+     **/
+    std::optional<int> FindBestStream(AVMediaType mediaType) const
+    {
+        int result =
+            av_find_best_stream(this->context_, mediaType, -1, -1, NULL, 0);
+
+        if (result < 0)
+        {
+            return {};
+        }
+
+        return result;
+    }
+
+    /**
+     ** Choose which packets the demuxer returns for a stream.
+     **
+     ** With AVDISCARD_ALL, the demuxer skips the stream's packets instead of
+     ** allocating them.
+     **/
+    void SetDiscard(int streamIndex, AVDiscard discard)
+    {
+        this->context_->streams[this->RequireStream_(streamIndex)]->discard =
+            discard;
+    }
+
+    /**
+     ** Read only the packets of streamIndices, and discard all others.
+     **/
+    void SelectStreams(const std::vector<int> &streamIndices)
+    {
+        for (int i = 0; i < this->GetStreamCount(); ++i)
+        {
+            this->SetDiscard(i, AVDISCARD_ALL);
+        }
+
+        for (int streamIndex: streamIndices)
+        {
+            this->SetDiscard(streamIndex, AVDISCARD_DEFAULT);
+        }
+    }
+
+    /**
+     ** Move the demuxer to the keyframe at or before timestamp, in the time
+     ** base of streamIndex.
+     **
+     ** Packet iterators must not be in use.
+     **/
+    void Seek(int streamIndex, int64_t timestamp)
+    {
+        int result = av_seek_frame(
+            this->context_,
+            static_cast<int>(this->RequireStream_(streamIndex)),
+            timestamp,
+            AVSEEK_FLAG_BACKWARD);
+
+        if (result < 0)
+        {
+            throw InputError(DescribeError("Failed to seek", result));
+        }
+    }
+
+    /**
+     ** Iterate the packets from the current position.
+     **
+     ** Only one iteration may be in progress at a time.
+     **/
+    Packets GetPackets()
+    {
+        return Packets(*this);
+    }
+
+private:
+    size_t RequireStream_(int streamIndex) const
+    {
+        if (streamIndex < 0 || streamIndex >= this->GetStreamCount())
+        {
+            throw InputError("Stream index out of range");
+        }
+
+        return static_cast<size_t>(streamIndex);
+    }
+
+    /**
+     ** @return An empty InputPacket at the end of the input.
+     **/
+    InputPacket ReadPacket_()
+    {
+        int result = av_read_frame(this->context_, this->packet_);
+
+        if (result == AVERROR_EOF)
+        {
+            return InputPacket();
+        }
+
+        if (result < 0)
+        {
+            throw InputError(DescribeError("Failed to read packet", result));
+        }
+
+        return InputPacket(this->packet_);
+    }
+
+    AVFormatContext *context_;
+
+    // Refers to the demuxer's data for the packet being read.
+    AVPacket *packet_;
+};
+
+
+} // end namespace clip
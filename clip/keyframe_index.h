@@ -0,0 +1,464 @@
+/**
+  * @file keyframe_index.h
+  *
+  * @brief An index of the packets of a video stream, stored beside the file
+  *     so that frames can be found without scanning.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include "clip/ffmpeg_shim.h"
+FFMPEG_SHIM_PUSH_IGNORES
+extern "C"
+{
+
+#include <libavformat/avformat.h>
+
+}
+FFMPEG_SHIM_POP_IGNORES
+
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "clip/error.h"
+#include "clip/input_context.h"
+
+
+namespace clip
+{
+
+
+CREATE_EXCEPTION(IndexError, VideoError);
+
+
+struct IndexEntry
+{
+    static constexpr uint32_t keyframe = 1;
+
+    // In the time base of the indexed stream.
+    int64_t pts;
+    int64_t dts;
+
+    // Byte offset of the packet in the file, or -1 when the demuxer does not
+    // report it.
+    int64_t position;
+
+    int32_t size;
+    uint32_t flags;
+
+    bool GetIsKeyframe() const
+    {
+        return (this->flags & keyframe) != 0;
+    }
+};
+
+
+static_assert(sizeof(IndexEntry) == 32);
+static_assert(std::is_trivially_copyable_v<IndexEntry>);
+
+
+namespace detail
+{
+
+
+struct IndexHeader
+{
+    static constexpr char expectedMagic[8] = {
+        'c', 'l', 'i', 'p', 'i', 'd', 'x', '\0'};
+
+    static constexpr uint32_t currentVersion = 1;
+
+    char magic[8];
+    uint32_t version;
+    int32_t streamIndex;
+    int32_t timeBaseNumerator;
+    int32_t timeBaseDenominator;
+    uint64_t count;
+};
+
+
+static_assert(sizeof(IndexHeader) == 32);
+
+
+/**
+ ** A read-only memory mapping of a whole file.
+ **/
+class MappedFile
+{
+public:
+    MappedFile()
+        :
+        data_(NULL),
+        size_(0)
+    {
+
+    }
+
+    explicit MappedFile(const std::string &fileName)
+        :
+        data_(NULL),
+        size_(0)
+    {
+        int file = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (file < 0)
+        {
+            throw IndexError(
+                "Unable to open " + fileName + ": " + std::strerror(errno));
+        }
+
+        struct stat status;
+
+        if (fstat(file, &status) < 0)
+        {
+            int error = errno;
+            close(file);
+
+            throw IndexError(
+                "Unable to stat " + fileName + ": " + std::strerror(error));
+        }
+
+        this->size_ = static_cast<size_t>(status.st_size);
+
+        if (this->size_ > 0)
+        {
+            void *data =
+                mmap(NULL, this->size_, PROT_READ, MAP_SHARED, file, 0);
+
+            if (data == MAP_FAILED)
+            {
+                int error = errno;
+                close(file);
+
+                throw IndexError(
+                    "Unable to map " + fileName + ": " + std::strerror(error));
+            }
+
+            this->data_ = static_cast<const char *>(data);
+        }
+
+        // The mapping remains valid after the file is closed.
+        close(file);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other)
+        :
+        data_(other.data_),
+        size_(other.size_)
+    {
+        other.data_ = NULL;
+        other.size_ = 0;
+    }
+
+    MappedFile & operator=(MappedFile &&other)
+    {
+        if (this != &other)
+        {
+            this->Unmap_();
+            this->data_ = other.data_;
+            this->size_ = other.size_;
+            other.data_ = NULL;
+            other.size_ = 0;
+        }
+
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        this->Unmap_();
+    }
+
+    const char * GetData() const
+    {
+        return this->data_;
+    }
+
+    size_t GetSize() const
+    {
+        return this->size_;
+    }
+
+private:
+    void Unmap_()
+    {
+        if (this->data_)
+        {
+            munmap(const_cast<char *>(this->data_), this->size_);
+            this->data_ = NULL;
+        }
+    }
+
+    const char *data_;
+    size_t size_;
+};
+
+
+} // end namespace detail
+
+
+/**
+ ** The packets of one stream, in presentation order, so entry n describes
+ ** frame n.
+ **
+ ** Built by reading every packet once, without decoding. The sidecar file
+ ** holds a fixed header followed by the entries, in the byte order of the
+ ** machine that wrote it, and is memory-mapped when loaded.
+ **/
+class KeyframeIndex
+{
+public:
+    KeyframeIndex(
+        int streamIndex,
+        AVRational timeBase,
+        std::vector<IndexEntry> entries)
+        :
+        streamIndex_(streamIndex),
+        timeBase_(timeBase),
+        entries_(std::move(entries)),
+        mapped_(),
+        data_(NULL),
+        count_(0)
+    {
+        std::stable_sort(
+            this->entries_.begin(),
+            this->entries_.end(),
+            [](const IndexEntry &first, const IndexEntry &second)
+            {
+                return first.pts < second.pts;
+            });
+
+        this->data_ = this->entries_.data();
+        this->count_ = this->entries_.size();
+    }
+
+    KeyframeIndex(KeyframeIndex &&) = default;
+    KeyframeIndex & operator=(KeyframeIndex &&) = default;
+
+    /**
+     ** Index the best video stream of fileName.
+     **/
+    static KeyframeIndex Build(const std::string &fileName)
+    {
+        InputContext inputContext(fileName);
+        auto streamIndex = inputContext.FindBestStream(AVMEDIA_TYPE_VIDEO);
+
+        if (!streamIndex)
+        {
+            throw IndexError("Unable to find a video stream in " + fileName);
+        }
+
+        return Build(inputContext, *streamIndex);
+    }
+
+    /**
+     ** Read the remaining packets of inputContext.
+     **
+     ** The packets of every other stream are discarded.
+     **/
+    static KeyframeIndex Build(InputContext &inputContext, int streamIndex)
+    {
+        inputContext.SelectStreams({streamIndex});
+
+        std::vector<IndexEntry> entries;
+
+        for (auto &packet: inputContext.GetPackets())
+        {
+            int64_t pts = (packet->pts != AV_NOPTS_VALUE)
+                ? packet->pts
+                : packet->dts;
+
+            if (pts == AV_NOPTS_VALUE)
+            {
+                throw IndexError(
+                    "Packets without timestamps cannot be indexed");
+            }
+
+            entries.push_back(
+                IndexEntry{
+                    pts,
+                    (packet->dts != AV_NOPTS_VALUE) ? packet->dts : pts,
+                    packet->pos,
+                    packet->size,
+                    (packet->flags & AV_PKT_FLAG_KEY) ? IndexEntry::keyframe
+                        : 0u});
+        }
+
+        return KeyframeIndex(
+            streamIndex,
+            inputContext.GetStream(streamIndex)->time_base,
+            std::move(entries));
+    }
+
+    /**
+     ** Map an index written by Save.
+     **/
+    static KeyframeIndex Load(const std::string &fileName)
+    {
+        detail::MappedFile mapped(fileName);
+
+        detail::IndexHeader header;
+
+        if (mapped.GetSize() < sizeof(header))
+        {
+            throw IndexError(fileName + " is not a keyframe index");
+        }
+
+        std::memcpy(&header, mapped.GetData(), sizeof(header));
+
+        if (
+            std::memcmp(
+                header.magic,
+                detail::IndexHeader::expectedMagic,
+                sizeof(header.magic)) != 0)
+        {
+            throw IndexError(fileName + " is not a keyframe index");
+        }
+
+        if (header.version != detail::IndexHeader::currentVersion)
+        {
+            throw IndexError(
+                "Unsupported keyframe index version in " + fileName);
+        }
+
+        size_t entryBytes = mapped.GetSize() - sizeof(header);
+
+        if (
+            entryBytes % sizeof(IndexEntry) != 0
+            || header.count != entryBytes / sizeof(IndexEntry))
+        {
+            throw IndexError(fileName + " is truncated");
+        }
+
+        return KeyframeIndex(header, std::move(mapped));
+    }
+
+    void Save(const std::string &fileName) const
+    {
+        detail::IndexHeader header{};
+
+        std::memcpy(
+            header.magic,
+            detail::IndexHeader::expectedMagic,
+            sizeof(header.magic));
+
+        header.version = detail::IndexHeader::currentVersion;
+        header.streamIndex = this->streamIndex_;
+        header.timeBaseNumerator = this->timeBase_.num;
+        header.timeBaseDenominator = this->timeBase_.den;
+        header.count = this->count_;
+
+        std::ofstream output(fileName, std::ios::binary | std::ios::trunc);
+
+        output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        output.write(
+            reinterpret_cast<const char *>(this->data_),
+            static_cast<std::streamsize>(this->count_ * sizeof(IndexEntry)));
+
+        output.close();
+
+        if (!output)
+        {
+            throw IndexError("Failed to write " + fileName);
+        }
+    }
+
+    int GetStreamIndex() const
+    {
+        return this->streamIndex_;
+    }
+
+    AVRational GetTimeBase() const
+    {
+        return this->timeBase_;
+    }
+
+    size_t GetCount() const
+    {
+        return this->count_;
+    }
+
+    const IndexEntry & operator[](size_t frameIndex) const
+    {
+        if (frameIndex >= this->count_)
+        {
+            throw IndexError("Frame index out of range");
+        }
+
+        return this->data_[frameIndex];
+    }
+
+    /**
+     ** @return The index of the last keyframe at or before frameIndex, where
+     ** decoding must start to reach frameIndex.
+     **/
+    size_t FindKeyframe(size_t frameIndex) const
+    {
+        if (frameIndex >= this->count_)
+        {
+            throw IndexError("Frame index out of range");
+        }
+
+        // At most one group of pictures is searched.
+        for (size_t i = frameIndex + 1; i > 0; --i)
+        {
+            if (this->data_[i - 1].GetIsKeyframe())
+            {
+                return i - 1;
+            }
+        }
+
+        // Streams that do not start with a keyframe are decoded from the
+        // beginning.
+        return 0;
+    }
+
+private:
+    KeyframeIndex(const detail::IndexHeader &header, detail::MappedFile mapped)
+        :
+        streamIndex_(header.streamIndex),
+        timeBase_{header.timeBaseNumerator, header.timeBaseDenominator},
+        entries_(),
+        mapped_(std::move(mapped)),
+        data_(
+            reinterpret_cast<const IndexEntry *>(
+                this->mapped_.GetData() + sizeof(header))),
+        count_(static_cast<size_t>(header.count))
+    {
+
+    }
+
+    int streamIndex_;
+    AVRational timeBase_;
+
+    // Entries are in either the vector or the mapping.
+    std::vector<IndexEntry> entries_;
+    detail::MappedFile mapped_;
+
+    const IndexEntry *data_;
+    size_t count_;
+};
+
+
+} // end namespace clip
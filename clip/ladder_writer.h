@@ -0,0 +1,265 @@
+/**
+  * @file ladder_writer.h
+  *
+  * @brief Writes one source to several VideoOutputs at decreasing
+  *     resolutions.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <algorithm>
+#include <vector>
+#include "clip/error.h"
+#include "clip/reformat.h"
+#include "clip/video_output.h"
+
+
+namespace clip
+{
+
+
+/**
+ ** Each source frame is converted to yuv420p once, at full resolution.
+ ** Every rung of the ladder is then scaled from the next larger rung,
+ ** directly into the frame of its VideoOutput.
+ **
+ ** The VideoOutputs must accept yuv420p frames (inPixelFormat ==
+ ** outPixelFormat == AV_PIX_FMT_YUV420P). Give each one an
+ ** encoderQueueDepth, so that the rungs are encoded on their own threads
+ ** while the next source frame is prepared.
+ **/
+class LadderWriter
+{
+public:
+    static constexpr AVPixelFormat ladderFormat = AV_PIX_FMT_YUV420P;
+
+    LadderWriter(
+        AVPixelFormat sourceFormat,
+        const Resolution &sourceResolution,
+        const std::vector<VideoOutput *> &outputs)
+        :
+        sourceResolution_(sourceResolution),
+        source_(
+            sourceFormat,
+            sourceResolution.height,
+            sourceResolution.width),
+        converter_(),
+        fullResolution_(),
+        rungs_()
+    {
+        if (outputs.empty())
+        {
+            throw VideoError("LadderWriter requires at least one output.");
+        }
+
+        for (VideoOutput *output: outputs)
+        {
+            const auto &options = output->GetOptions();
+
+            if (
+                options.inPixelFormat != ladderFormat
+                || options.outPixelFormat != ladderFormat)
+            {
+                throw VideoError("Ladder outputs must use yuv420p.");
+            }
+
+            this->rungs_.push_back({output, output->GetResolution(), {}});
+        }
+
+        // Largest first, so that each rung is scaled from a larger one.
+        std::stable_sort(
+            this->rungs_.begin(),
+            this->rungs_.end(),
+            [](const Rung &first, const Rung &second)
+            {
+                return GetArea(first.resolution) > GetArea(second.resolution);
+            });
+
+        const auto &firstOptions = this->rungs_.front().output->GetOptions();
+
+        auto converterOptions = firstOptions;
+        converterOptions.width = sourceResolution.width;
+        converterOptions.height = sourceResolution.height;
+        converterOptions.inPixelFormat = sourceFormat;
+        converterOptions.outPixelFormat = ladderFormat;
+
+        this->converter_ = detail::FrameConverter(converterOptions);
+
+        Resolution parent = sourceResolution;
+
+        if (this->rungs_.front().resolution != sourceResolution)
+        {
+            // No rung matches the source, so a full resolution frame is
+            // needed to scale from.
+            this->fullResolution_ = Frame(
+                ladderFormat,
+                sourceResolution.height,
+                sourceResolution.width);
+        }
+
+        for (auto &rung: this->rungs_)
+        {
+            if (rung.resolution != parent)
+            {
+                rung.scale = Reformat(
+                    parent,
+                    ladderFormat,
+                    rung.resolution,
+                    ladderFormat,
+                    scaleFlag,
+                    rung.output->GetOptions().reformatThreadCount);
+            }
+
+            parent = rung.resolution;
+        }
+    }
+
+    /**
+     ** Borrow the source frame. Fill it in place, then call Commit().
+     **
+     ** Only packed source formats are supported.
+     **/
+    VideoFrameMap AcquireFrame()
+    {
+        auto sourceFormat = static_cast<AVPixelFormat>(this->source_->format);
+
+        if (av_pix_fmt_count_planes(sourceFormat) != 1)
+        {
+            throw VideoError(
+                "AcquireFrame requires a packed source pixel format.");
+        }
+
+        int dataWidth = av_image_get_linesize(
+            sourceFormat,
+            this->sourceResolution_.width,
+            0);
+
+        if (dataWidth < 0)
+        {
+            throw VideoError(
+                DescribeError("Unable to compute frame data width", dataWidth));
+        }
+
+        return VideoFrameMap(
+            this->source_->data[0],
+            this->sourceResolution_.height,
+            dataWidth,
+            Eigen::OuterStride<>(this->source_->linesize[0]));
+    }
+
+    /**
+     ** Convert the source frame, and scale it down the ladder.
+     **/
+    void Commit()
+    {
+        const AVFrame *parent = NULL;
+
+        for (auto &rung: this->rungs_)
+        {
+            AVFrame *target = rung.output->GetNextFrame();
+
+            if (!parent)
+            {
+                if (this->fullResolution_)
+                {
+                    this->converter_(this->source_, this->fullResolution_);
+                    rung.scale(this->fullResolution_, target);
+                }
+                else
+                {
+                    // The largest rung is the source resolution.
+                    this->converter_(this->source_, target);
+                }
+            }
+            else if (rung.scale)
+            {
+                rung.scale(parent, target);
+            }
+            else
+            {
+                // Two rungs with the same resolution.
+                int result = av_frame_copy(target, parent);
+
+                if (result < 0)
+                {
+                    throw VideoError(
+                        DescribeError("Unable to copy frame", result));
+                }
+            }
+
+            parent = target;
+        }
+
+        // The smaller rungs have been scaled from the larger ones, so no
+        // encoder receives its frame until all of them are filled.
+        for (auto &rung: this->rungs_)
+        {
+            rung.output->Commit();
+        }
+    }
+
+    /**
+     ** Write packed, row-major source data.
+     **/
+    template<typename Derived>
+    void operator()(const Eigen::DenseBase<Derived> &data)
+    {
+        VideoFrameMap frame = this->AcquireFrame();
+
+        frame =
+            Eigen::Reshaped<
+                const Derived,
+                Eigen::Dynamic,
+                Eigen::Dynamic,
+                Eigen::RowMajor>(
+                    data.derived(),
+                    frame.rows(),
+                    frame.cols());
+
+        this->Commit();
+    }
+
+    TimeStamp GetTimeStamp() const
+    {
+        return this->rungs_.front().output->GetTimeStamp();
+    }
+
+    void Flush()
+    {
+        for (auto &rung: this->rungs_)
+        {
+            rung.output->Flush();
+        }
+    }
+
+private:
+    static int64_t GetArea(const Resolution &resolution)
+    {
+        return static_cast<int64_t>(resolution.width) * resolution.height;
+    }
+
+    struct Rung
+    {
+        VideoOutput *output;
+        Resolution resolution;
+
+        // Scales from the previous rung, or the full resolution frame.
+        // Empty when the resolutions match.
+        Reformat scale;
+    };
+
+    Resolution sourceResolution_;
+    Frame source_;
+    detail::FrameConverter converter_;
+    Frame fullResolution_;
+    std::vector<Rung> rungs_;
+};
+
+
+} // end namespace clip
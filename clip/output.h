@@ -22,6 +22,8 @@
 #include "clip/time_stamp.h"
 #include "clip/frame.h"
 #include "clip/packet.h"
+#include "clip/output_statistics.h"
+#include "clip/thread_budget.h"
 
 
 namespace clip
@@ -41,6 +43,17 @@ public:
         {
             // The encoder is still working through frames.
         };
+
+        // Report any failure to write packets on the mux thread.
+        this->outputContext_->ThrowIfMuxFailed();
+    }
+
+    /**
+     ** Safe to call from any thread while encoding.
+     **/
+    OutputStatisticsSnapshot GetStatistics() const
+    {
+        return this->statistics_->GetSnapshot();
     }
 
     Output(const Output &) = delete;
@@ -57,7 +70,9 @@ protected:
         outputContext_(outputContext),
         codec_(codecId),
         codecContext_(this->codec_),
-        stream_(*outputContext)
+        stream_(*outputContext),
+        statistics_(std::make_shared<OutputStatistics>()),
+        threadLease_(AcquireLease_(this->codec_))
     {
         if (outputContext->GetIsInitialized())
         {
@@ -66,6 +81,10 @@ protected:
                 "initializing the OutputContext.");
         }
 
+        outputContext->RegisterStatistics(
+            this->stream_->index,
+            this->statistics_);
+
         /* Some formats want stream headers to be separate. */
         if ((*this->outputContext_)->oformat->flags & AVFMT_GLOBALHEADER)
         {
@@ -84,8 +103,15 @@ protected:
             throw OutputError("OutputContext is not initialized.");
         }
 
+        using Stage = OutputStatistics::Stage;
+
         // send the frame to the encoder
-        int result = avcodec_send_frame(this->codecContext_, source);
+        int result = this->statistics_->Time(
+            Stage::send,
+            [&]()
+            {
+                return avcodec_send_frame(this->codecContext_, source);
+            });
 
         if (result < 0)
         {
@@ -93,9 +119,21 @@ protected:
                 DescribeError("Error sending a frame to the encoder", result));
         }
 
+        if (source)
+        {
+            this->statistics_->AddFrame();
+        }
+
         while (result >= 0)
         {
-            result = avcodec_receive_packet(this->codecContext_, this->packet_);
+            result = this->statistics_->Time(
+                Stage::receive,
+                [&]()
+                {
+                    return avcodec_receive_packet(
+                        this->codecContext_,
+                        this->packet_);
+                });
 
             if (result == AVERROR(EAGAIN) || result == AVERROR_EOF)
             {
@@ -115,25 +153,11 @@ protected:
 
             this->packet_->stream_index = this->stream_->index;
 
-#ifndef NDEBUG
-            LogPacket(std::cout, *this->outputContext_, this->packet_);
-#endif
-
             // Write the compressed frame to the media file.
-            result = av_interleaved_write_frame(
-                *this->outputContext_,
-                this->packet_);
-
-            /* packet is now blank (av_interleaved_write_frame() takes
-             * ownership of its contents and resets packet), so that no
-             * unreferencing is necessary.  This would be different if one used
-             * av_write_frame(). */
-
-            if (result < 0)
-            {
-                throw OutputError(
-                    DescribeError("Error writing output packet", result));
-            }
+            // packet is now blank (av_interleaved_write_frame() takes
+            // ownership of its contents and resets packet), so that no
+            // unreferencing is necessary.
+            this->outputContext_->WritePacket(this->packet_);
         }
 
         return (result == AVERROR_EOF);
@@ -147,8 +171,25 @@ protected:
     Codec codec_;
     CodecContext codecContext_;
     Stream stream_;
+    std::shared_ptr<OutputStatistics> statistics_;
+
+    // Counts a video output in the ThreadBudget until it is destroyed.
+    // Audio outputs hold an empty lease, with a share of one thread.
+    ThreadBudget::Lease threadLease_;
 
 private:
+    static ThreadBudget::Lease AcquireLease_(const AVCodec *codec)
+    {
+        // Audio encoders need little time, and would only reduce the share
+        // of the video encoders that they run beside.
+        if (codec->type != AVMEDIA_TYPE_VIDEO)
+        {
+            return {};
+        }
+
+        return ThreadBudget::Get().Acquire();
+    }
+
     OutputPacket packet_;
 };
 
@@ -24,10 +24,22 @@ extern "C"
 FFMPEG_SHIM_POP_IGNORES
 
 
+#include <atomic>
+#include <exception>
+#include <memory>
 #include <string>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "clip/error.h"
 #include "clip/dictionary.h"
+#include "clip/fragment_options.h"
+#include "clip/output_sink.h"
+#include "clip/output_statistics.h"
+#include "clip/packet_trace.h"
+#include "clip/rotating_muxer.h"
+#include "clip/detail/packet_queue.h"
 
 
 #ifdef ff_const59
@@ -116,7 +128,16 @@ public:
         :
         context_(outputFormat),
         isInitialized_(false),
-        isFinalized_(false)
+        isFinalized_(false),
+        writeMutex_(),
+        muxQueue_(),
+        muxThread_(),
+        hasMuxError_(false),
+        muxError_(),
+        statistics_(),
+        packetTrace_(),
+        sink_(),
+        rotation_()
     {
         if (!(outputFormat->flags & AVFMT_NOFILE))
         {
@@ -134,6 +155,96 @@ public:
         }
     }
 
+    /**
+     ** Write the muxed bytes to write, instead of a file.
+     **
+     ** Without seek, formats that rewrite their headers at the end, like
+     ** mp4 without fragmentation, fail to finalize.
+     **/
+    OutputContext(
+        const AVOutputFormat *outputFormat,
+        SinkWrite write,
+        SinkSeek seek = {})
+        :
+        context_(outputFormat),
+        isInitialized_(false),
+        isFinalized_(false),
+        writeMutex_(),
+        muxQueue_(),
+        muxThread_(),
+        hasMuxError_(false),
+        muxError_(),
+        statistics_(),
+        packetTrace_(),
+        sink_(),
+        rotation_()
+    {
+        if (outputFormat->flags & AVFMT_NOFILE)
+        {
+            throw VideoError("This output format does not write a file.");
+        }
+
+        this->sink_ = std::make_unique<detail::AvioSink>(write, seek);
+        this->context_.Get()->pb = this->sink_->Get();
+        this->context_.Get()->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+
+    /**
+     ** Write a new file at the first video keyframe after each
+     ** segmentDuration, without reopening the encoders.
+     **
+     ** onSegment is called as each file is completed.
+     **/
+    OutputContext(
+        const AVOutputFormat *outputFormat,
+        const RotationOptions &rotationOptions,
+        SegmentCallback onSegment = {})
+        :
+        context_(outputFormat),
+        isInitialized_(false),
+        isFinalized_(false),
+        writeMutex_(),
+        muxQueue_(),
+        muxThread_(),
+        hasMuxError_(false),
+        muxError_(),
+        statistics_(),
+        packetTrace_(),
+        sink_(),
+        rotation_(
+            std::make_unique<detail::RotatingMuxer>(
+                rotationOptions,
+                onSegment))
+    {
+
+    }
+
+    /**
+     ** Write the muxed bytes to a sink with Write and Seek members, like
+     ** MemorySink or UringFileSink.
+     **
+     ** The sink is shared, so the bytes written by Finalize() remain
+     ** available after the context is destroyed.
+     **/
+    template<typename Sink>
+    OutputContext(
+        const AVOutputFormat *outputFormat,
+        std::shared_ptr<Sink> sink)
+        :
+        OutputContext(
+            outputFormat,
+            [sink](const uint8_t *data, size_t size)
+            {
+                sink->Write(data, size);
+            },
+            [sink](int64_t offset, int whence)
+            {
+                return sink->Seek(offset, whence);
+            })
+    {
+
+    }
+
     ~OutputContext()
     {
         if (!this->isFinalized_)
@@ -142,19 +253,35 @@ public:
             {
                 this->Finalize();
             }
-            catch (ClipError &error)
+            catch (std::exception &error)
             {
                 // Do not propagate exception from the destructor.
+                // Sink callbacks, the mux thread, and segment callbacks may
+                // fail with any exception.
                 std::cerr << error.what() << std::endl;
             }
+            catch (...)
+            {
+                std::cerr << "Unknown error finalizing OutputContext"
+                    << std::endl;
+            }
         }
 
+        // Finalize has usually stopped the mux thread already.
+        this->StopMuxThread_();
+
         if (!this->context_.Get())
         {
             return;
         }
 
-        if (this->context_.Get()->pb)
+        if (this->sink_)
+        {
+            // The AVIOContext belongs to the sink.
+            this->context_.Get()->pb = NULL;
+            this->sink_.reset();
+        }
+        else if (this->context_.Get()->pb)
         {
             /* Close the output file. */
             avio_closep(&this->context_.Get()->pb);
@@ -171,24 +298,79 @@ public:
         return this->context_.Get();
     }
 
+    /**
+     ** Write packets to the file on a dedicated thread, so that disk latency
+     ** does not stall the encoders.
+     **
+     ** Up to queueDepth packets wait for the mux thread before writers block.
+     ** Errors from the mux thread are reported by Output::Flush() and
+     ** Finalize().
+     **
+     ** Call this before Initialize().
+     **/
+    void EnableMuxThread(size_t queueDepth = 64)
+    {
+        if (this->isInitialized_)
+        {
+            throw std::logic_error(
+                "The mux thread must be enabled before initializing the "
+                "OutputContext.");
+        }
+
+        this->muxQueue_ = std::make_unique<detail::PacketQueue>(queueDepth);
+    }
+
     /**
      ** This must be called after all outputs have been created with this
      ** context.
      **/
     void Initialize(Dictionary &codecOptions)
     {
-        int result = avformat_write_header(
-            this->context_.Get(),
-            codecOptions.Get());
+        if (this->rotation_)
+        {
+            // Each segment writes its own header.
+            this->rotation_->Initialize(this->context_.Get(), codecOptions);
+        }
+        else
+        {
+            int result = avformat_write_header(
+                this->context_.Get(),
+                codecOptions.Get());
 
-        if (result < 0)
+            if (result < 0)
+            {
+                throw ClipError(
+                    std::string("Error initializing OutputContext: ")
+                    + clip::AvErrorToString(result));
+            }
+        }
+
+        this->isInitialized_ = true;
+
+        if (this->muxQueue_)
+        {
+            this->muxThread_ = std::thread(&OutputContext::RunMuxer_, this);
+        }
+    }
+
+    /**
+     ** Write a fragmented mp4 or mov.
+     **
+     ** The fragment options are added to formatOptions.
+     **/
+    void Initialize(
+        Dictionary &formatOptions,
+        const FragmentOptions &fragmentOptions)
+    {
+        if (!FragmentOptions::IsSupported(this->context_.Get()->oformat))
         {
             throw ClipError(
-                std::string("Error initializing OutputContext: ")
-                + clip::AvErrorToString(result));
+                std::string("Fragments are not supported by ")
+                + this->context_.Get()->oformat->name);
         }
 
-        this->isInitialized_ = true;
+        fragmentOptions.AddTo(formatOptions);
+        this->Initialize(formatOptions);
     }
 
     /**
@@ -196,8 +378,36 @@ public:
      **/
     void Finalize()
     {
+        // Write every queued packet before the trailer.
+        this->StopMuxThread_();
+        this->ThrowIfMuxFailed();
+
+        if (this->rotation_)
+        {
+            this->rotation_->Finalize();
+            this->isFinalized_ = true;
+
+            return;
+        }
+
+        if (!this->isInitialized_)
+        {
+            // Without a header there is no trailer to write. This happens
+            // when construction of the outputs failed.
+            this->isFinalized_ = true;
+
+            return;
+        }
+
         int result = av_write_trailer(this->context_.Get());
 
+        if (this->sink_)
+        {
+            // Report why the sink failed, instead of the muxer's EIO.
+            avio_flush(this->context_.Get()->pb);
+            this->sink_->ThrowIfFailed();
+        }
+
         if (result < 0)
         {
             throw ClipError(
@@ -208,6 +418,153 @@ public:
         this->isFinalized_ = true;
     }
 
+    /**
+     ** Write an encoded packet to the muxer.
+     **
+     ** Outputs sharing this context may encode on different threads, so
+     ** writes are serialized.
+     **
+     ** Like av_interleaved_write_frame, this takes ownership of the packet's
+     ** contents and leaves the packet blank.
+     **/
+    void WritePacket(AVPacket *packet)
+    {
+        if (this->packetTrace_)
+        {
+            this->packetTrace_->Record(packet);
+        }
+
+        if (this->muxThread_.joinable())
+        {
+            this->ThrowIfMuxFailed();
+
+            // The mux thread takes the reference to the packet's data.
+            this->muxQueue_->Push(packet);
+
+            return;
+        }
+
+        std::lock_guard lock(this->writeMutex_);
+        this->WritePacket_(packet);
+    }
+
+    /**
+     ** Rethrow the first error encountered by the mux thread.
+     **/
+    void ThrowIfMuxFailed() const
+    {
+        if (this->hasMuxError_.load(std::memory_order_acquire))
+        {
+            std::rethrow_exception(this->muxError_);
+        }
+    }
+
+    /**
+     ** @return The count of packets waiting for the mux thread.
+     **/
+    size_t GetMuxQueueDepth() const
+    {
+        if (!this->muxQueue_)
+        {
+            return 0;
+        }
+
+        return this->muxQueue_->GetSize();
+    }
+
+    /**
+     ** Outputs register their statistics as they are created, so that the
+     ** time spent writing each stream's packets is added to them.
+     **/
+    void RegisterStatistics(
+        int streamIndex,
+        std::shared_ptr<OutputStatistics> statistics)
+    {
+        if (this->isInitialized_)
+        {
+            throw std::logic_error(
+                "Statistics must be registered before initializing the "
+                "OutputContext.");
+        }
+
+        auto index = static_cast<size_t>(streamIndex);
+
+        if (index >= this->statistics_.size())
+        {
+            this->statistics_.resize(index + 1);
+        }
+
+        this->statistics_[index] = statistics;
+    }
+
+    /**
+     ** Record the most recent `capacity` packets passed to WritePacket.
+     **
+     ** Call this before Initialize().
+     **/
+    void EnablePacketTrace(size_t capacity = 4096)
+    {
+        if (this->isInitialized_)
+        {
+            throw std::logic_error(
+                "The packet trace must be enabled before initializing the "
+                "OutputContext.");
+        }
+
+        this->packetTrace_ = std::make_unique<PacketTrace>(capacity);
+    }
+
+    /**
+     ** @return NULL unless EnablePacketTrace() has been called.
+     **/
+    const PacketTrace * GetPacketTrace() const
+    {
+        return this->packetTrace_.get();
+    }
+
+    /**
+     ** Write the packet trace, with the time base of each stream.
+     ** See PacketTrace::DumpToFile for the layout.
+     **/
+    void DumpPacketTrace(const std::string &fileName) const
+    {
+        if (!this->packetTrace_)
+        {
+            throw ClipError("The packet trace is not enabled.");
+        }
+
+        std::vector<AVRational> timeBases;
+        const AVFormatContext *context = this->context_.Get();
+
+        for (unsigned i = 0; i < context->nb_streams; ++i)
+        {
+            timeBases.push_back(context->streams[i]->time_base);
+        }
+
+        this->packetTrace_->DumpToFile(fileName, timeBases);
+    }
+
+    /**
+     ** @return The sum of the statistics of every output.
+     **
+     ** The set of outputs is fixed once the context is initialized, so this
+     ** is safe to call from any thread without locking.
+     **/
+    OutputStatisticsSnapshot GetStatistics() const
+    {
+        OutputStatisticsSnapshot result{};
+
+        for (const auto &statistics: this->statistics_)
+        {
+            if (statistics)
+            {
+                result += statistics->GetSnapshot();
+            }
+        }
+
+        return result;
+    }
+
     bool GetIsInitialized() const
     {
         return this->isInitialized_;
@@ -218,10 +575,118 @@ public:
         return this->isFinalized_;
     }
 
+private:
+    void WritePacket_(AVPacket *packet)
+    {
+        // The muxer takes the packet's contents.
+        int64_t sizeBytes = packet->size;
+        OutputStatistics *statistics = NULL;
+        auto index = static_cast<size_t>(packet->stream_index);
+
+        if (index < this->statistics_.size())
+        {
+            statistics = this->statistics_[index].get();
+        }
+
+        auto start = OutputStatistics::Clock::now();
+        int result = (this->rotation_)
+            ? this->rotation_->Write(packet)
+            : av_interleaved_write_frame(this->context_.Get(), packet);
+
+        if (statistics)
+        {
+            statistics->AddTime(
+                OutputStatistics::Stage::write,
+                OutputStatistics::Clock::now() - start);
+        }
+
+        if (result < 0)
+        {
+            throw VideoError(
+                DescribeError("Error writing output packet", result));
+        }
+
+        if (statistics)
+        {
+            statistics->AddPacket(sizeBytes);
+        }
+    }
+
+    void RunMuxer_()
+    {
+        AVPacket *packet = av_packet_alloc();
+
+        if (!packet)
+        {
+            this->muxError_ = std::make_exception_ptr(
+                VideoError("Could not allocate AVPacket"));
+
+            this->hasMuxError_.store(true, std::memory_order_release);
+        }
+
+        // A single thread writes every stream, so the muxer interleaves
+        // packets from all outputs as usual.
+        while (packet && this->muxQueue_->Pop(packet))
+        {
+            if (this->hasMuxError_.load(std::memory_order_relaxed))
+            {
+                // Keep draining so that writers never block on a full queue.
+                av_packet_unref(packet);
+
+                continue;
+            }
+
+            try
+            {
+                this->WritePacket_(packet);
+            }
+            catch (...)
+            {
+                av_packet_unref(packet);
+                this->muxError_ = std::current_exception();
+                this->hasMuxError_.store(true, std::memory_order_release);
+            }
+        }
+
+        if (packet)
+        {
+            av_packet_free(&packet);
+        }
+    }
+
+    void StopMuxThread_()
+    {
+        if (!this->muxThread_.joinable())
+        {
+            return;
+        }
+
+        this->muxQueue_->Close();
+        this->muxThread_.join();
+    }
+
 protected:
     Context context_;
     bool isInitialized_;
     bool isFinalized_;
+    std::mutex writeMutex_;
+
+private:
+    std::unique_ptr<detail::PacketQueue> muxQueue_;
+    std::thread muxThread_;
+    std::atomic<bool> hasMuxError_;
+    std::exception_ptr muxError_;
+
+    // Indexed by stream.
+    std::vector<std::shared_ptr<OutputStatistics>> statistics_;
+
+    std::unique_ptr<PacketTrace> packetTrace_;
+
+    // Only present when writing to a sink instead of a file.
+    std::unique_ptr<detail::AvioSink> sink_;
+
+    // Only present when the output is split into several files.
+    std::unique_ptr<detail::RotatingMuxer> rotation_;
 };
 
 
@@ -0,0 +1,300 @@
+/**
+  * @file output_sink.h
+  *
+  * @brief Destinations for muxed bytes other than a file.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include "clip/ffmpeg_shim.h"
+FFMPEG_SHIM_PUSH_IGNORES
+extern "C"
+{
+
+#include <libavformat/avio.h>
+#include <libavutil/mem.h>
+
+}
+FFMPEG_SHIM_POP_IGNORES
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <vector>
+#include "clip/error.h"
+
+
+// The write callback takes a const buffer since libavformat 61.
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+#define CLIP_AVIO_WRITE_BUFFER const uint8_t
+#else
+#define CLIP_AVIO_WRITE_BUFFER uint8_t
+#endif
+
+
+namespace clip
+{
+
+
+/**
+ ** Receives every byte written by the muxer, in order.
+ **/
+using SinkWrite = std::function<void(const uint8_t *data, size_t size)>;
+
+/**
+ ** Moves the write position like fseek, with whence SEEK_SET, SEEK_CUR or
+ ** SEEK_END, and returns the new position.
+ **
+ ** When whence is AVSEEK_SIZE, return the size of the output, or a negative
+ ** AVERROR if it is unknown.
+ **
+ ** Formats like mp4 seek back to finish their headers, and fail without one.
+ **/
+using SinkSeek = std::function<int64_t(int64_t offset, int whence)>;
+
+
+/**
+ ** A growable buffer that holds the entire output.
+ **/
+class MemorySink
+{
+public:
+    MemorySink()
+        :
+        data_(),
+        position_(0)
+    {
+
+    }
+
+    void Write(const uint8_t *data, size_t size)
+    {
+        size_t end = this->position_ + size;
+
+        if (end > this->data_.size())
+        {
+            this->data_.resize(end);
+        }
+
+        std::memcpy(this->data_.data() + this->position_, data, size);
+        this->position_ = end;
+    }
+
+    int64_t Seek(int64_t offset, int whence)
+    {
+        auto size = static_cast<int64_t>(this->data_.size());
+
+        if (whence == AVSEEK_SIZE)
+        {
+            return size;
+        }
+
+        int64_t position;
+
+        switch (whence & ~AVSEEK_FORCE)
+        {
+            case SEEK_SET:
+                position = offset;
+                break;
+
+            case SEEK_CUR:
+                position = static_cast<int64_t>(this->position_) + offset;
+                break;
+
+            case SEEK_END:
+                position = size + offset;
+                break;
+
+            default:
+                return AVERROR(EINVAL);
+        }
+
+        if (position < 0)
+        {
+            return AVERROR(EINVAL);
+        }
+
+        // Writing past the end fills the gap with zeros.
+        this->position_ = static_cast<size_t>(position);
+
+        return position;
+    }
+
+    const std::vector<uint8_t> & GetData() const
+    {
+        return this->data_;
+    }
+
+    /**
+     ** Take the bytes written so far, and start again at position zero.
+     **/
+    std::vector<uint8_t> Release()
+    {
+        std::vector<uint8_t> result;
+        std::swap(result, this->data_);
+        this->position_ = 0;
+
+        return result;
+    }
+
+private:
+    std::vector<uint8_t> data_;
+    size_t position_;
+};
+
+
+namespace detail
+{
+
+
+/**
+ ** An AVIOContext that calls a SinkWrite and an optional SinkSeek.
+ **
+ ** Exceptions cannot pass through libavformat, so the first one thrown by a
+ ** callback is kept, and rethrown by ThrowIfFailed.
+ **/
+class AvioSink
+{
+public:
+    static constexpr int defaultBufferSize = 64 * 1024;
+
+    AvioSink(
+        SinkWrite write,
+        SinkSeek seek,
+        int bufferSize = defaultBufferSize)
+        :
+        write_(write),
+        seek_(seek),
+        error_(),
+        context_(NULL)
+    {
+        if (!this->write_)
+        {
+            throw ClipError("An output sink requires a write function.");
+        }
+
+        auto buffer = static_cast<unsigned char *>(
+            av_malloc(static_cast<size_t>(bufferSize)));
+
+        if (!buffer)
+        {
+            throw ClipError("Failed to allocate the output sink buffer.");
+        }
+
+        this->context_ = avio_alloc_context(
+            buffer,
+            bufferSize,
+            1,
+            this,
+            NULL,
+            &AvioSink::Write_,
+            this->seek_ ? &AvioSink::Seek_ : NULL);
+
+        if (!this->context_)
+        {
+            av_free(buffer);
+            throw ClipError("Failed to allocate AVIOContext.");
+        }
+
+        this->context_->seekable = this->seek_ ? AVIO_SEEKABLE_NORMAL : 0;
+    }
+
+    AvioSink(const AvioSink &) = delete;
+    AvioSink & operator=(const AvioSink &) = delete;
+
+    ~AvioSink()
+    {
+        if (!this->context_)
+        {
+            return;
+        }
+
+        avio_flush(this->context_);
+
+        // The buffer may have been reallocated by avio.
+        av_freep(&this->context_->buffer);
+        avio_context_free(&this->context_);
+    }
+
+    AVIOContext * Get() const
+    {
+        return this->context_;
+    }
+
+    void ThrowIfFailed() const
+    {
+        if (this->error_)
+        {
+            std::rethrow_exception(this->error_);
+        }
+    }
+
+private:
+    static int Write_(
+        void *opaque,
+        CLIP_AVIO_WRITE_BUFFER *buffer,
+        int size)
+    {
+        auto self = static_cast<AvioSink *>(opaque);
+
+        if (self->error_)
+        {
+            return AVERROR(EIO);
+        }
+
+        try
+        {
+            self->write_(buffer, static_cast<size_t>(size));
+        }
+        catch (...)
+        {
+            self->error_ = std::current_exception();
+
+            return AVERROR(EIO);
+        }
+
+        return size;
+    }
+
+    static int64_t Seek_(void *opaque, int64_t offset, int whence)
+    {
+        auto self = static_cast<AvioSink *>(opaque);
+
+        if (self->error_)
+        {
+            return AVERROR(EIO);
+        }
+
+        try
+        {
+            return self->seek_(offset, whence);
+        }
+        catch (...)
+        {
+            self->error_ = std::current_exception();
+
+            return AVERROR(EIO);
+        }
+    }
+
+    SinkWrite write_;
+    SinkSeek seek_;
+    std::exception_ptr error_;
+    AVIOContext *context_;
+};
+
+
+} // end namespace detail
+
+
+} // end namespace clip
@@ -0,0 +1,249 @@
+/**
+  * @file output_statistics.h
+  *
+  * @brief Counters and timers updated by an Output as it encodes and
+  *     writes.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+
+namespace clip
+{
+
+
+/**
+ ** A copy of the statistics at one moment.
+ **
+ ** Each field is read separately, so fields may be off by one frame or
+ ** packet relative to each other.
+ **/
+struct OutputStatisticsSnapshot
+{
+    using Duration = std::chrono::nanoseconds;
+
+    // Frames sent to the encoder.
+    uint64_t frameCount;
+
+    // Packets written to the muxer, and their total size.
+    uint64_t packetCount;
+    uint64_t byteCount;
+
+    // Time spent in avcodec_send_frame, avcodec_receive_packet,
+    // av_interleaved_write_frame, and converting to the encoder's pixel
+    // format.
+    Duration sendTime;
+    Duration receiveTime;
+    Duration writeTime;
+    Duration reformatTime;
+
+    // Frames waiting for the encoder thread, and frames discarded because
+    // the queue was full.
+    uint64_t queueDepth;
+    uint64_t droppedFrameCount;
+
+    // Time since the statistics were created.
+    Duration elapsed;
+
+    OutputStatisticsSnapshot & operator+=(
+        const OutputStatisticsSnapshot &other)
+    {
+        this->frameCount += other.frameCount;
+        this->packetCount += other.packetCount;
+        this->byteCount += other.byteCount;
+        this->sendTime += other.sendTime;
+        this->receiveTime += other.receiveTime;
+        this->writeTime += other.writeTime;
+        this->reformatTime += other.reformatTime;
+        this->queueDepth += other.queueDepth;
+        this->droppedFrameCount += other.droppedFrameCount;
+
+        if (other.elapsed > this->elapsed)
+        {
+            this->elapsed = other.elapsed;
+        }
+
+        return *this;
+    }
+
+    double GetFramesPerSecond() const
+    {
+        return GetRate_(this->frameCount);
+    }
+
+    double GetBytesPerSecond() const
+    {
+        return GetRate_(this->byteCount);
+    }
+
+private:
+    double GetRate_(uint64_t count) const
+    {
+        double seconds = std::chrono::duration<double>(this->elapsed).count();
+
+        if (seconds <= 0.0)
+        {
+            return 0.0;
+        }
+
+        return static_cast<double>(count) / seconds;
+    }
+};
+
+
+/**
+ ** Written by the encoding and muxing threads, and read by any thread.
+ **
+ ** Every update is a relaxed atomic add, so the hot path never takes a
+ ** lock, and GetSnapshot may be polled from a monitoring thread.
+ **/
+class OutputStatistics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Duration = OutputStatisticsSnapshot::Duration;
+
+    // Stages that are timed.
+    enum class Stage
+    {
+        send,
+        receive,
+        write,
+        reformat
+    };
+
+    OutputStatistics()
+        :
+        start_(Clock::now()),
+        frameCount_(0),
+        packetCount_(0),
+        byteCount_(0),
+        times_{},
+        queueDepth_(0),
+        droppedFrameCount_(0)
+    {
+
+    }
+
+    OutputStatistics(const OutputStatistics &) = delete;
+    OutputStatistics & operator=(const OutputStatistics &) = delete;
+
+    void AddFrame()
+    {
+        this->frameCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void AddPacket(int64_t sizeBytes)
+    {
+        this->packetCount_.fetch_add(1, std::memory_order_relaxed);
+
+        this->byteCount_.fetch_add(
+            static_cast<uint64_t>(sizeBytes),
+            std::memory_order_relaxed);
+    }
+
+    void AddTime(Stage stage, Clock::duration duration)
+    {
+        this->times_[static_cast<size_t>(stage)].fetch_add(
+            static_cast<uint64_t>(
+                std::chrono::duration_cast<Duration>(duration).count()),
+            std::memory_order_relaxed);
+    }
+
+    /**
+     ** Call function, and add the time it takes to stage.
+     **/
+    template<typename Function>
+    decltype(auto) Time(Stage stage, Function &&function)
+    {
+        Timer timer(*this, stage);
+
+        return function();
+    }
+
+    void SetQueueDepth(size_t queueDepth)
+    {
+        this->queueDepth_.store(queueDepth, std::memory_order_relaxed);
+    }
+
+    void SetDroppedFrameCount(size_t droppedFrameCount)
+    {
+        this->droppedFrameCount_.store(
+            droppedFrameCount,
+            std::memory_order_relaxed);
+    }
+
+    OutputStatisticsSnapshot GetSnapshot() const
+    {
+        return {
+            this->frameCount_.load(std::memory_order_relaxed),
+            this->packetCount_.load(std::memory_order_relaxed),
+            this->byteCount_.load(std::memory_order_relaxed),
+            this->GetTime_(Stage::send),
+            this->GetTime_(Stage::receive),
+            this->GetTime_(Stage::write),
+            this->GetTime_(Stage::reformat),
+            this->queueDepth_.load(std::memory_order_relaxed),
+            this->droppedFrameCount_.load(std::memory_order_relaxed),
+            std::chrono::duration_cast<Duration>(Clock::now() - this->start_)};
+    }
+
+private:
+    // Adds the time between construction and destruction, even if the timed
+    // call throws.
+    class Timer
+    {
+    public:
+        Timer(OutputStatistics &statistics, Stage stage)
+            :
+            statistics_(statistics),
+            stage_(stage),
+            start_(Clock::now())
+        {
+
+        }
+
+        ~Timer()
+        {
+            this->statistics_.AddTime(
+                this->stage_,
+                Clock::now() - this->start_);
+        }
+
+    private:
+        OutputStatistics &statistics_;
+        Stage stage_;
+        Clock::time_point start_;
+    };
+
+    Duration GetTime_(Stage stage) const
+    {
+        return Duration(
+            static_cast<Duration::rep>(
+                this->times_[static_cast<size_t>(stage)].load(
+                    std::memory_order_relaxed)));
+    }
+
+    static constexpr size_t stageCount = 4;
+
+    Clock::time_point start_;
+    std::atomic<uint64_t> frameCount_;
+    std::atomic<uint64_t> packetCount_;
+    std::atomic<uint64_t> byteCount_;
+    std::atomic<uint64_t> times_[stageCount];
+    std::atomic<uint64_t> queueDepth_;
+    std::atomic<uint64_t> droppedFrameCount_;
+};
+
+
+} // end namespace clip
@@ -0,0 +1,298 @@
+/**
+  * @file packet_trace.h
+  *
+  * @brief A fixed-size, lock-free record of the most recent packets.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include "clip/ffmpeg_shim.h"
+FFMPEG_SHIM_PUSH_IGNORES
+extern "C"
+{
+
+#include <libavcodec/packet.h>
+
+}
+FFMPEG_SHIM_POP_IGNORES
+
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "clip/error.h"
+
+
+namespace clip
+{
+
+
+struct PacketRecord
+{
+    // Counts every packet recorded, starting at zero.
+    uint64_t sequence;
+
+    // In the stream's time base.
+    int64_t pts;
+    int64_t dts;
+    int64_t duration;
+
+    // steady_clock time when the packet was recorded.
+    int64_t recordedNanoseconds;
+
+    int32_t size;
+    int32_t streamIndex;
+    int32_t isKeyframe;
+    int32_t reserved;
+};
+
+
+/**
+ ** Any number of threads may record, and any thread may read.
+ **
+ ** Recording a packet takes a sequence number with one atomic add, claims
+ ** the sequence's slot by exchanging its stamp, and fills it with relaxed
+ ** stores, so tracing costs nanoseconds. When the ring is full, the oldest
+ ** records are overwritten.
+ **
+ ** Two writers a whole ring apart may reach the same slot at once. The
+ ** stamp lets only one of them write: the newer record waits for the older
+ ** one to finish, and the older record is dropped if the newer one has
+ ** already claimed the slot, so no record mixes the fields of two packets.
+ **/
+class PacketTrace
+{
+public:
+    // Identifies the files written by DumpToFile.
+    static constexpr char magic[8] =
+        {'C', 'L', 'I', 'P', 'T', 'R', 'C', '1'};
+
+    /**
+     ** capacity is rounded up to a power of two.
+     **/
+    explicit PacketTrace(size_t capacity)
+        :
+        mask_(std::bit_ceil(std::max(capacity, size_t{2})) - 1),
+        next_(0),
+        slots_(std::make_unique<Slot[]>(mask_ + 1))
+    {
+
+    }
+
+    size_t GetCapacity() const
+    {
+        return this->mask_ + 1;
+    }
+
+    void Record(const AVPacket *packet)
+    {
+        auto recorded = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+        uint64_t sequence =
+            this->next_.fetch_add(1, std::memory_order_relaxed);
+        Slot &slot = this->slots_[sequence & this->mask_];
+
+        if (!Claim_(slot, sequence))
+        {
+            return;
+        }
+
+        slot.pts.store(packet->pts, std::memory_order_relaxed);
+        slot.dts.store(packet->dts, std::memory_order_relaxed);
+        slot.duration.store(packet->duration, std::memory_order_relaxed);
+        slot.recorded.store(recorded, std::memory_order_relaxed);
+        slot.size.store(packet->size, std::memory_order_relaxed);
+
+        slot.streamIndex.store(
+            packet->stream_index,
+            std::memory_order_relaxed);
+
+        slot.isKeyframe.store(
+            (packet->flags & AV_PKT_FLAG_KEY) ? 1 : 0,
+            std::memory_order_relaxed);
+
+        slot.stamp.store(2 * sequence + 2, std::memory_order_release);
+    }
+
+    /**
+     ** @return The records still in the ring, oldest first.
+     **
+     ** Records that are being overwritten while they are read are skipped.
+     **/
+    std::vector<PacketRecord> GetRecords() const
+    {
+        uint64_t end = this->next_.load(std::memory_order_acquire);
+        uint64_t capacity = this->GetCapacity();
+        uint64_t begin = (end > capacity) ? end - capacity : 0;
+
+        std::vector<PacketRecord> result;
+        result.reserve(static_cast<size_t>(end - begin));
+
+        for (uint64_t sequence = begin; sequence < end; ++sequence)
+        {
+            const Slot &slot = this->slots_[sequence & this->mask_];
+            uint64_t expected = 2 * sequence + 2;
+
+            if (slot.stamp.load(std::memory_order_acquire) != expected)
+            {
+                // Still being written, or already overwritten.
+                continue;
+            }
+
+            PacketRecord record{
+                sequence,
+                slot.pts.load(std::memory_order_relaxed),
+                slot.dts.load(std::memory_order_relaxed),
+                slot.duration.load(std::memory_order_relaxed),
+                slot.recorded.load(std::memory_order_relaxed),
+                slot.size.load(std::memory_order_relaxed),
+                slot.streamIndex.load(std::memory_order_relaxed),
+                slot.isKeyframe.load(std::memory_order_relaxed),
+                0};
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (slot.stamp.load(std::memory_order_relaxed) != expected)
+            {
+                continue;
+            }
+
+            result.push_back(record);
+        }
+
+        return result;
+    }
+
+    /**
+     ** Write the records in a binary file:
+     **
+     **     char magic[8]
+     **     uint32_t streamCount
+     **     int32_t numerator, denominator   (timeBases, streamCount times)
+     **     uint64_t recordCount
+     **     PacketRecord records[recordCount]
+     **
+     ** Values are in native byte order.
+     **/
+    void DumpToFile(
+        const std::string &fileName,
+        const std::vector<AVRational> &timeBases) const
+    {
+        auto records = this->GetRecords();
+
+        std::ofstream output(fileName, std::ios::binary);
+
+        if (!output)
+        {
+            throw ClipError("Unable to open packet trace file: " + fileName);
+        }
+
+        auto streamCount = static_cast<uint32_t>(timeBases.size());
+        auto recordCount = static_cast<uint64_t>(records.size());
+
+        output.write(magic, sizeof(magic));
+        Write_(output, streamCount);
+
+        for (const auto &timeBase: timeBases)
+        {
+            Write_(output, static_cast<int32_t>(timeBase.num));
+            Write_(output, static_cast<int32_t>(timeBase.den));
+        }
+
+        Write_(output, recordCount);
+
+        output.write(
+            reinterpret_cast<const char *>(records.data()),
+            static_cast<std::streamsize>(
+                records.size() * sizeof(PacketRecord)));
+
+        if (!output)
+        {
+            throw ClipError("Failed to write packet trace file: " + fileName);
+        }
+    }
+
+private:
+    template<typename T>
+    static void Write_(std::ofstream &output, T value)
+    {
+        output.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    struct Slot
+    {
+        // 2 * sequence + 2 once the record is complete.
+        std::atomic<uint64_t> stamp{0};
+        std::atomic<int64_t> pts{0};
+        std::atomic<int64_t> dts{0};
+        std::atomic<int64_t> duration{0};
+        std::atomic<int64_t> recorded{0};
+        std::atomic<int32_t> size{0};
+        std::atomic<int32_t> streamIndex{0};
+        std::atomic<int32_t> isKeyframe{0};
+    };
+
+    /**
+     ** Mark the slot as being written with an odd stamp.
+     **
+     ** @return false when a newer record owns the slot.
+     **/
+    static bool Claim_(Slot &slot, uint64_t sequence)
+    {
+        uint64_t writing = 2 * sequence + 1;
+        uint64_t stamp = slot.stamp.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            if (stamp > writing)
+            {
+                // This record would have been overwritten anyway.
+                return false;
+            }
+
+            if (stamp & 1)
+            {
+                // An older record is still being written.
+                std::this_thread::yield();
+                stamp = slot.stamp.load(std::memory_order_relaxed);
+
+                continue;
+            }
+
+            if (
+                slot.stamp.compare_exchange_weak(
+                    stamp,
+                    writing,
+                    std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+
+        // Readers that see a field written below also see the odd stamp.
+        std::atomic_thread_fence(std::memory_order_release);
+
+        return true;
+    }
+
+    uint64_t mask_;
+    std::atomic<uint64_t> next_;
+    std::unique_ptr<Slot[]> slots_;
+};
+
+
+} // end namespace clip
@@ -57,6 +57,30 @@ namespace clip
 template<AVPixelFormat pixelFormat, typename Enable = void>
 struct ColorType {};
 
+template<AVPixelFormat pixelFormat>
+struct ColorType
+    <
+        pixelFormat,
+        std::enable_if_t<IsAnyOf(pixelFormat, AV_PIX_FMT_GRAY8)>
+    >
+{
+    using type = uint8_t;
+};
+
+
+template<AVPixelFormat pixelFormat>
+struct ColorType
+    <
+        pixelFormat,
+        std::enable_if_t<
+            IsAnyOf(pixelFormat, AV_PIX_FMT_GRAY16BE, AV_PIX_FMT_GRAY16LE)
+        >
+    >
+{
+    using type = uint16_t;
+};
+
+
 template<AVPixelFormat pixelFormat>
 struct ColorType
     <
@@ -100,6 +124,23 @@ struct ColorType
 template<AVPixelFormat pixelFormat, typename Enable = void>
 struct ColorCount {};
 
+template<AVPixelFormat pixelFormat>
+struct ColorCount
+    <
+        pixelFormat,
+        std::enable_if_t<
+            IsAnyOf(
+                pixelFormat,
+                AV_PIX_FMT_GRAY8,
+                AV_PIX_FMT_GRAY16BE,
+                AV_PIX_FMT_GRAY16LE)
+        >
+    >
+{
+    static constexpr size_t value = 1;
+};
+
+
 template<AVPixelFormat pixelFormat>
 struct ColorCount
     <
@@ -162,6 +203,24 @@ PixelSize GetPixelSize(AVPixelFormat pixelFormat)
 {
     switch (pixelFormat)
     {
+        case AV_PIX_FMT_GRAY8:
+        {
+            using Traits = PixelTraits<AV_PIX_FMT_GRAY8>;
+            return {Traits::colorCount, Traits::sizeBytes};
+        }
+
+        case AV_PIX_FMT_GRAY16BE:
+        {
+            using Traits = PixelTraits<AV_PIX_FMT_GRAY16BE>;
+            return {Traits::colorCount, Traits::sizeBytes};
+        }
+
+        case AV_PIX_FMT_GRAY16LE:
+        {
+            using Traits = PixelTraits<AV_PIX_FMT_GRAY16LE>;
+            return {Traits::colorCount, Traits::sizeBytes};
+        }
+
         case AV_PIX_FMT_RGB24:
         {
             using Traits = PixelTraits<AV_PIX_FMT_RGB24>;
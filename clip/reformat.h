@@ -17,6 +17,7 @@ FFMPEG_SHIM_PUSH_IGNORES
 extern "C"
 {
 
+#include <libavutil/opt.h>
 #include <libswscale/swscale.h>
 
 }
@@ -26,6 +27,7 @@ FFMPEG_SHIM_POP_IGNORES
 #include "clip/frame.h"
 #include "clip/codec_context.h"
 #include "clip/error.h"
+#include "clip/resolution.h"
 
 
 namespace clip
@@ -35,20 +37,80 @@ namespace clip
 class Reformat
 {
 public:
-    Reformat(): context_(NULL) {}
+    Reformat(): context_(NULL), threadCount_(1) {}
 
+    /**
+     ** When threadCount is greater than one, each frame is split into
+     ** horizontal slices that are converted concurrently. The output is
+     ** identical to the single-threaded conversion.
+     **/
     Reformat(
         CodecContext &targetCodec,
         AVPixelFormat sourceFormat,
-        int scaleFlag = SWS_BICUBIC)
+        int scaleFlag = SWS_BICUBIC,
+        int threadCount = 1)
+        :
+        Reformat(
+            Resolution{targetCodec->width, targetCodec->height},
+            sourceFormat,
+            Resolution{targetCodec->width, targetCodec->height},
+            targetCodec->pix_fmt,
+            scaleFlag,
+            threadCount)
     {
+
+    }
+
+    Reformat(
+        const Resolution &sourceResolution,
+        AVPixelFormat sourceFormat,
+        const Resolution &targetResolution,
+        AVPixelFormat targetFormat,
+        int scaleFlag = SWS_BICUBIC,
+        int threadCount = 1)
+        :
+        context_(NULL),
+        threadCount_(threadCount)
+    {
+        if (threadCount > 1)
+        {
+            this->context_ = sws_alloc_context();
+
+            if (!this->context_)
+            {
+                throw VideoError("Could not allocate SwsContext");
+            }
+
+            av_opt_set_int(this->context_, "srcw", sourceResolution.width, 0);
+            av_opt_set_int(this->context_, "srch", sourceResolution.height, 0);
+            av_opt_set_pixel_fmt(this->context_, "src_format", sourceFormat, 0);
+            av_opt_set_int(this->context_, "dstw", targetResolution.width, 0);
+            av_opt_set_int(this->context_, "dsth", targetResolution.height, 0);
+            av_opt_set_pixel_fmt(this->context_, "dst_format", targetFormat, 0);
+            av_opt_set_int(this->context_, "sws_flags", scaleFlag, 0);
+            av_opt_set_int(this->context_, "threads", threadCount, 0);
+
+            int result = sws_init_context(this->context_, NULL, NULL);
+
+            if (result < 0)
+            {
+                sws_freeContext(this->context_);
+                this->context_ = NULL;
+
+                throw VideoError(
+                    DescribeError("Could not initialize SwsContext", result));
+            }
+
+            return;
+        }
+
         this->context_ = sws_getContext(
-            targetCodec->width,
-            targetCodec->height,
+            sourceResolution.width,
+            sourceResolution.height,
             sourceFormat,
-            targetCodec->width,
-            targetCodec->height,
-            targetCodec->pix_fmt,
+            targetResolution.width,
+            targetResolution.height,
+            targetFormat,
             scaleFlag,
             NULL,
             NULL,
@@ -62,7 +124,8 @@ public:
 
     Reformat(Reformat &&other)
         :
-        context_(other.context_)
+        context_(other.context_),
+        threadCount_(other.threadCount_)
     {
         other.context_ = NULL; 
     }
@@ -71,6 +134,7 @@ public:
     {
         sws_freeContext(this->context_);
         this->context_ = other.context_;
+        this->threadCount_ = other.threadCount_;
         other.context_ = NULL;
         return *this;
     }
@@ -84,6 +148,29 @@ public:
         sws_freeContext(this->context_);
     }
 
+    /**
+     ** Select the YUV coefficients, one of the SWS_CS_* constants.
+     **/
+    void SetColorspace(int colorspace)
+    {
+        const int *coefficients = sws_getCoefficients(colorspace);
+
+        int result = sws_setColorspaceDetails(
+            this->context_,
+            coefficients,
+            0,
+            coefficients,
+            0,
+            0,
+            1 << 16,
+            1 << 16);
+
+        if (result < 0)
+        {
+            throw VideoError("Colorspace details are not supported");
+        }
+    }
+
     operator struct SwsContext * ()
     {
         return this->context_;
@@ -94,8 +181,25 @@ public:
         return (this->context_ != NULL);
     }
 
-    int operator()(const Frame &source, Frame &target)
+    int operator()(const AVFrame *source, AVFrame *target)
     {
+        if (this->threadCount_ > 1)
+        {
+            // Only the frame API distributes slices across threads.
+            int result = sws_scale_frame(
+                this->context_,
+                target,
+                source);
+
+            if (result < 0)
+            {
+                throw VideoError(
+                    DescribeError("Failed to convert frame", result));
+            }
+
+            return target->height;
+        }
+
         return sws_scale(
             this->context_,
             source->data,
@@ -108,6 +212,7 @@ public:
 
 private:
     struct SwsContext *context_;
+    int threadCount_;
 };
 
 
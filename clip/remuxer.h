@@ -0,0 +1,207 @@
+/**
+  * @file remuxer.h
+  *
+  * @brief Copies the streams of a file into another container, without
+  *     decoding.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include "clip/ffmpeg_shim.h"
+FFMPEG_SHIM_PUSH_IGNORES
+extern "C"
+{
+
+#include <libavformat/avformat.h>
+
+}
+FFMPEG_SHIM_POP_IGNORES
+
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "clip/error.h"
+#include "clip/input_context.h"
+#include "clip/output_context.h"
+#include "clip/stream.h"
+
+
+namespace clip
+{
+
+
+/**
+ ** Copies the encoded packets of every video, audio and subtitle stream that
+ ** the output format can hold. Nothing is decoded or encoded, so remuxing
+ ** runs at the speed of the disk.
+ **
+ ** Create the Remuxer before initializing the OutputContext, call Run(), and
+ ** then finalize the OutputContext.
+ **/
+class Remuxer
+{
+public:
+    Remuxer(
+        const std::string &inputFileName,
+        std::shared_ptr<OutputContext> outputContext)
+        :
+        inputContext_(inputFileName),
+        outputContext_(outputContext),
+        outputIndices_()
+    {
+        if (outputContext->GetIsInitialized())
+        {
+            throw std::logic_error(
+                "Cannot create additional output streams after "
+                "initializing the OutputContext.");
+        }
+
+        const AVOutputFormat *outputFormat = (*outputContext)->oformat;
+        std::vector<int> selected;
+
+        for (int i = 0; i < this->inputContext_.GetStreamCount(); ++i)
+        {
+            const AVStream *input = this->inputContext_.GetStream(i);
+
+            if (!IsSupported_(outputFormat, input->codecpar))
+            {
+                this->outputIndices_.push_back({});
+                continue;
+            }
+
+            Stream output(*outputContext);
+
+            int result = avcodec_parameters_copy(
+                output->codecpar,
+                input->codecpar);
+
+            if (result < 0)
+            {
+                throw VideoError(
+                    DescribeError("Could not copy stream parameters", result));
+            }
+
+            // The input container's tag may mean something else, or nothing,
+            // in the output container. Let the muxer choose.
+            output->codecpar->codec_tag = 0;
+
+            // The muxer may replace this when the header is written.
+            output->time_base = input->time_base;
+
+            this->outputIndices_.push_back(output->index);
+            selected.push_back(i);
+        }
+
+        if (selected.empty())
+        {
+            throw VideoError(
+                std::string("No streams of ") + inputFileName
+                + " can be stored in " + outputFormat->name);
+        }
+
+        // The demuxer skips the packets of every other stream.
+        this->inputContext_.SelectStreams(selected);
+    }
+
+    Remuxer(const Remuxer &) = delete;
+    Remuxer & operator=(const Remuxer &) = delete;
+
+    /**
+     ** Copy every packet to the OutputContext.
+     **/
+    void Run()
+    {
+        if (!this->outputContext_->GetIsInitialized())
+        {
+            throw std::logic_error(
+                "Initialize the OutputContext before remuxing.");
+        }
+
+        for (auto &packet: this->inputContext_.GetPackets())
+        {
+            this->WritePacket_(packet);
+        }
+    }
+
+    const InputContext & GetInputContext() const
+    {
+        return this->inputContext_;
+    }
+
+    /**
+     ** @return The index of the output stream for an input stream, or empty
+     ** if the output format cannot hold it.
+     **/
+    std::optional<int> GetOutputIndex(int inputIndex) const
+    {
+        return this->outputIndices_.at(static_cast<size_t>(inputIndex));
+    }
+
+private:
+    static bool IsSupported_(
+        const AVOutputFormat *outputFormat,
+        const AVCodecParameters *parameters)
+    {
+        switch (parameters->codec_type)
+        {
+            case AVMEDIA_TYPE_VIDEO:
+            case AVMEDIA_TYPE_AUDIO:
+            case AVMEDIA_TYPE_SUBTITLE:
+                break;
+
+            default:
+                return false;
+        }
+
+        // Negative when the muxer cannot tell, which is left to
+        // avformat_write_header to decide.
+        return avformat_query_codec(
+            outputFormat,
+            parameters->codec_id,
+            FF_COMPLIANCE_NORMAL) != 0;
+    }
+
+    void WritePacket_(AVPacket *packet)
+    {
+        int inputIndex = packet->stream_index;
+        auto outputIndex = this->GetOutputIndex(inputIndex);
+
+        if (!outputIndex)
+        {
+            return;
+        }
+
+        const AVStream *output = (*this->outputContext_)->streams[*outputIndex];
+
+        av_packet_rescale_ts(
+            packet,
+            this->inputContext_.GetStream(inputIndex)->time_base,
+            output->time_base);
+
+        packet->stream_index = *outputIndex;
+
+        // The byte position in the input means nothing to the muxer.
+        packet->pos = -1;
+
+        // The OutputContext takes the packet's contents, and writes it with
+        // av_interleaved_write_frame.
+        this->outputContext_->WritePacket(packet);
+    }
+
+    InputContext inputContext_;
+    std::shared_ptr<OutputContext> outputContext_;
+
+    // Indexed by input stream.
+    std::vector<std::optional<int>> outputIndices_;
+};
+
+
+} // end namespace clip
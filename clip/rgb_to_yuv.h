@@ -0,0 +1,135 @@
+/**
+  * @file rgb_to_yuv.h
+  *
+  * @brief Converts RGB24 frames to yuv420p or yuv444p without swscale.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <cassert>
+#include "clip/frame.h"
+#include "clip/error.h"
+#include "clip/video_options.h"
+#include "clip/detail/rgb_to_yuv_kernels.h"
+
+
+namespace clip
+{
+
+
+/**
+ ** Uses the fastest kernel supported by the processor at runtime.
+ **/
+class RgbToYuv
+{
+public:
+    static bool IsSupported(
+        AVPixelFormat sourceFormat,
+        AVPixelFormat targetFormat)
+    {
+        return (sourceFormat == AV_PIX_FMT_RGB24)
+            && (targetFormat == AV_PIX_FMT_YUV420P
+                || targetFormat == AV_PIX_FMT_YUV444P);
+    }
+
+    RgbToYuv()
+        :
+        targetFormat_(AV_PIX_FMT_NONE),
+        coefficients_(detail::bt601Coefficients),
+        convert420_(NULL),
+        convert444_(NULL)
+    {
+
+    }
+
+    RgbToYuv(AVPixelFormat targetFormat, ColorMatrix colorMatrix)
+        :
+        targetFormat_(targetFormat),
+        coefficients_(
+            (colorMatrix == ColorMatrix::bt709)
+                ? detail::bt709Coefficients
+                : detail::bt601Coefficients),
+        convert420_(NULL),
+        convert444_(NULL)
+    {
+        if (!IsSupported(AV_PIX_FMT_RGB24, targetFormat))
+        {
+            throw VideoError("Unsupported target format for RgbToYuv");
+        }
+
+        auto simdLevel = detail::GetSimdLevel();
+        this->convert420_ = detail::GetRgbToYuv420Kernel(simdLevel);
+        this->convert444_ = detail::GetRgbToYuv444Kernel(simdLevel);
+    }
+
+    operator bool () const
+    {
+        return (this->targetFormat_ != AV_PIX_FMT_NONE);
+    }
+
+    void operator()(const AVFrame *source, AVFrame *target) const
+    {
+        assert(source->format == AV_PIX_FMT_RGB24);
+        assert(target->format == this->targetFormat_);
+        assert(source->width == target->width);
+        assert(source->height == target->height);
+
+        int height = source->height;
+        int width = source->width;
+
+        const uint8_t *rgb = source->data[0];
+        int rgbStride = source->linesize[0];
+
+        uint8_t *y = target->data[0];
+        uint8_t *u = target->data[1];
+        uint8_t *v = target->data[2];
+
+        if (this->targetFormat_ == AV_PIX_FMT_YUV444P)
+        {
+            for (int row = 0; row < height; ++row)
+            {
+                this->convert444_(
+                    rgb + row * rgbStride,
+                    width,
+                    y + row * target->linesize[0],
+                    u + row * target->linesize[1],
+                    v + row * target->linesize[2],
+                    this->coefficients_);
+            }
+
+            return;
+        }
+
+        // yuv420p requires even dimensions.
+        assert(height % 2 == 0);
+        assert(width % 2 == 0);
+
+        for (int row = 0; row < height; row += 2)
+        {
+            this->convert420_(
+                rgb + row * rgbStride,
+                rgb + (row + 1) * rgbStride,
+                width,
+                y + row * target->linesize[0],
+                y + (row + 1) * target->linesize[0],
+                u + (row / 2) * target->linesize[1],
+                v + (row / 2) * target->linesize[2],
+                this->coefficients_);
+        }
+    }
+
+private:
+    AVPixelFormat targetFormat_;
+    detail::YuvCoefficients coefficients_;
+    detail::RgbToYuv420Kernel convert420_;
+    detail::RgbToYuv444Kernel convert444_;
+};
+
+
+} // end namespace clip
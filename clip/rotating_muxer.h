@@ -0,0 +1,469 @@
+/**
+  * @file rotating_muxer.h
+  *
+  * @brief Splits the output of an OutputContext into a series of files.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include "clip/ffmpeg_shim.h"
+FFMPEG_SHIM_PUSH_IGNORES
+extern "C"
+{
+
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+
+}
+FFMPEG_SHIM_POP_IGNORES
+
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "clip/dictionary.h"
+#include "clip/error.h"
+
+
+namespace clip
+{
+
+
+struct RotationOptions
+{
+    // A new file is started at the first video keyframe after the current
+    // one is this long.
+    std::chrono::microseconds segmentDuration;
+
+    // Formatted with the segment index, e.g. "camera_{:06}.mp4".
+    std::string fileNamePattern;
+
+    static RotationOptions MakeDefault(const std::string &fileNamePattern)
+    {
+        return {
+            .segmentDuration = std::chrono::seconds(60),
+            .fileNamePattern = fileNamePattern};
+    }
+};
+
+
+struct SegmentInfo
+{
+    // Counts from zero.
+    size_t index;
+
+    std::string fileName;
+
+    // Time of the segment's first packet, from the start of the recording.
+    std::chrono::microseconds start;
+
+    std::chrono::microseconds duration;
+};
+
+
+/**
+ ** Called after each segment's file is complete, on the thread that writes
+ ** packets.
+ **/
+using SegmentCallback = std::function<void(const SegmentInfo &)>;
+
+
+namespace detail
+{
+
+
+/**
+ ** Writes the packets of an OutputContext to a new file at video keyframes.
+ **
+ ** The streams of the OutputContext are only a template. Each segment has
+ ** its own AVFormatContext with copies of them, so the encoders are never
+ ** reopened. Every segment's timestamps start at zero.
+ **
+ ** A segment starts at the time of the packet that opens it, usually a video
+ ** keyframe. Packets of the other streams from before that time, which the
+ ** encoders may deliver after it, are moved to the start of the segment.
+ **
+ ** After an error, no segment is open, and Write throws.
+ **/
+class RotatingMuxer
+{
+public:
+    // AV_TIME_BASE_Q is a C compound literal.
+    static constexpr AVRational microseconds{1, AV_TIME_BASE};
+
+    RotatingMuxer(
+        const RotationOptions &options,
+        SegmentCallback onSegment)
+        :
+        options_(options),
+        onSegment_(onSegment),
+        streams_(NULL),
+        formatOptions_(),
+        referenceStream_(0),
+        segment_(NULL),
+        segmentIndex_(0),
+        fileName_(),
+        hasPackets_(false),
+        recordingStart_(0),
+        segmentStart_(0),
+        segmentEnd_(0),
+        lastDts_()
+    {
+        if (this->options_.segmentDuration.count() <= 0)
+        {
+            throw ClipError("Segment duration must be positive.");
+        }
+    }
+
+    RotatingMuxer(const RotatingMuxer &) = delete;
+    RotatingMuxer & operator=(const RotatingMuxer &) = delete;
+
+    ~RotatingMuxer()
+    {
+        // Finalize() has closed the last segment, unless an error
+        // interrupted it.
+        this->Free_();
+    }
+
+    /**
+     ** Open the first segment.
+     **
+     ** Each segment's header is written with a copy of formatOptions.
+     **/
+    void Initialize(AVFormatContext *streams, const Dictionary &formatOptions)
+    {
+        this->streams_ = streams;
+        this->formatOptions_ = formatOptions;
+
+        // Segments start at keyframes of the first video stream, or of the
+        // first stream when there is no video.
+        this->referenceStream_ = 0;
+
+        for (unsigned i = 0; i < streams->nb_streams; ++i)
+        {
+            if (streams->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+            {
+                this->referenceStream_ = static_cast<int>(i);
+                break;
+            }
+        }
+
+        this->Open_();
+    }
+
+    /**
+     ** Like av_interleaved_write_frame, this takes the packet's contents.
+     **
+     ** The packet's timestamps are in the time base of the template stream.
+     **/
+    int Write(AVPacket *packet)
+    {
+        if (!this->segment_)
+        {
+            throw VideoError(
+                "Cannot write to a segment after an earlier error.");
+        }
+
+        const AVStream *stream = this->streams_->streams[packet->stream_index];
+        int64_t time = this->GetTime_(packet, stream->time_base);
+
+        if (this->hasPackets_ && this->IsBoundary_(packet, time))
+        {
+            this->Close_();
+            ++this->segmentIndex_;
+            this->Open_();
+        }
+
+        if (!this->hasPackets_)
+        {
+            if (this->segmentIndex_ == 0)
+            {
+                this->recordingStart_ = time;
+            }
+
+            this->segmentStart_ = time;
+            this->segmentEnd_ = time;
+            this->hasPackets_ = true;
+        }
+
+        int64_t end = time;
+
+        if (packet->duration > 0)
+        {
+            end += av_rescale_q(
+                packet->duration,
+                stream->time_base,
+                microseconds);
+        }
+
+        this->segmentEnd_ = std::max(this->segmentEnd_, end);
+
+        // Restart the timestamps at zero.
+        int64_t offset = av_rescale_q(
+            this->segmentStart_,
+            microseconds,
+            stream->time_base);
+
+        if (packet->pts != AV_NOPTS_VALUE)
+        {
+            packet->pts -= offset;
+        }
+
+        if (packet->dts != AV_NOPTS_VALUE)
+        {
+            packet->dts -= offset;
+        }
+
+        this->ClampTimeStamps_(packet);
+
+        // The muxer may have chosen a different time base for its stream.
+        av_packet_rescale_ts(
+            packet,
+            stream->time_base,
+            this->segment_->streams[packet->stream_index]->time_base);
+
+        return av_interleaved_write_frame(this->segment_, packet);
+    }
+
+    /**
+     ** Complete the current segment.
+     **/
+    void Finalize()
+    {
+        if (this->segment_)
+        {
+            this->Close_();
+        }
+    }
+
+    const std::string & GetFileName() const
+    {
+        return this->fileName_;
+    }
+
+private:
+    // Microseconds, by decoding order.
+    static int64_t GetTime_(const AVPacket *packet, AVRational timeBase)
+    {
+        int64_t time =
+            (packet->dts != AV_NOPTS_VALUE) ? packet->dts : packet->pts;
+
+        return av_rescale_q(time, timeBase, microseconds);
+    }
+
+    bool IsBoundary_(const AVPacket *packet, int64_t time) const
+    {
+        if (packet->stream_index != this->referenceStream_)
+        {
+            return false;
+        }
+
+        if (!(packet->flags & AV_PKT_FLAG_KEY))
+        {
+            return false;
+        }
+
+        return (time - this->segmentStart_)
+            >= this->options_.segmentDuration.count();
+    }
+
+    /**
+     ** Move a packet from before the start of the segment to the start,
+     ** keeping the decoding order of its stream.
+     **/
+    void ClampTimeStamps_(AVPacket *packet)
+    {
+        int64_t &lastDts =
+            this->lastDts_.at(static_cast<size_t>(packet->stream_index));
+
+        if (packet->dts != AV_NOPTS_VALUE)
+        {
+            if (packet->dts < 0)
+            {
+                packet->dts = (lastDts == AV_NOPTS_VALUE) ? 0 : lastDts + 1;
+            }
+
+            lastDts = packet->dts;
+        }
+
+        if (packet->pts != AV_NOPTS_VALUE)
+        {
+            int64_t minimum =
+                (packet->dts != AV_NOPTS_VALUE) ? packet->dts : 0;
+
+            packet->pts = std::max(packet->pts, minimum);
+        }
+    }
+
+    void Open_()
+    {
+        try
+        {
+            this->OpenSegment_();
+        }
+        catch (...)
+        {
+            // Do not leave a segment without a header for Write.
+            this->Free_();
+            throw;
+        }
+
+        this->hasPackets_ = false;
+        this->lastDts_.assign(this->streams_->nb_streams, AV_NOPTS_VALUE);
+    }
+
+    void OpenSegment_()
+    {
+        this->fileName_ = fmt::format(
+            fmt::runtime(this->options_.fileNamePattern),
+            this->segmentIndex_);
+
+        const AVOutputFormat *outputFormat = this->streams_->oformat;
+
+        int result = avformat_alloc_output_context2(
+            &this->segment_,
+            outputFormat,
+            NULL,
+            this->fileName_.c_str());
+
+        if (result < 0)
+        {
+            throw VideoError(
+                DescribeError("Failed to allocate segment context", result));
+        }
+
+        for (unsigned i = 0; i < this->streams_->nb_streams; ++i)
+        {
+            const AVStream *source = this->streams_->streams[i];
+            AVStream *stream = avformat_new_stream(this->segment_, NULL);
+
+            if (!stream)
+            {
+                throw VideoError("Could not allocate segment stream");
+            }
+
+            result = avcodec_parameters_copy(
+                stream->codecpar,
+                source->codecpar);
+
+            if (result < 0)
+            {
+                throw VideoError(
+                    DescribeError("Could not copy stream parameters", result));
+            }
+
+            stream->id = source->id;
+            stream->time_base = source->time_base;
+        }
+
+        if (!(outputFormat->flags & AVFMT_NOFILE))
+        {
+            result = avio_open(
+                &this->segment_->pb,
+                this->fileName_.c_str(),
+                AVIO_FLAG_WRITE);
+
+            if (result < 0)
+            {
+                throw VideoError(
+                    DescribeError(
+                        "Failed to open segment " + this->fileName_,
+                        result));
+            }
+        }
+
+        // avformat_write_header consumes the options it uses.
+        Dictionary formatOptions(this->formatOptions_);
+
+        result = avformat_write_header(this->segment_, formatOptions.Get());
+
+        if (result < 0)
+        {
+            throw VideoError(
+                DescribeError("Error writing segment header", result));
+        }
+    }
+
+    void Close_()
+    {
+        int result = av_write_trailer(this->segment_);
+
+        // The trailer cannot be retried, so the segment is freed even when
+        // it fails, and Write refuses packets while no segment is open.
+        this->Free_();
+
+        if (result < 0)
+        {
+            throw VideoError(
+                DescribeError(
+                    "Error finalizing segment " + this->fileName_,
+                    result));
+        }
+
+        if (this->onSegment_)
+        {
+            using Microseconds = std::chrono::microseconds;
+
+            this->onSegment_(
+                SegmentInfo{
+                    this->segmentIndex_,
+                    this->fileName_,
+                    Microseconds(this->segmentStart_ - this->recordingStart_),
+                    Microseconds(this->segmentEnd_ - this->segmentStart_)});
+        }
+    }
+
+    void Free_()
+    {
+        if (!this->segment_)
+        {
+            return;
+        }
+
+        if (this->segment_->pb)
+        {
+            avio_closep(&this->segment_->pb);
+        }
+
+        avformat_free_context(this->segment_);
+        this->segment_ = NULL;
+    }
+
+    RotationOptions options_;
+    SegmentCallback onSegment_;
+
+    // The OutputContext's own format context, which holds the streams.
+    AVFormatContext *streams_;
+
+    Dictionary formatOptions_;
+    int referenceStream_;
+
+    AVFormatContext *segment_;
+    size_t segmentIndex_;
+    std::string fileName_;
+    bool hasPackets_;
+
+    // Microseconds, in the timestamps of the encoders.
+    int64_t recordingStart_;
+    int64_t segmentStart_;
+    int64_t segmentEnd_;
+
+    // The last dts written to each stream of the segment, in the time base
+    // of the template stream.
+    std::vector<int64_t> lastDts_;
+};
+
+
+} // end namespace detail
+
+
+} // end namespace clip
@@ -0,0 +1,349 @@
+/**
+  * @file segmented_video_output.h
+  *
+  * @brief Encodes independent GOP-aligned segments of a video concurrently.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "clip/output.h"
+#include "clip/thread_pool.h"
+#include "clip/video_output.h"
+
+
+namespace clip
+{
+
+
+struct SegmentOptions
+{
+    // Each segment is this many GOPs long.
+    int gopsPerSegment;
+
+    // Segments encoded at the same time.
+    unsigned workerCount;
+
+    // Threads used by each segment's encoder.
+    int encoderThreadCount;
+
+    static SegmentOptions MakeDefault()
+    {
+        return {
+            .gopsPerSegment = 4,
+            .workerCount = ThreadPool::GetDefaultThreadCount(),
+            .encoderThreadCount = 1};
+    }
+};
+
+
+/**
+ ** Renders a video offline by splitting the timeline into segments that
+ ** start on GOP boundaries, and encoding the segments concurrently.
+ **
+ ** Every segment has its own encoder, so each one starts with a keyframe
+ ** and references no frame outside of itself. The encoders share one set of
+ ** options, so they produce the same stream parameters, and the packets
+ ** are written to the OutputContext in order with continuous timestamps.
+ **/
+class SegmentedVideoOutput : public Output
+{
+public:
+    /**
+     ** Fill `frame`, in inPixelFormat, with the frame at `frameIndex`.
+     **
+     ** Called concurrently from the worker threads. Within a segment, frames
+     ** are requested in order on the same thread.
+     **/
+    using Fill = std::function<void(int64_t frameIndex, AVFrame *frame)>;
+
+    SegmentedVideoOutput(
+        std::shared_ptr<OutputContext> outputContext,
+        const Dictionary &codecOptions,
+        const VideoOptions &videoOptions,
+        const SegmentOptions &segmentOptions = SegmentOptions::MakeDefault())
+        :
+        Output(outputContext, (*outputContext)->oformat->video_codec),
+        codecOptions_(codecOptions),
+        videoOptions_(videoOptions),
+        segmentOptions_(segmentOptions),
+        segmentFrameCount_(
+            static_cast<int64_t>(videoOptions.gopSize)
+            * segmentOptions.gopsPerSegment),
+        frameCount_(0),
+        outputContext_(outputContext),
+        stitchMutex_(),
+        completed_(),
+        nextSegment_(0)
+    {
+        if (this->segmentFrameCount_ < 1)
+        {
+            throw VideoError("Segments must contain at least one frame.");
+        }
+
+        // Every encoder is opened with these options, so add them once.
+        AddVideoCodecOptions(this->codecOptions_, this->videoOptions_);
+
+        // This encoder only provides the stream parameters.
+        // Each segment has its own encoder with the same configuration.
+        this->ConfigureEncoder_(this->codecContext_);
+        this->stream_->time_base = this->codecContext_->time_base;
+
+        // avcodec_open2 consumes the options it uses.
+        Dictionary codecOptionsCopy(this->codecOptions_);
+
+        OpenVideoEncoder(
+            this->codecContext_,
+            this->codec_,
+            codecOptionsCopy);
+
+        int result = avcodec_parameters_from_context(
+            this->stream_->codecpar,
+            this->codecContext_);
+
+        if (result < 0)
+        {
+            throw VideoError("Could not copy the stream parameters");
+        }
+    }
+
+    /**
+     ** Encode frameCount frames, and write them to the OutputContext.
+     **
+     ** Returns when every packet has been written. Frames continue from the
+     ** previous call, and frameIndex counts from the first call.
+     **/
+    void Render(int64_t frameCount, const Fill &fill)
+    {
+        if (!this->outputContext_->GetIsInitialized())
+        {
+            throw OutputError("OutputContext is not initialized.");
+        }
+
+        int64_t firstFrame = this->frameCount_;
+
+        auto segmentCount = static_cast<size_t>(
+            (frameCount + this->segmentFrameCount_ - 1)
+            / this->segmentFrameCount_);
+
+        {
+            std::lock_guard lock(this->stitchMutex_);
+            this->completed_.clear();
+            this->nextSegment_ = 0;
+        }
+
+        ThreadPool threadPool(this->segmentOptions_.workerCount);
+
+        // Segments are handed out in order, so they tend to complete in
+        // order, and few packets wait to be written.
+        threadPool.ParallelFor(
+            segmentCount,
+            [&](size_t segment)
+            {
+                int64_t begin = firstFrame
+                    + static_cast<int64_t>(segment)
+                        * this->segmentFrameCount_;
+
+                int64_t end = std::min(
+                    begin + this->segmentFrameCount_,
+                    firstFrame + frameCount);
+
+                this->Stitch_(
+                    segment,
+                    this->EncodeSegment_(begin, end, fill));
+            });
+
+        this->frameCount_ += frameCount;
+    }
+
+    TimeStamp GetTimeStamp() const
+    {
+        return TimeStamp(this->frameCount_, this->codecContext_->time_base);
+    }
+
+private:
+    using Packets = std::vector<OutputPacket>;
+
+    void ConfigureEncoder_(CodecContext &codecContext) const
+    {
+        // The constructor has already added the preset and quality factor
+        // to codecOptions_.
+        ConfigureVideoCodecContext(codecContext, this->videoOptions_);
+
+        /* Some formats want stream headers to be separate. */
+        if ((*this->outputContext_)->oformat->flags & AVFMT_GLOBALHEADER)
+        {
+            codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+    }
+
+    Packets EncodeSegment_(int64_t begin, int64_t end, const Fill &fill)
+    {
+        using Stage = OutputStatistics::Stage;
+
+        CodecContext codecContext(this->codec_);
+        this->ConfigureEncoder_(codecContext);
+        codecContext->thread_count =
+            this->segmentOptions_.encoderThreadCount;
+
+        // Segments are encoded concurrently, and only read codecOptions_.
+        Dictionary codecOptions(this->codecOptions_);
+        OpenVideoEncoder(codecContext, this->codec_, codecOptions);
+
+        bool needsConversion =
+            this->videoOptions_.inPixelFormat
+            != this->videoOptions_.outPixelFormat;
+
+        Frame input(
+            this->videoOptions_.inPixelFormat,
+            this->videoOptions_.height,
+            this->videoOptions_.width);
+
+        Frame converted;
+        detail::FrameConverter converter;
+
+        if (needsConversion)
+        {
+            converted = Frame(
+                this->videoOptions_.outPixelFormat,
+                this->videoOptions_.height,
+                this->videoOptions_.width);
+
+            converter = detail::FrameConverter(this->videoOptions_);
+        }
+
+        Packets packets;
+
+        auto send = [&](AVFrame *frame)
+        {
+            int result = this->statistics_->Time(
+                Stage::send,
+                [&]()
+                {
+                    return avcodec_send_frame(codecContext, frame);
+                });
+
+            if (result < 0)
+            {
+                throw OutputError(
+                    DescribeError(
+                        "Error sending a frame to the encoder",
+                        result));
+            }
+
+            while (true)
+            {
+                OutputPacket packet;
+
+                result = this->statistics_->Time(
+                    Stage::receive,
+                    [&]()
+                    {
+                        return avcodec_receive_packet(codecContext, packet);
+                    });
+
+                if (result == AVERROR(EAGAIN) || result == AVERROR_EOF)
+                {
+                    return;
+                }
+
+                if (result < 0)
+                {
+                    throw OutputError("Error receiving encoded packet");
+                }
+
+                // Frame timestamps count from the first frame of the video,
+                // so the packets of consecutive segments are continuous.
+                av_packet_rescale_ts(
+                    packet,
+                    codecContext->time_base,
+                    this->stream_->time_base);
+
+                packet->stream_index = this->stream_->index;
+                packets.push_back(std::move(packet));
+            }
+        };
+
+        for (int64_t frameIndex = begin; frameIndex < end; ++frameIndex)
+        {
+            // The encoder may still hold a reference to the last frame.
+            input.MakeWritable();
+            fill(frameIndex, input);
+
+            Frame *encoded = &input;
+
+            if (needsConversion)
+            {
+                converted.MakeWritable();
+
+                this->statistics_->Time(
+                    Stage::reformat,
+                    [&]()
+                    {
+                        converter(input, converted);
+                    });
+
+                encoded = &converted;
+            }
+
+            (*encoded)->pts = frameIndex;
+            send(*encoded);
+            this->statistics_->AddFrame();
+        }
+
+        // Drain the encoder.
+        send(NULL);
+
+        return packets;
+    }
+
+    /**
+     ** Write the packets of every completed segment that follows the
+     ** segments already written.
+     **/
+    void Stitch_(size_t segment, Packets &&packets)
+    {
+        std::lock_guard lock(this->stitchMutex_);
+
+        this->completed_.emplace(segment, std::move(packets));
+
+        auto next = this->completed_.find(this->nextSegment_);
+
+        while (next != this->completed_.end())
+        {
+            for (auto &packet: next->second)
+            {
+                this->outputContext_->WritePacket(packet);
+            }
+
+            this->completed_.erase(next);
+            next = this->completed_.find(++this->nextSegment_);
+        }
+    }
+
+private:
+    Dictionary codecOptions_;
+    VideoOptions videoOptions_;
+    SegmentOptions segmentOptions_;
+    int64_t segmentFrameCount_;
+    int64_t frameCount_;
+
+    // Output keeps its OutputContext private.
+    std::shared_ptr<OutputContext> outputContext_;
+
+    std::mutex stitchMutex_;
+    std::map<size_t, Packets> completed_;
+    size_t nextSegment_;
+};
+
+
+} // end namespace clip
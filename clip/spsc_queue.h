@@ -0,0 +1,197 @@
+/**
+  * @file spsc_queue.h
+  *
+  * @brief Bounded lock-free queue for one producer and one consumer.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+
+namespace clip
+{
+
+
+/**
+ ** Values are pushed by a single producer and popped by a single consumer.
+ **
+ ** The producer may also pop, to discard the oldest value when the queue is
+ ** full. Pops claim their slot with a compare-and-swap, so the producer and
+ ** the consumer never receive the same value.
+ **
+ ** Head and tail are monotonic counters; they never wrap in practice.
+ **/
+template<typename T>
+class SpscQueue
+{
+    static_assert(
+        std::is_trivially_copyable_v<T>,
+        "Values are stored in atomic slots.");
+
+public:
+    explicit SpscQueue(size_t capacity)
+        :
+        capacity_(capacity),
+        slots_(capacity),
+        head_(0),
+        tail_(0)
+    {
+        assert(capacity > 0);
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue & operator=(const SpscQueue &) = delete;
+
+    size_t GetCapacity() const
+    {
+        return this->capacity_;
+    }
+
+    size_t GetSize() const
+    {
+        uint64_t head = this->head_.load(std::memory_order_acquire);
+        uint64_t tail = this->tail_.load(std::memory_order_acquire);
+
+        return static_cast<size_t>(tail - head);
+    }
+
+    /**
+     ** Producer only.
+     **
+     ** @return false if the queue is full.
+     **/
+    bool TryPush(T value)
+    {
+        uint64_t tail = this->tail_.load(std::memory_order_relaxed);
+        uint64_t head = this->head_.load(std::memory_order_acquire);
+
+        if (tail - head >= this->capacity_)
+        {
+            return false;
+        }
+
+        this->slots_[tail % this->capacity_].store(
+            value,
+            std::memory_order_relaxed);
+
+        this->tail_.store(tail + 1, std::memory_order_release);
+        this->tail_.notify_all();
+
+        return true;
+    }
+
+    /**
+     ** Producer only. Blocks until there is room for the value.
+     **/
+    void Push(T value)
+    {
+        while (!this->TryPush(value))
+        {
+            this->WaitForSpace();
+        }
+    }
+
+    /**
+     ** Consumer, or the producer discarding the oldest value.
+     **
+     ** @return The oldest value, or nothing if the queue is empty.
+     **/
+    std::optional<T> TryPop()
+    {
+        uint64_t head = this->head_.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            uint64_t tail = this->tail_.load(std::memory_order_acquire);
+
+            if (head == tail)
+            {
+                return {};
+            }
+
+            T value =
+                this->slots_[head % this->capacity_].load(
+                    std::memory_order_relaxed);
+
+            if (this->head_.compare_exchange_weak(
+                    head,
+                    head + 1,
+                    std::memory_order_acq_rel,
+                    std::memory_order_relaxed))
+            {
+                this->head_.notify_all();
+
+                return value;
+            }
+
+            // Another pop claimed the slot, and head has been reloaded.
+        }
+    }
+
+    /**
+     ** Consumer only. Blocks until a value is available.
+     **/
+    T Pop()
+    {
+        while (true)
+        {
+            auto value = this->TryPop();
+
+            if (value)
+            {
+                return *value;
+            }
+
+            this->WaitForData();
+        }
+    }
+
+    /**
+     ** Block while the queue is full.
+     **/
+    void WaitForSpace() const
+    {
+        uint64_t head = this->head_.load(std::memory_order_acquire);
+        uint64_t tail = this->tail_.load(std::memory_order_relaxed);
+
+        if (tail - head >= this->capacity_)
+        {
+            this->head_.wait(head, std::memory_order_acquire);
+        }
+    }
+
+    /**
+     ** Block while the queue is empty.
+     **/
+    void WaitForData() const
+    {
+        uint64_t tail = this->tail_.load(std::memory_order_acquire);
+        uint64_t head = this->head_.load(std::memory_order_acquire);
+
+        if (head == tail)
+        {
+            this->tail_.wait(tail, std::memory_order_acquire);
+        }
+    }
+
+private:
+    size_t capacity_;
+    std::vector<std::atomic<T>> slots_;
+    std::atomic<uint64_t> head_;
+    std::atomic<uint64_t> tail_;
+};
+
+
+} // end namespace clip
@@ -0,0 +1,191 @@
+/**
+  * @file thread_budget.h
+  *
+  * @brief Divides the machine's cores among the codecs that are open.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+
+namespace clip
+{
+
+
+/**
+ ** Every video Output holds a Lease for as long as it exists. When an
+ ** encoder is opened without an explicit thread count, it is given an equal
+ ** share of the budget's threads, so that many outputs in one process do
+ ** not each start a thread per core. Audio outputs are not counted.
+ **
+ ** Shares are never rebalanced. A codec's thread count is fixed when it is
+ ** opened, so GetShare only describes the encoders opened after it is
+ ** called: an encoder opened alone keeps every core after others open
+ ** beside it, and the threads of a closed encoder are only used by encoders
+ ** opened later. Give the expected number of outputs to the constructor, or
+ ** to SetExpectedCount, when it is known in advance.
+ **/
+class ThreadBudget
+{
+public:
+    class Lease
+    {
+    public:
+        Lease()
+            :
+            budget_(nullptr)
+        {
+
+        }
+
+        explicit Lease(ThreadBudget &budget)
+            :
+            budget_(&budget)
+        {
+            this->budget_->liveCount_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        Lease(const Lease &) = delete;
+        Lease & operator=(const Lease &) = delete;
+
+        Lease(Lease &&other)
+            :
+            budget_(other.budget_)
+        {
+            other.budget_ = nullptr;
+        }
+
+        Lease & operator=(Lease &&other)
+        {
+            if (this != &other)
+            {
+                this->Release_();
+                this->budget_ = other.budget_;
+                other.budget_ = nullptr;
+            }
+
+            return *this;
+        }
+
+        ~Lease()
+        {
+            this->Release_();
+        }
+
+        /**
+         ** @return The threads this lease may use now, at least one, or one
+         **     for an empty lease.
+         **/
+        unsigned GetShare() const
+        {
+            if (!this->budget_)
+            {
+                return 1;
+            }
+
+            return this->budget_->GetShare();
+        }
+
+    private:
+        void Release_()
+        {
+            if (this->budget_)
+            {
+                this->budget_->liveCount_.fetch_sub(
+                    1,
+                    std::memory_order_relaxed);
+
+                this->budget_ = nullptr;
+            }
+        }
+
+        ThreadBudget *budget_;
+    };
+
+    explicit ThreadBudget(
+        unsigned threadCount = std::thread::hardware_concurrency(),
+        unsigned expectedCount = 0)
+        :
+        threadCount_(std::max(1u, threadCount)),
+        expectedCount_(expectedCount),
+        liveCount_(0)
+    {
+
+    }
+
+    ThreadBudget(const ThreadBudget &) = delete;
+    ThreadBudget & operator=(const ThreadBudget &) = delete;
+
+    /**
+     ** The budget shared by every Output in the process.
+     **/
+    static ThreadBudget & Get()
+    {
+        static ThreadBudget budget;
+
+        return budget;
+    }
+
+    Lease Acquire()
+    {
+        return Lease(*this);
+    }
+
+    /**
+     ** Change the number of threads to divide, which defaults to the number
+     ** of cores.
+     **/
+    void SetThreadCount(unsigned threadCount)
+    {
+        this->threadCount_.store(
+            std::max(1u, threadCount),
+            std::memory_order_relaxed);
+    }
+
+    unsigned GetThreadCount() const
+    {
+        return this->threadCount_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     ** Divide the threads among at least expectedCount leases, even while
+     ** fewer are live.
+     **/
+    void SetExpectedCount(unsigned expectedCount)
+    {
+        this->expectedCount_.store(expectedCount, std::memory_order_relaxed);
+    }
+
+    unsigned GetLiveCount() const
+    {
+        return this->liveCount_.load(std::memory_order_relaxed);
+    }
+
+    unsigned GetShare() const
+    {
+        unsigned divisor = std::max(
+            {
+                1u,
+                this->liveCount_.load(std::memory_order_relaxed),
+                this->expectedCount_.load(std::memory_order_relaxed)});
+
+        return std::max(1u, this->GetThreadCount() / divisor);
+    }
+
+private:
+    std::atomic<unsigned> threadCount_;
+    std::atomic<unsigned> expectedCount_;
+    std::atomic<unsigned> liveCount_;
+};
+
+
+} // end namespace clip
@@ -0,0 +1,251 @@
+/**
+  * @file thread_pool.h
+  *
+  * @brief A fixed set of worker threads that share indexed work.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace clip
+{
+
+
+class ThreadPool
+{
+public:
+    static unsigned GetDefaultThreadCount()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /**
+     ** The thread calling ParallelFor also does work, so threadCount - 1
+     ** workers are started.
+     **/
+    explicit ThreadPool(unsigned threadCount = GetDefaultThreadCount())
+        :
+        callMutex_(),
+        mutex_(),
+        wake_(),
+        done_(),
+        job_(nullptr),
+        generation_(0),
+        isStopping_(false),
+        workers_()
+    {
+        for (unsigned i = 1; i < threadCount; ++i)
+        {
+            this->workers_.emplace_back(&ThreadPool::Run_, this);
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard lock(this->mutex_);
+            this->isStopping_ = true;
+        }
+
+        this->wake_.notify_all();
+
+        for (auto &worker: this->workers_)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    unsigned GetThreadCount() const
+    {
+        return static_cast<unsigned>(this->workers_.size()) + 1;
+    }
+
+    /**
+     ** Call function(index) for every index in [0, count), and return when
+     ** all calls have finished.
+     **
+     ** Indices are handed out one at a time, in order, to whichever thread
+     ** is free. The first exception thrown by function is rethrown here.
+     **/
+    void ParallelFor(size_t count, const std::function<void(size_t)> &function)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        if (this->workers_.empty() || count == 1)
+        {
+            for (size_t index = 0; index < count; ++index)
+            {
+                function(index);
+            }
+
+            return;
+        }
+
+        // One job at a time.
+        std::lock_guard callLock(this->callMutex_);
+
+        Job job(count, function);
+
+        {
+            std::lock_guard lock(this->mutex_);
+            this->job_ = &job;
+            ++this->generation_;
+        }
+
+        this->wake_.notify_all();
+        Work_(job);
+
+        {
+            // Once the job is withdrawn no other worker can join it.
+            // Every index has been claimed, so the job is complete when the
+            // workers that joined it have returned.
+            std::unique_lock lock(this->mutex_);
+            this->job_ = nullptr;
+
+            this->done_.wait(
+                lock,
+                [&job]()
+                {
+                    return job.workerCount == 0;
+                });
+        }
+
+        if (job.error)
+        {
+            std::rethrow_exception(job.error);
+        }
+    }
+
+private:
+    struct Job
+    {
+        Job(size_t count_, const std::function<void(size_t)> &function_)
+            :
+            count(count_),
+            function(function_),
+            next(0),
+            workerCount(0),
+            hasError(false),
+            error()
+        {
+
+        }
+
+        size_t count;
+        const std::function<void(size_t)> &function;
+        std::atomic<size_t> next;
+
+        // Guarded by the pool's mutex_.
+        size_t workerCount;
+
+        std::atomic<bool> hasError;
+        std::exception_ptr error;
+    };
+
+    static void Work_(Job &job)
+    {
+        while (!job.hasError.load(std::memory_order_relaxed))
+        {
+            size_t index = job.next.fetch_add(1, std::memory_order_relaxed);
+
+            if (index >= job.count)
+            {
+                return;
+            }
+
+            try
+            {
+                job.function(index);
+            }
+            catch (...)
+            {
+                if (!job.hasError.exchange(true))
+                {
+                    job.error = std::current_exception();
+                }
+
+                return;
+            }
+        }
+    }
+
+    void Run_()
+    {
+        size_t seenGeneration = 0;
+
+        while (true)
+        {
+            Job *job;
+
+            {
+                std::unique_lock lock(this->mutex_);
+
+                this->wake_.wait(
+                    lock,
+                    [this, seenGeneration]()
+                    {
+                        return this->isStopping_
+                            || (this->job_
+                                && this->generation_ != seenGeneration);
+                    });
+
+                if (this->isStopping_)
+                {
+                    return;
+                }
+
+                seenGeneration = this->generation_;
+                job = this->job_;
+                ++job->workerCount;
+            }
+
+            Work_(*job);
+
+            bool isLast;
+
+            {
+                std::lock_guard lock(this->mutex_);
+                isLast = (--job->workerCount == 0);
+            }
+
+            if (isLast)
+            {
+                this->done_.notify_one();
+            }
+        }
+    }
+
+private:
+    std::mutex callMutex_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    Job *job_;
+    size_t generation_;
+    bool isStopping_;
+    std::vector<std::thread> workers_;
+};
+
+
+} // end namespace clip
@@ -0,0 +1,395 @@
+/**
+  * @file thumbnail_extractor.h
+  *
+  * @brief Decodes only the keyframes of a video stream into small RGB24
+  *     images.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "tau/eigen.h"
+#include "clip/decoder.h"
+#include "clip/frame.h"
+#include "clip/input_context.h"
+#include "clip/packet.h"
+#include "clip/reformat.h"
+#include "clip/resolution.h"
+#include "clip/thread_pool.h"
+
+
+namespace clip
+{
+
+
+struct ThumbnailOptions
+{
+    // Thumbnails keep the aspect ratio of the video, and fit within this
+    // size.
+    Resolution maximumSize;
+
+    unsigned threadCount;
+
+    // Keyframes read before each parallel decode. Larger batches keep the
+    // threads busier, and hold more packets in memory.
+    size_t batchSize;
+
+    static ThumbnailOptions MakeDefault()
+    {
+        return {
+            .maximumSize = {160, 120},
+            .threadCount = ThreadPool::GetDefaultThreadCount(),
+            .batchSize = 64};
+    }
+};
+
+
+struct Thumbnail
+{
+    // Row-major RGB24, with three columns per pixel.
+    using Image = Eigen::Matrix
+        <
+            uint8_t,
+            Eigen::Dynamic,
+            Eigen::Dynamic,
+            Eigen::RowMajor
+        >;
+
+    // In the time base of ThumbnailExtractor::GetStream().
+    int64_t pts;
+
+    Image image;
+};
+
+
+/**
+ ** @return The largest size within maximumSize with the aspect ratio of
+ ** source. Sizes that already fit are not enlarged.
+ **/
+inline Resolution FitResolution(
+    const Resolution &source,
+    const Resolution &maximumSize)
+{
+    double scale = std::min(
+        1.0,
+        std::min(
+            maximumSize.width / static_cast<double>(source.width),
+            maximumSize.height / static_cast<double>(source.height)));
+
+    return {
+        std::max(1, static_cast<int>(source.width * scale)),
+        std::max(1, static_cast<int>(source.height * scale))};
+}
+
+
+/**
+ ** Called in presentation order of the keyframes, on the thread that called
+ ** Extract.
+ **/
+using ThumbnailCallback = std::function<void(Thumbnail &&)>;
+
+
+/**
+ ** Makes a thumbnail of every keyframe of the best video stream.
+ **
+ ** The demuxer discards every other packet, so only keyframes are read.
+ ** Each keyframe is decoded on its own, with a single-threaded decoder, and
+ ** a batch of keyframes is decoded in parallel on a ThreadPool.
+ **
+ ** A keyframe that cannot be decoded without the frames before it, like the
+ ** recovery point of an open group of pictures, may be skipped.
+ **/
+class ThumbnailExtractor
+{
+public:
+    ThumbnailExtractor(
+        const std::string &fileName,
+        const ThumbnailOptions &options = ThumbnailOptions::MakeDefault())
+        :
+        options_(options),
+        inputContext_(fileName),
+        streamIndex_(FindVideoStream_(this->inputContext_)),
+        resolution_(
+            FitResolution_(
+                this->GetStream()->codecpar,
+                options.maximumSize)),
+        threadPool_(options.threadCount),
+        workersMutex_(),
+        workers_()
+    {
+        if (this->options_.batchSize < 1)
+        {
+            throw ClipError("Thumbnail batch size must be positive.");
+        }
+
+        this->inputContext_.SelectStreams({this->streamIndex_});
+
+        // Drop the non-key packets in the demuxer, before they are read.
+        this->inputContext_.SetDiscard(this->streamIndex_, AVDISCARD_NONKEY);
+    }
+
+    ThumbnailExtractor(const ThumbnailExtractor &) = delete;
+    ThumbnailExtractor & operator=(const ThumbnailExtractor &) = delete;
+
+    const AVStream * GetStream() const
+    {
+        return this->inputContext_.GetStream(this->streamIndex_);
+    }
+
+    /**
+     ** @return The size of each thumbnail.
+     **/
+    Resolution GetResolution() const
+    {
+        return this->resolution_;
+    }
+
+    void Extract(const ThumbnailCallback &callback)
+    {
+        std::vector<OutputPacket> batch;
+        std::vector<std::optional<Thumbnail>> thumbnails;
+
+        for (auto &packet: this->inputContext_.GetPackets())
+        {
+            // Not every demuxer honors AVDISCARD_NONKEY.
+            if (!(packet->flags & AV_PKT_FLAG_KEY))
+            {
+                continue;
+            }
+
+            // Take the demuxer's reference, without copying the payload.
+            OutputPacket keyframe;
+            av_packet_move_ref(keyframe, packet);
+            batch.push_back(std::move(keyframe));
+
+            if (batch.size() == this->options_.batchSize)
+            {
+                this->DecodeBatch_(batch, thumbnails, callback);
+            }
+        }
+
+        this->DecodeBatch_(batch, thumbnails, callback);
+    }
+
+    std::vector<Thumbnail> Extract()
+    {
+        std::vector<Thumbnail> result;
+
+        this->Extract(
+            [&result](Thumbnail &&thumbnail)
+            {
+                result.push_back(std::move(thumbnail));
+            });
+
+        return result;
+    }
+
+private:
+    // Each thread borrows a decoder and converter for one keyframe at a time.
+    struct Worker
+    {
+        Worker(const AVStream *stream)
+            :
+            decoder(stream, MakeDecoderOptions_()),
+            decoded(Frame::MakeEmpty()),
+            target(Frame::MakeEmpty()),
+            reformat(),
+            sourceFormat(AV_PIX_FMT_NONE),
+            sourceResolution{0, 0}
+        {
+
+        }
+
+        Decoder decoder;
+        Frame decoded;
+        Frame target;
+        Reformat reformat;
+        AVPixelFormat sourceFormat;
+        Resolution sourceResolution;
+    };
+
+    static DecoderOptions MakeDecoderOptions_()
+    {
+        auto options = DecoderOptions::MakeDefault();
+
+        // Keyframes are decoded in parallel, one per thread.
+        options.threadCount = 1;
+        options.skipFrame = AVDISCARD_NONKEY;
+
+        return options;
+    }
+
+    static int FindVideoStream_(const InputContext &inputContext)
+    {
+        auto streamIndex = inputContext.FindBestStream(AVMEDIA_TYPE_VIDEO);
+
+        if (!streamIndex)
+        {
+            throw DecoderError("Unable to find a video stream.");
+        }
+
+        return *streamIndex;
+    }
+
+    static Resolution FitResolution_(
+        const AVCodecParameters *parameters,
+        const Resolution &maximumSize)
+    {
+        if (parameters->width <= 0 || parameters->height <= 0)
+        {
+            throw DecoderError("The video stream has no size.");
+        }
+
+        return FitResolution(
+            {parameters->width, parameters->height},
+            maximumSize);
+    }
+
+    void DecodeBatch_(
+        std::vector<OutputPacket> &batch,
+        std::vector<std::optional<Thumbnail>> &thumbnails,
+        const ThumbnailCallback &callback)
+    {
+        thumbnails.clear();
+        thumbnails.resize(batch.size());
+
+        this->threadPool_.ParallelFor(
+            batch.size(),
+            [&](size_t index)
+            {
+                auto worker = this->AcquireWorker_();
+                thumbnails[index] = this->Decode_(*worker, batch[index]);
+                this->ReleaseWorker_(std::move(worker));
+            });
+
+        batch.clear();
+
+        std::vector<Thumbnail> decoded;
+
+        for (auto &thumbnail: thumbnails)
+        {
+            if (thumbnail)
+            {
+                decoded.push_back(std::move(*thumbnail));
+            }
+        }
+
+        // Keyframes are demuxed in decoding order.
+        std::stable_sort(
+            decoded.begin(),
+            decoded.end(),
+            [](const Thumbnail &first, const Thumbnail &second)
+            {
+                return first.pts < second.pts;
+            });
+
+        for (auto &thumbnail: decoded)
+        {
+            callback(std::move(thumbnail));
+        }
+    }
+
+    std::unique_ptr<Worker> AcquireWorker_()
+    {
+        {
+            std::lock_guard lock(this->workersMutex_);
+
+            if (!this->workers_.empty())
+            {
+                auto worker = std::move(this->workers_.back());
+                this->workers_.pop_back();
+
+                return worker;
+            }
+        }
+
+        return std::make_unique<Worker>(this->GetStream());
+    }
+
+    void ReleaseWorker_(std::unique_ptr<Worker> worker)
+    {
+        std::lock_guard lock(this->workersMutex_);
+        this->workers_.push_back(std::move(worker));
+    }
+
+    std::optional<Thumbnail> Decode_(Worker &worker, const AVPacket *packet)
+    {
+        // Each keyframe is decoded on its own.
+        worker.decoder.Reset();
+        worker.decoder.Send(packet);
+        worker.decoder.Send(NULL);
+
+        if (!worker.decoder.Receive(worker.decoded))
+        {
+            return {};
+        }
+
+        Thumbnail thumbnail{
+            worker.decoded->best_effort_timestamp,
+            Thumbnail::Image(
+                this->resolution_.height,
+                this->resolution_.width * 3)};
+
+        this->Convert_(worker, thumbnail.image);
+
+        // Return the decoder's buffer.
+        av_frame_unref(worker.decoded);
+
+        return thumbnail;
+    }
+
+    void Convert_(Worker &worker, Thumbnail::Image &image)
+    {
+        const Frame &decoded = worker.decoded;
+        auto sourceFormat = static_cast<AVPixelFormat>(decoded->format);
+        Resolution sourceResolution{decoded->width, decoded->height};
+
+        if (
+            !worker.reformat
+            || sourceFormat != worker.sourceFormat
+            || sourceResolution != worker.sourceResolution)
+        {
+            // Area averaging suits large reductions.
+            worker.reformat = Reformat(
+                sourceResolution,
+                sourceFormat,
+                this->resolution_,
+                AV_PIX_FMT_RGB24,
+                SWS_AREA);
+
+            worker.sourceFormat = sourceFormat;
+            worker.sourceResolution = sourceResolution;
+        }
+
+        // Point the target frame at the image.
+        worker.target->data[0] = image.data();
+        worker.target->linesize[0] = static_cast<int>(image.cols());
+
+        worker.reformat(decoded, worker.target);
+    }
+
+    ThumbnailOptions options_;
+    InputContext inputContext_;
+    int streamIndex_;
+    Resolution resolution_;
+    ThreadPool threadPool_;
+
+    std::mutex workersMutex_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+
+} // end namespace clip
@@ -0,0 +1,781 @@
+/**
+  * @file transcoder.h
+  *
+  * @brief Decodes a video stream and encodes it again, with each stage on its
+  *     own thread.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clip/decoder.h"
+#include "clip/detail/bounded_queue.h"
+#include "clip/frame.h"
+#include "clip/input_context.h"
+#include "clip/output_context.h"
+#include "clip/packet.h"
+#include "clip/reformat.h"
+#include "clip/resolution.h"
+#include "clip/stream.h"
+#include "clip/video_output.h"
+
+
+namespace clip
+{
+
+
+enum class AudioMode
+{
+    // Copy the best audio stream's packets to the output without decoding.
+    copy,
+
+    // Leave the audio out of the output.
+    drop
+};
+
+
+struct TranscodeOptions
+{
+    // Packets or frames that may wait between each pair of stages.
+    size_t queueDepth;
+
+    DecoderOptions decoderOptions;
+
+    AudioMode audioMode;
+
+    static TranscodeOptions MakeDefault()
+    {
+        return {
+            .queueDepth = 8,
+            .decoderOptions = DecoderOptions::MakeDefault(),
+            .audioMode = AudioMode::copy};
+    }
+};
+
+
+struct StageOccupancy
+{
+    // Items waiting for this stage, and the most that may wait.
+    size_t queued;
+    size_t capacity;
+
+    // Items this stage has produced.
+    uint64_t itemCount;
+
+    // Time spent working, excluding time blocked on the queues.
+    std::chrono::nanoseconds busyTime;
+};
+
+
+/**
+ ** The slowest stage has the most busy time, and the queue before it stays
+ ** full.
+ **/
+struct TranscodeOccupancy
+{
+    StageOccupancy demux;
+    StageOccupancy decode;
+    StageOccupancy reformat;
+    StageOccupancy encode;
+
+    // Packets waiting for the OutputContext's mux thread, if enabled.
+    size_t muxQueued;
+};
+
+
+namespace detail
+{
+
+
+class StageCounters
+{
+public:
+    StageCounters()
+        :
+        itemCount_(0),
+        busyTime_ns_(0)
+    {
+
+    }
+
+    template<typename Function>
+    auto Time(Function &&function)
+    {
+        struct Timer
+        {
+            ~Timer()
+            {
+                auto elapsed = std::chrono::steady_clock::now() - this->start;
+
+                this->busyTime_ns.fetch_add(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        elapsed).count(),
+                    std::memory_order_relaxed);
+            }
+
+            std::atomic<int64_t> &busyTime_ns;
+            std::chrono::steady_clock::time_point start;
+        };
+
+        Timer timer{this->busyTime_ns_, std::chrono::steady_clock::now()};
+
+        return function();
+    }
+
+    void AddItem()
+    {
+        this->itemCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    StageOccupancy GetOccupancy(size_t queued, size_t capacity) const
+    {
+        return {
+            queued,
+            capacity,
+            this->itemCount_.load(std::memory_order_relaxed),
+            std::chrono::nanoseconds(
+                this->busyTime_ns_.load(std::memory_order_relaxed))};
+    }
+
+private:
+    std::atomic<uint64_t> itemCount_;
+    std::atomic<int64_t> busyTime_ns_;
+};
+
+
+} // end namespace detail
+
+
+/**
+ ** Transcodes the best video stream of a file into a VideoOutput.
+ **
+ ** Demuxing, decoding, conversion to the encoder's pixel format, and
+ ** encoding each run on their own thread, connected by bounded queues of
+ ** reference-counted packets and frames, so nothing is copied between
+ ** stages. Enable the OutputContext's mux thread to give muxing a thread of
+ ** its own.
+ **
+ ** Frames are encoded in presentation order, at the decoder's best-effort
+ ** timestamps rescaled to 1 / videoOptions.framesPerSecond and counted from
+ ** the start of the video stream. When framesPerSecond is zero, the input
+ ** stream's average frame rate is used. A frame that rounds to the same time
+ ** stamp as the frame before it is dropped.
+ **
+ ** With AudioMode::copy, the packets of the best audio stream are copied to
+ ** the output on the demuxing thread, shifted by the same start time so that
+ ** they stay in sync with the video.
+ **
+ ** Create the Transcoder before initializing the OutputContext, call Run(),
+ ** and then finalize the OutputContext.
+ **/
+class Transcoder
+{
+public:
+    /**
+     ** videoOptions.inPixelFormat is ignored. Decoded frames are converted
+     ** directly to outPixelFormat at the output resolution.
+     **
+     ** Set videoOptions.framesPerSecond to zero to keep the input's frame
+     ** rate.
+     **
+     ** Throws VideoError when the input has audio that the output format
+     ** cannot hold, unless options.audioMode is AudioMode::drop.
+     **/
+    Transcoder(
+        const std::string &inputFileName,
+        std::shared_ptr<OutputContext> outputContext,
+        Dictionary &codecOptions,
+        VideoOptions videoOptions,
+        const TranscodeOptions &options = TranscodeOptions::MakeDefault())
+        :
+        inputContext_(inputFileName),
+        streamIndex_(FindVideoStream_(this->inputContext_)),
+        decoder_(
+            this->inputContext_.GetStream(this->streamIndex_),
+            options.decoderOptions),
+        outputContext_(outputContext),
+        videoOutput_(
+            outputContext,
+            codecOptions,
+            MatchFormats_(
+                videoOptions,
+                this->inputContext_.GetStream(this->streamIndex_))),
+        packets_(options.queueDepth),
+        decoded_(options.queueDepth),
+        converted_(options.queueDepth),
+
+        // Enough frames that recycling never blocks the encoder.
+        recycled_(options.queueDepth + 2),
+
+        reformat_(),
+        sourceFormat_(AV_PIX_FMT_NONE),
+        sourceResolution_{0, 0},
+        inputTimeBase_(
+            this->inputContext_.GetStream(this->streamIndex_)->time_base),
+        startPts_(GetStartPts_(this->inputContext_, this->streamIndex_)),
+        audioStreamIndex_(),
+        audioOutputIndex_(-1),
+        demuxStage_(),
+        decodeStage_(),
+        convertStage_(),
+        encodeStage_(),
+        errorMutex_(),
+        hasError_(false),
+        error_()
+    {
+        if (options.audioMode == AudioMode::copy)
+        {
+            this->audioStreamIndex_ =
+                this->inputContext_.FindBestStream(AVMEDIA_TYPE_AUDIO);
+        }
+
+        if (!this->audioStreamIndex_)
+        {
+            this->inputContext_.SelectStreams({this->streamIndex_});
+
+            return;
+        }
+
+        this->audioOutputIndex_ = this->CreateAudioStream_();
+
+        this->inputContext_.SelectStreams(
+            {this->streamIndex_, *this->audioStreamIndex_});
+    }
+
+    Transcoder(const Transcoder &) = delete;
+    Transcoder & operator=(const Transcoder &) = delete;
+
+    /**
+     ** Blocks until every frame has been encoded and the encoder has been
+     ** flushed.
+     **
+     ** Rethrows the first error from any stage.
+     **/
+    void Run()
+    {
+        std::vector<std::thread> threads;
+
+        for (
+            auto stage: {
+                &Transcoder::Demux_,
+                &Transcoder::Decode_,
+                &Transcoder::Convert_,
+                &Transcoder::Encode_})
+        {
+            threads.emplace_back(&Transcoder::RunStage_, this, stage);
+        }
+
+        for (auto &thread: threads)
+        {
+            thread.join();
+        }
+
+        if (this->hasError_.load(std::memory_order_acquire))
+        {
+            std::rethrow_exception(this->error_);
+        }
+    }
+
+    /**
+     ** Safe to call from any thread while Run() is in progress.
+     **/
+    TranscodeOccupancy GetOccupancy() const
+    {
+        return {
+            this->demuxStage_.GetOccupancy(0, 0),
+            this->decodeStage_.GetOccupancy(
+                this->packets_.GetSize(),
+                this->packets_.GetCapacity()),
+            this->convertStage_.GetOccupancy(
+                this->decoded_.GetSize(),
+                this->decoded_.GetCapacity()),
+            this->encodeStage_.GetOccupancy(
+                this->converted_.GetSize(),
+                this->converted_.GetCapacity()),
+            this->outputContext_->GetMuxQueueDepth()};
+    }
+
+    const VideoOutput & GetVideoOutput() const
+    {
+        return this->videoOutput_;
+    }
+
+private:
+    static int FindVideoStream_(const InputContext &inputContext)
+    {
+        auto streamIndex = inputContext.FindBestStream(AVMEDIA_TYPE_VIDEO);
+
+        if (!streamIndex)
+        {
+            throw DecoderError("Unable to find a video stream.");
+        }
+
+        return *streamIndex;
+    }
+
+    static VideoOptions & MatchFormats_(
+        VideoOptions &videoOptions,
+        const AVStream *stream)
+    {
+        // The conversion stage writes the encoder's format, so VideoOutput
+        // does not need a converter of its own.
+        videoOptions.inPixelFormat = videoOptions.outPixelFormat;
+        videoOptions.encoderQueueDepth = 0;
+
+        if (videoOptions.framesPerSecond <= 0)
+        {
+            videoOptions.framesPerSecond = GetFramesPerSecond_(stream);
+        }
+
+        return videoOptions;
+    }
+
+    static int GetFramesPerSecond_(const AVStream *stream)
+    {
+        // Prefer the average rate, which the demuxer measures, to the
+        // guess in r_frame_rate.
+        for (auto rate: {stream->avg_frame_rate, stream->r_frame_rate})
+        {
+            if (rate.num > 0 && rate.den > 0)
+            {
+                return std::max(1, static_cast<int>(av_q2d(rate) + 0.5));
+            }
+        }
+
+        throw DecoderError(
+            "Unable to find the frame rate of the video stream. "
+            "Set videoOptions.framesPerSecond.");
+    }
+
+    // @return The start of the video stream, in its own time base.
+    static int64_t GetStartPts_(
+        const InputContext &inputContext,
+        int streamIndex)
+    {
+        const AVStream *stream = inputContext.GetStream(streamIndex);
+
+        if (stream->start_time != AV_NOPTS_VALUE)
+        {
+            return stream->start_time;
+        }
+
+        if (inputContext->start_time != AV_NOPTS_VALUE)
+        {
+            // AV_TIME_BASE_Q is a C compound literal.
+            return av_rescale_q(
+                inputContext->start_time,
+                AVRational{1, AV_TIME_BASE},
+                stream->time_base);
+        }
+
+        return 0;
+    }
+
+    // @return The index of the output stream.
+    int CreateAudioStream_()
+    {
+        const AVStream *input =
+            this->inputContext_.GetStream(*this->audioStreamIndex_);
+
+        const AVOutputFormat *outputFormat = (*this->outputContext_)->oformat;
+
+        int isSupported = avformat_query_codec(
+            outputFormat,
+            input->codecpar->codec_id,
+            FF_COMPLIANCE_NORMAL);
+
+        // Negative when the muxer cannot tell, which is left to
+        // avformat_write_header to decide.
+        if (isSupported == 0)
+        {
+            throw VideoError(
+                std::string("The audio of this input cannot be stored in ")
+                + outputFormat->name + ". Set audioMode to AudioMode::drop.");
+        }
+
+        Stream output(*this->outputContext_);
+
+        int result = avcodec_parameters_copy(output->codecpar, input->codecpar);
+
+        if (result < 0)
+        {
+            throw VideoError(
+                DescribeError("Could not copy audio parameters", result));
+        }
+
+        // Let the muxer choose a tag for the output container.
+        output->codecpar->codec_tag = 0;
+        output->time_base = input->time_base;
+
+        return output->index;
+    }
+
+    void RunStage_(void (Transcoder::*stage)())
+    {
+        try
+        {
+            (this->*stage)();
+        }
+        catch (...)
+        {
+            this->Fail_(std::current_exception());
+        }
+    }
+
+    void Fail_(std::exception_ptr error)
+    {
+        {
+            std::lock_guard lock(this->errorMutex_);
+
+            if (!this->hasError_.load(std::memory_order_relaxed))
+            {
+                this->error_ = error;
+                this->hasError_.store(true, std::memory_order_release);
+            }
+        }
+
+        // Unblock every stage.
+        this->packets_.Close();
+        this->decoded_.Close();
+        this->converted_.Close();
+        this->recycled_.Close();
+    }
+
+    bool HasFailed_() const
+    {
+        return this->hasError_.load(std::memory_order_acquire);
+    }
+
+    void Demux_()
+    {
+        auto packets = this->inputContext_.GetPackets();
+
+        auto packet = this->demuxStage_.Time(
+            [&]()
+            {
+                return packets.begin();
+            });
+
+        while (packet != packets.end())
+        {
+            if ((*packet)->stream_index != this->streamIndex_)
+            {
+                this->demuxStage_.Time(
+                    [&]()
+                    {
+                        this->WriteAudio_(*packet);
+                        ++packet;
+                    });
+
+                continue;
+            }
+
+            // Take the demuxer's reference, without copying the payload.
+            OutputPacket demuxed;
+            av_packet_move_ref(demuxed, *packet);
+            this->demuxStage_.AddItem();
+
+            if (!this->packets_.Push(std::move(demuxed)))
+            {
+                return;
+            }
+
+            this->demuxStage_.Time(
+                [&]()
+                {
+                    ++packet;
+                });
+        }
+
+        this->packets_.Close();
+    }
+
+    void WriteAudio_(AVPacket *packet)
+    {
+        const AVStream *input =
+            this->inputContext_.GetStream(*this->audioStreamIndex_);
+
+        // The muxer may have replaced the time base when the header was
+        // written.
+        const AVStream *output =
+            (*this->outputContext_)->streams[this->audioOutputIndex_];
+
+        int64_t offset = av_rescale_q(
+            this->startPts_,
+            this->inputTimeBase_,
+            input->time_base);
+
+        if (packet->pts != AV_NOPTS_VALUE)
+        {
+            if (packet->pts + packet->duration <= offset)
+            {
+                // The packet ends before the first video frame.
+                return;
+            }
+
+            packet->pts -= offset;
+        }
+
+        if (packet->dts != AV_NOPTS_VALUE)
+        {
+            packet->dts -= offset;
+        }
+
+        av_packet_rescale_ts(packet, input->time_base, output->time_base);
+        packet->stream_index = this->audioOutputIndex_;
+
+        // The byte position in the input means nothing to the muxer.
+        packet->pos = -1;
+
+        this->outputContext_->WritePacket(packet);
+    }
+
+    void Decode_()
+    {
+        while (auto packet = this->packets_.Pop())
+        {
+            this->decodeStage_.Time(
+                [&]()
+                {
+                    this->decoder_.Send(*packet);
+                });
+
+            if (!this->ReceiveFrames_())
+            {
+                return;
+            }
+        }
+
+        if (this->HasFailed_())
+        {
+            return;
+        }
+
+        this->decodeStage_.Time(
+            [&]()
+            {
+                this->decoder_.Send(NULL);
+            });
+
+        if (this->ReceiveFrames_())
+        {
+            this->decoded_.Close();
+        }
+    }
+
+    // @return false if the pipeline has stopped.
+    bool ReceiveFrames_()
+    {
+        while (true)
+        {
+            Frame frame = Frame::MakeEmpty();
+
+            bool isReceived = this->decodeStage_.Time(
+                [&]()
+                {
+                    return this->decoder_.Receive(frame);
+                });
+
+            if (!isReceived)
+            {
+                return true;
+            }
+
+            this->decodeStage_.AddItem();
+
+            if (!this->decoded_.Push(std::move(frame)))
+            {
+                return false;
+            }
+        }
+    }
+
+    void Convert_()
+    {
+        while (auto decoded = this->decoded_.Pop())
+        {
+            Frame converted = this->convertStage_.Time(
+                [&]()
+                {
+                    Frame target = this->AcquireTarget_();
+                    this->GetReformat_(*decoded)(*decoded, target);
+
+                    // Carry the presentation time to the encoder.
+                    target->pts = (*decoded)->best_effort_timestamp;
+
+                    return target;
+                });
+
+            // Return the decoder's buffer before waiting on the encoder.
+            decoded.reset();
+            this->convertStage_.AddItem();
+
+            if (!this->converted_.Push(std::move(converted)))
+            {
+                return;
+            }
+        }
+
+        if (!this->HasFailed_())
+        {
+            this->converted_.Close();
+        }
+    }
+
+    Frame AcquireTarget_()
+    {
+        auto recycled = this->recycled_.TryPop();
+
+        if (recycled)
+        {
+            // The encoder may still hold a reference to the buffers.
+            recycled->MakeWritable();
+
+            return std::move(*recycled);
+        }
+
+        const VideoOptions &options = this->videoOutput_.GetOptions();
+
+        return Frame(options.outPixelFormat, options.height, options.width);
+    }
+
+    Reformat & GetReformat_(const Frame &decoded)
+    {
+        auto sourceFormat = static_cast<AVPixelFormat>(decoded->format);
+        Resolution sourceResolution{decoded->width, decoded->height};
+
+        if (
+            !this->reformat_
+            || sourceFormat != this->sourceFormat_
+            || sourceResolution.width != this->sourceResolution_.width
+            || sourceResolution.height != this->sourceResolution_.height)
+        {
+            const VideoOptions &options = this->videoOutput_.GetOptions();
+
+            this->reformat_ = Reformat(
+                sourceResolution,
+                sourceFormat,
+                this->videoOutput_.GetResolution(),
+                options.outPixelFormat,
+                scaleFlag,
+                options.reformatThreadCount);
+
+            this->sourceFormat_ = sourceFormat;
+            this->sourceResolution_ = sourceResolution;
+        }
+
+        return this->reformat_;
+    }
+
+    void Encode_()
+    {
+        while (auto frame = this->converted_.Pop())
+        {
+            auto pts = this->GetOutputPts_(*frame);
+
+            if (pts)
+            {
+                this->encodeStage_.Time(
+                    [&]()
+                    {
+                        this->videoOutput_.WriteFrame(*frame, *pts);
+                    });
+
+                this->encodeStage_.AddItem();
+            }
+
+            // The encoder keeps its own reference, so the frame can be
+            // refilled once the encoder releases the buffers.
+            this->recycled_.Push(std::move(*frame));
+        }
+
+        if (this->HasFailed_())
+        {
+            return;
+        }
+
+        this->encodeStage_.Time(
+            [&]()
+            {
+                this->videoOutput_.Flush();
+            });
+    }
+
+    /**
+     ** @return The frame's pts in the encoder's time base, or empty when it
+     **     does not follow the previous frame's.
+     **/
+    std::optional<int64_t> GetOutputPts_(const Frame &frame)
+    {
+        auto timeStamp = this->videoOutput_.GetTimeStamp();
+
+        if (frame->pts == AV_NOPTS_VALUE)
+        {
+            return timeStamp.Count();
+        }
+
+        int64_t pts = av_rescale_q(
+            frame->pts - this->startPts_,
+            this->inputTimeBase_,
+            timeStamp.GetTimeBase());
+
+        if (pts < timeStamp.Count())
+        {
+            return {};
+        }
+
+        return pts;
+    }
+
+    InputContext inputContext_;
+    int streamIndex_;
+    Decoder decoder_;
+    std::shared_ptr<OutputContext> outputContext_;
+    VideoOutput videoOutput_;
+
+    detail::BoundedQueue<OutputPacket> packets_;
+    detail::BoundedQueue<Frame> decoded_;
+    detail::BoundedQueue<Frame> converted_;
+    detail::BoundedQueue<Frame> recycled_;
+
+    // Only used by the conversion stage.
+    Reformat reformat_;
+    AVPixelFormat sourceFormat_;
+    Resolution sourceResolution_;
+
+    // The video stream's time base and start, shared by both streams.
+    AVRational inputTimeBase_;
+    int64_t startPts_;
+
+    // Only used by the demuxing stage, once constructed.
+    std::optional<int> audioStreamIndex_;
+    int audioOutputIndex_;
+
+    detail::StageCounters demuxStage_;
+    detail::StageCounters decodeStage_;
+    detail::StageCounters convertStage_;
+    detail::StageCounters encodeStage_;
+
+    std::mutex errorMutex_;
+    std::atomic<bool> hasError_;
+    std::exception_ptr error_;
+};
+
+
+} // end namespace clip
@@ -0,0 +1,596 @@
+/**
+  * @file uring_sink.h
+  *
+  * @brief Writes muxed bytes to a file with io_uring, in large batches.
+  *
+  * Only available when clip is built with liburing (CLIP_HAS_IO_URING).
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#ifdef CLIP_HAS_IO_URING
+
+
+#include "clip/ffmpeg_shim.h"
+FFMPEG_SHIM_PUSH_IGNORES
+extern "C"
+{
+
+#include <libavformat/avio.h>
+
+}
+FFMPEG_SHIM_POP_IGNORES
+
+
+#include <fcntl.h>
+#include <liburing.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "clip/error.h"
+
+
+namespace clip
+{
+
+
+struct UringOptions
+{
+    // Bytes collected before a write is submitted.
+    // Rounded up to a multiple of UringFileSink::alignment.
+    size_t bufferSize;
+
+    // Buffers that may be written at once, while the muxer fills another.
+    unsigned bufferCount;
+
+    // Bypass the page cache with O_DIRECT. When the file system does not
+    // support it, writes go through the page cache.
+    bool useDirectIo;
+
+    static UringOptions MakeDefault()
+    {
+        return {
+            .bufferSize = 1024 * 1024,
+            .bufferCount = 4,
+            .useDirectIo = false};
+    }
+};
+
+
+/**
+ ** A file sink for OutputContext that never blocks the muxer on the disk,
+ ** unless every buffer is waiting to be written.
+ **
+ ** Bytes are collected in aligned buffers, and each full buffer is
+ ** submitted to io_uring. Seeking, like mp4 does to finish its headers,
+ ** waits for the writes in flight, so that overlapping writes land in
+ ** order.
+ **
+ ** With O_DIRECT, only aligned, full-sized writes bypass the page cache.
+ ** The final partial buffer and writes after a seek use a second,
+ ** buffered file descriptor.
+ **
+ ** Call Close() after OutputContext::Finalize() to wait for the last
+ ** writes and report their errors.
+ **/
+class UringFileSink
+{
+public:
+    static constexpr size_t alignment = 4096;
+
+    UringFileSink(
+        const std::string &fileName,
+        const UringOptions &options = UringOptions::MakeDefault())
+        :
+        fileName_(fileName),
+        bufferSize_(
+            (std::max(options.bufferSize, alignment) + alignment - 1)
+            / alignment * alignment),
+        bufferedFile_(-1),
+        directFile_(-1),
+        ring_(),
+        isOpen_(false),
+        storage_(),
+        buffers_(),
+        current_(-1),
+        inFlightCount_(0),
+        position_(0),
+        size_(0)
+    {
+        if (options.bufferCount < 1)
+        {
+            throw ClipError("UringFileSink requires at least one buffer.");
+        }
+
+        this->bufferedFile_ = open(
+            fileName.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644);
+
+        if (this->bufferedFile_ < 0)
+        {
+            throw ClipError(
+                "Unable to open " + fileName + ": " + std::strerror(errno));
+        }
+
+        if (options.useDirectIo)
+        {
+            // Fails with EINVAL on file systems without O_DIRECT, like tmpfs.
+            this->directFile_ =
+                open(fileName.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+        }
+
+        int result = io_uring_queue_init(options.bufferCount, &this->ring_, 0);
+
+        if (result < 0)
+        {
+            this->CloseFiles_();
+
+            throw ClipError(
+                std::string("Unable to create io_uring: ")
+                + std::strerror(-result));
+        }
+
+        this->isOpen_ = true;
+
+        for (unsigned i = 0; i < options.bufferCount; ++i)
+        {
+            auto data = static_cast<uint8_t *>(
+                std::aligned_alloc(alignment, this->bufferSize_));
+
+            if (!data)
+            {
+                this->Release_();
+                throw ClipError("Unable to allocate UringFileSink buffers.");
+            }
+
+            this->storage_.emplace_back(data);
+            this->buffers_.push_back({data, 0, 0, 0, -1, false});
+        }
+    }
+
+    UringFileSink(const UringFileSink &) = delete;
+    UringFileSink & operator=(const UringFileSink &) = delete;
+
+    ~UringFileSink()
+    {
+        try
+        {
+            this->Close();
+        }
+        catch (std::exception &error)
+        {
+            // Do not propagate exception from the destructor.
+            std::cerr << error.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cerr << "Unknown error closing " << this->fileName_
+                << std::endl;
+        }
+
+        // Close() releases everything unless it failed.
+        this->Release_();
+    }
+
+    /**
+     ** @return true when full buffers bypass the page cache.
+     **/
+    bool GetIsDirect() const
+    {
+        return this->directFile_ >= 0;
+    }
+
+    void Write(const uint8_t *data, size_t size)
+    {
+        if (!this->isOpen_)
+        {
+            throw ClipError("UringFileSink is closed: " + this->fileName_);
+        }
+
+        while (size > 0)
+        {
+            Buffer &buffer = this->GetCurrent_();
+
+            size_t count = std::min(size, this->bufferSize_ - buffer.size);
+            std::memcpy(buffer.data + buffer.size, data, count);
+
+            buffer.size += count;
+            data += count;
+            size -= count;
+
+            this->position_ += static_cast<int64_t>(count);
+            this->size_ = std::max(this->size_, this->position_);
+
+            if (buffer.size == this->bufferSize_)
+            {
+                this->Submit_();
+            }
+        }
+    }
+
+    int64_t Seek(int64_t offset, int whence)
+    {
+        if (whence == AVSEEK_SIZE)
+        {
+            return this->size_;
+        }
+
+        int64_t position;
+
+        switch (whence & ~AVSEEK_FORCE)
+        {
+            case SEEK_SET:
+                position = offset;
+                break;
+
+            case SEEK_CUR:
+                position = this->position_ + offset;
+                break;
+
+            case SEEK_END:
+                position = this->size_ + offset;
+                break;
+
+            default:
+                return AVERROR(EINVAL);
+        }
+
+        if (position < 0)
+        {
+            return AVERROR(EINVAL);
+        }
+
+        if (position != this->position_)
+        {
+            // The next write may overlap one in flight.
+            this->Submit_();
+            this->WaitAll_();
+            this->position_ = position;
+        }
+
+        return position;
+    }
+
+    /**
+     ** Write the remaining bytes, wait for every write, and close the file.
+     **/
+    void Close()
+    {
+        if (!this->isOpen_)
+        {
+            return;
+        }
+
+        try
+        {
+            this->Submit_();
+            this->WaitAll_();
+        }
+        catch (...)
+        {
+            // The remaining writes are abandoned.
+            this->Release_();
+            throw;
+        }
+
+        this->Release_();
+    }
+
+private:
+    struct Buffer
+    {
+        uint8_t *data;
+        size_t size;
+        size_t written;
+
+        // Position in the file of data[0].
+        int64_t offset;
+
+        int file;
+        bool isInFlight;
+    };
+
+    struct Free
+    {
+        void operator()(uint8_t *data) const
+        {
+            std::free(data);
+        }
+    };
+
+    Buffer & GetCurrent_()
+    {
+        if (this->current_ >= 0)
+        {
+            return this->buffers_[static_cast<size_t>(this->current_)];
+        }
+
+        auto available = std::find_if(
+            this->buffers_.begin(),
+            this->buffers_.end(),
+            [](const Buffer &buffer)
+            {
+                return !buffer.isInFlight;
+            });
+
+        while (available == this->buffers_.end())
+        {
+            // Every buffer is being written.
+            Buffer *completed = this->WaitOne_();
+
+            if (completed && !completed->isInFlight)
+            {
+                available = this->buffers_.begin()
+                    + (completed - this->buffers_.data());
+            }
+        }
+
+        available->size = 0;
+        available->written = 0;
+        available->offset = this->position_;
+        this->current_ = available - this->buffers_.begin();
+
+        return *available;
+    }
+
+    void Submit_()
+    {
+        if (this->current_ < 0)
+        {
+            return;
+        }
+
+        Buffer &buffer = this->buffers_[static_cast<size_t>(this->current_)];
+        this->current_ = -1;
+
+        if (buffer.size == 0)
+        {
+            return;
+        }
+
+        bool isAligned =
+            (buffer.offset % static_cast<int64_t>(alignment) == 0)
+            && (buffer.size % alignment == 0);
+
+        buffer.file = (this->directFile_ >= 0 && isAligned)
+            ? this->directFile_
+            : this->bufferedFile_;
+
+        buffer.isInFlight = true;
+        ++this->inFlightCount_;
+
+        this->Prepare_(buffer);
+    }
+
+    void Prepare_(Buffer &buffer)
+    {
+        io_uring_sqe *entry = io_uring_get_sqe(&this->ring_);
+
+        while (!entry)
+        {
+            // The ring has one entry per buffer, so this is not expected.
+            this->WaitOne_();
+            entry = io_uring_get_sqe(&this->ring_);
+        }
+
+        io_uring_prep_write(
+            entry,
+            buffer.file,
+            buffer.data + buffer.written,
+            static_cast<unsigned>(buffer.size - buffer.written),
+            static_cast<uint64_t>(buffer.offset)
+                + static_cast<uint64_t>(buffer.written));
+
+        io_uring_sqe_set_data(entry, &buffer);
+
+        int result = io_uring_submit(&this->ring_);
+
+        if (result < 0)
+        {
+            throw ClipError(
+                "Unable to submit a write to " + this->fileName_ + ": "
+                + std::strerror(-result));
+        }
+    }
+
+    /**
+     ** Wait for one write to complete.
+     **
+     ** @return The buffer, which is still in flight if the write was short
+     ** and the rest has been submitted.
+     **/
+    Buffer * WaitOne_()
+    {
+        io_uring_cqe *completion = NULL;
+        int result = io_uring_wait_cqe(&this->ring_, &completion);
+
+        if (result < 0)
+        {
+            throw ClipError(
+                std::string("Failed waiting for io_uring: ")
+                + std::strerror(-result));
+        }
+
+        auto buffer = static_cast<Buffer *>(io_uring_cqe_get_data(completion));
+        int written = completion->res;
+        io_uring_cqe_seen(&this->ring_, completion);
+
+        if (written <= 0)
+        {
+            buffer->isInFlight = false;
+            --this->inFlightCount_;
+
+            throw ClipError(
+                "Failed to write " + this->fileName_ + ": "
+                + std::strerror((written < 0) ? -written : EIO));
+        }
+
+        buffer->written += static_cast<size_t>(written);
+
+        if (buffer->written < buffer->size)
+        {
+            // The remainder is not aligned for O_DIRECT.
+            buffer->file = this->bufferedFile_;
+            this->Prepare_(*buffer);
+
+            return buffer;
+        }
+
+        buffer->isInFlight = false;
+        --this->inFlightCount_;
+
+        return buffer;
+    }
+
+    void WaitAll_()
+    {
+        while (this->inFlightCount_ > 0)
+        {
+            this->WaitOne_();
+        }
+    }
+
+    void CloseFiles_()
+    {
+        if (this->directFile_ >= 0)
+        {
+            close(this->directFile_);
+            this->directFile_ = -1;
+        }
+
+        if (this->bufferedFile_ >= 0)
+        {
+            close(this->bufferedFile_);
+            this->bufferedFile_ = -1;
+        }
+    }
+
+    /**
+     ** Cancel the writes in flight, and wait until the kernel has finished
+     ** with every buffer.
+     **
+     ** Only called while failing, so errors are not reported.
+     **/
+    void Abandon_() noexcept
+    {
+        this->current_ = -1;
+
+        if (this->inFlightCount_ == 0)
+        {
+            return;
+        }
+
+        for (auto &buffer: this->buffers_)
+        {
+            if (!buffer.isInFlight)
+            {
+                continue;
+            }
+
+            io_uring_sqe *entry = io_uring_get_sqe(&this->ring_);
+
+            if (!entry)
+            {
+                // The write completes without being canceled.
+                break;
+            }
+
+            io_uring_prep_cancel(entry, &buffer, 0);
+
+            // The cancellation's own completion has no buffer.
+            io_uring_sqe_set_data(entry, NULL);
+        }
+
+        io_uring_submit(&this->ring_);
+
+        while (this->inFlightCount_ > 0)
+        {
+            io_uring_cqe *completion = NULL;
+            int result = io_uring_wait_cqe(&this->ring_, &completion);
+
+            if (result == -EINTR)
+            {
+                continue;
+            }
+
+            if (result < 0)
+            {
+                // The kernel may still read the buffers, so they must
+                // outlive the ring.
+                for (auto &data: this->storage_)
+                {
+                    (void)data.release();
+                }
+
+                this->inFlightCount_ = 0;
+
+                return;
+            }
+
+            auto buffer =
+                static_cast<Buffer *>(io_uring_cqe_get_data(completion));
+
+            io_uring_cqe_seen(&this->ring_, completion);
+
+            if (buffer && buffer->isInFlight)
+            {
+                buffer->isInFlight = false;
+                --this->inFlightCount_;
+            }
+        }
+    }
+
+    void Release_()
+    {
+        if (this->isOpen_)
+        {
+            // Writes left in flight by an error must not outlive the ring or
+            // the buffers.
+            this->Abandon_();
+            io_uring_queue_exit(&this->ring_);
+            this->isOpen_ = false;
+        }
+
+        this->CloseFiles_();
+    }
+
+    std::string fileName_;
+    size_t bufferSize_;
+    int bufferedFile_;
+    int directFile_;
+    io_uring ring_;
+    bool isOpen_;
+    std::vector<std::unique_ptr<uint8_t, Free>> storage_;
+    std::vector<Buffer> buffers_;
+
+    // Index of the buffer being filled, or -1.
+    ptrdiff_t current_;
+
+    size_t inFlightCount_;
+
+    // The file position of the next write.
+    int64_t position_;
+    int64_t size_;
+};
+
+
+} // end namespace clip
+
+
+#endif // CLIP_HAS_IO_URING
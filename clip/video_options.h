@@ -56,6 +56,41 @@ const char * presetStrings[] = {
     "placebo"};
 
 
+// Coefficients used to convert RGB to YUV.
+enum class ColorMatrix: uint8_t
+{
+    bt601 = 0,
+    bt709
+};
+
+
+// How the encoder divides its work among threads.
+enum class ThreadType: uint8_t
+{
+    // Let the codec choose.
+    automatic = 0,
+
+    // Encode several frames at once. Adds a frame of latency per thread.
+    frame,
+
+    // Split each frame into slices. No added latency.
+    slice,
+
+    frameAndSlice
+};
+
+
+// What VideoOutput does when its encoder queue is full.
+enum class Backpressure: uint8_t
+{
+    // Wait for the encoder thread to take a frame.
+    block = 0,
+
+    // Discard the oldest frame that has not been encoded yet.
+    dropOldest
+};
+
+
 struct VideoOptions
 {
     int height;
@@ -71,6 +106,25 @@ struct VideoOptions
     AVCodecID codecId;
     Preset preset;
 
+    // When non-zero, frames are encoded on a dedicated thread, and up to
+    // encoderQueueDepth filled frames wait for it.
+    size_t encoderQueueDepth;
+    Backpressure backpressure;
+
+    // Conversion to outPixelFormat is split across this many threads.
+    int reformatThreadCount;
+
+    // Threads used by the encoder. VideoOutput gives the encoder a share of
+    // the ThreadBudget when threadCount is zero.
+    int threadCount;
+    ThreadType threadType;
+
+    ColorMatrix colorMatrix;
+
+    // Convert RGB24 to yuv420p and yuv444p with clip's own SIMD kernels
+    // instead of swscale.
+    bool useNativeConverter;
+
     static VideoOptions MakeDefault(const Resolution &resolution)
     {
         VideoOptions result
@@ -86,7 +140,14 @@ struct VideoOptions
             .profile = FF_PROFILE_H264_HIGH,
             .level = 51,
             .codecId = AV_CODEC_ID_H264,
-            .preset = Preset::medium
+            .preset = Preset::medium,
+            .encoderQueueDepth = 0,
+            .backpressure = Backpressure::block,
+            .reformatThreadCount = 1,
+            .threadCount = 0,
+            .threadType = ThreadType::automatic,
+            .colorMatrix = ColorMatrix::bt601,
+            .useNativeConverter = true
         };
 
         return result;
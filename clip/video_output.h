@@ -12,7 +12,28 @@
 #pragma once
 
 
+#include "clip/ffmpeg_shim.h"
+FFMPEG_SHIM_PUSH_IGNORES
+extern "C"
+{
+
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+}
+FFMPEG_SHIM_POP_IGNORES
+
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "tau/eigen.h"
+#include "clip/spsc_queue.h"
 #include "clip/reformat.h"
+#include "clip/rgb_to_yuv.h"
 #include "clip/output.h"
 #include "clip/dictionary.h"
 #include "clip/video_options.h"
@@ -25,6 +46,399 @@ namespace clip
 static const int scaleFlag = SWS_BICUBIC;
 
 
+// Row-major bytes of a packed video frame.
+using VideoFrame =
+    Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+// Maps a VideoFrame onto memory with padding at the end of each row.
+using VideoFrameMap = Eigen::Map<VideoFrame, 0, Eigen::OuterStride<>>;
+
+
+/**
+ ** Add the videoOptions that are passed to avcodec_open2 to codecOptions.
+ **/
+inline void AddVideoCodecOptions(
+    Dictionary &codecOptions,
+    const VideoOptions &videoOptions)
+{
+    codecOptions.Set(
+        "preset",
+        presetStrings[static_cast<size_t>(videoOptions.preset)]);
+
+    if (videoOptions.qualityFactor >= 0)
+    {
+        codecOptions.Set(
+            "crf",
+            std::to_string(videoOptions.qualityFactor).c_str());
+    }
+}
+
+
+/**
+ ** Apply the videoOptions that are fields of the codec context to an
+ ** encoder that has not been opened yet.
+ **/
+inline void ConfigureVideoCodecContext(
+    AVCodecContext *codecContext,
+    const VideoOptions &videoOptions)
+{
+    codecContext->profile = videoOptions.profile;
+
+    if (videoOptions.bitRate > 0)
+    {
+        codecContext->bit_rate = videoOptions.bitRate;
+    }
+
+    // Resolution must be a multiple of two.
+    assert(videoOptions.height % 2 == 0);
+    assert(videoOptions.width % 2 == 0);
+
+    codecContext->height = videoOptions.height;
+    codecContext->width = videoOptions.width;
+    codecContext->time_base = AVRational{1, videoOptions.framesPerSecond};
+    codecContext->gop_size = videoOptions.gopSize;
+    codecContext->pix_fmt = videoOptions.outPixelFormat;
+
+    if (videoOptions.threadCount > 0)
+    {
+        codecContext->thread_count = videoOptions.threadCount;
+    }
+
+    switch (videoOptions.threadType)
+    {
+        case ThreadType::frame:
+            codecContext->thread_type = FF_THREAD_FRAME;
+            break;
+
+        case ThreadType::slice:
+            codecContext->thread_type = FF_THREAD_SLICE;
+            break;
+
+        case ThreadType::frameAndSlice:
+            codecContext->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            break;
+
+        case ThreadType::automatic:
+        default:
+            break;
+    }
+
+    if (videoOptions.colorMatrix == ColorMatrix::bt709)
+    {
+        codecContext->colorspace = AVCOL_SPC_BT709;
+    }
+
+    // codecContext->level = videoOptions.level;
+    // codecContext->codec_id = videoOptions.codecId;
+}
+
+
+/**
+ ** Apply videoOptions to an encoder that has not been opened yet.
+ **
+ ** Options that are passed to avcodec_open2 are added to codecOptions.
+ **/
+inline void ConfigureVideoEncoder(
+    AVCodecContext *codecContext,
+    Dictionary &codecOptions,
+    const VideoOptions &videoOptions)
+{
+    AddVideoCodecOptions(codecOptions, videoOptions);
+    ConfigureVideoCodecContext(codecContext, videoOptions);
+}
+
+
+inline void OpenVideoEncoder(
+    AVCodecContext *codecContext,
+    const AVCodec *codec,
+    Dictionary &codecOptions)
+{
+    int result = avcodec_open2(codecContext, codec, codecOptions.Get());
+
+    if (result < 0)
+    {
+        throw VideoError(
+            DescribeError("Could not open video codec", result));
+    }
+}
+
+
+namespace detail
+{
+
+
+/**
+ ** Converts frames from videoOptions.inPixelFormat to outPixelFormat, with
+ ** the native converter when it supports the formats, or with swscale.
+ **/
+class FrameConverter
+{
+public:
+    FrameConverter()
+        :
+        rgbToYuv_(),
+        reformat_()
+    {
+
+    }
+
+    FrameConverter(const VideoOptions &videoOptions)
+        :
+        rgbToYuv_(),
+        reformat_()
+    {
+        if (
+            videoOptions.useNativeConverter
+            && RgbToYuv::IsSupported(
+                videoOptions.inPixelFormat,
+                videoOptions.outPixelFormat))
+        {
+            this->rgbToYuv_ = RgbToYuv(
+                videoOptions.outPixelFormat,
+                videoOptions.colorMatrix);
+
+            return;
+        }
+
+        Resolution resolution{videoOptions.width, videoOptions.height};
+
+        this->reformat_ = Reformat(
+            resolution,
+            videoOptions.inPixelFormat,
+            resolution,
+            videoOptions.outPixelFormat,
+            scaleFlag,
+            videoOptions.reformatThreadCount);
+
+        if (videoOptions.colorMatrix == ColorMatrix::bt709)
+        {
+            this->reformat_.SetColorspace(SWS_CS_ITU709);
+        }
+    }
+
+    void operator()(const AVFrame *source, AVFrame *target)
+    {
+        if (this->rgbToYuv_)
+        {
+            this->rgbToYuv_(source, target);
+        }
+        else
+        {
+            this->reformat_(source, target);
+        }
+    }
+
+private:
+    RgbToYuv rgbToYuv_;
+    Reformat reformat_;
+};
+
+
+/**
+ ** A preallocated ring of input frames, and the thread that encodes them.
+ **
+ ** Frames circulate between the producer and the encoder thread through two
+ ** lock-free queues: filled frames wait in `pending`, and encoded frames are
+ ** returned through `available`.
+ **/
+class EncoderQueue
+{
+public:
+    using Encode = std::function<void(Frame &)>;
+
+    EncoderQueue(const VideoOptions &options)
+        :
+        backpressure_(options.backpressure),
+        pool_(),
+        pending_(options.encoderQueueDepth),
+        available_(options.encoderQueueDepth + 2),
+        filling_(NULL),
+        spare_(NULL),
+        thread_(),
+        hasError_(false),
+        error_(),
+        droppedCount_(0)
+    {
+        // One frame is filled while another is encoded.
+        size_t frameCount = options.encoderQueueDepth + 2;
+
+        // Frames must not move after their addresses are queued.
+        this->pool_.reserve(frameCount);
+
+        for (size_t i = 0; i < frameCount; ++i)
+        {
+            this->pool_.emplace_back(
+                options.inPixelFormat,
+                options.height,
+                options.width);
+
+            this->available_.TryPush(&this->pool_.back());
+        }
+    }
+
+    ~EncoderQueue()
+    {
+        this->Stop();
+    }
+
+    EncoderQueue(const EncoderQueue &) = delete;
+    EncoderQueue & operator=(const EncoderQueue &) = delete;
+
+    /**
+     ** @return The frame to fill next.
+     **/
+    Frame & Acquire()
+    {
+        this->ThrowIfFailed();
+
+        if (!this->filling_)
+        {
+            if (this->spare_)
+            {
+                this->filling_ = this->spare_;
+                this->spare_ = NULL;
+            }
+            else
+            {
+                this->filling_ = this->available_.Pop();
+            }
+
+            // The encoder may still hold a reference to this frame.
+            this->filling_->MakeWritable();
+        }
+
+        return *this->filling_;
+    }
+
+    /**
+     ** Queue the acquired frame for the encoder thread.
+     **/
+    void Submit(int64_t pts, const Encode &encode)
+    {
+        assert(this->filling_);
+
+        this->ThrowIfFailed();
+
+        (*this->filling_)->pts = pts;
+
+        if (!this->thread_.joinable())
+        {
+            this->thread_ = std::thread(&EncoderQueue::Run_, this, encode);
+        }
+
+        while (!this->pending_.TryPush(this->filling_))
+        {
+            this->ThrowIfFailed();
+
+            if (this->backpressure_ == Backpressure::block)
+            {
+                this->pending_.WaitForSpace();
+
+                continue;
+            }
+
+            // Discard the oldest frame and keep it to fill again.
+            auto oldest = this->pending_.TryPop();
+
+            if (oldest)
+            {
+                assert(!this->spare_);
+                this->spare_ = *oldest;
+                ++this->droppedCount_;
+            }
+        }
+
+        this->filling_ = NULL;
+    }
+
+    /**
+     ** Wait for every queued frame to be encoded, and join the thread.
+     **/
+    void Stop()
+    {
+        if (!this->thread_.joinable())
+        {
+            return;
+        }
+
+        // A NULL frame tells the encoder thread to exit.
+        this->pending_.Push(NULL);
+        this->thread_.join();
+    }
+
+    void ThrowIfFailed() const
+    {
+        if (this->hasError_.load(std::memory_order_acquire))
+        {
+            std::rethrow_exception(this->error_);
+        }
+    }
+
+    size_t GetStride() const
+    {
+        return static_cast<size_t>(this->pool_.front()->linesize[0]);
+    }
+
+    size_t GetDepth() const
+    {
+        return this->pending_.GetSize();
+    }
+
+    size_t GetDroppedCount() const
+    {
+        return this->droppedCount_;
+    }
+
+private:
+    void Run_(Encode encode)
+    {
+        while (true)
+        {
+            Frame *frame = this->pending_.Pop();
+
+            if (!frame)
+            {
+                return;
+            }
+
+            if (!this->hasError_.load(std::memory_order_relaxed))
+            {
+                try
+                {
+                    encode(*frame);
+                }
+                catch (...)
+                {
+                    // Keep draining the queue so the producer cannot block
+                    // forever. The error is reported on the producer's next
+                    // call.
+                    this->error_ = std::current_exception();
+                    this->hasError_.store(true, std::memory_order_release);
+                }
+            }
+
+            // There is always room to return a frame to the pool.
+            this->available_.TryPush(frame);
+        }
+    }
+
+private:
+    Backpressure backpressure_;
+    std::vector<Frame> pool_;
+    SpscQueue<Frame *> pending_;
+    SpscQueue<Frame *> available_;
+    Frame *filling_;
+    Frame *spare_;
+    std::thread thread_;
+    std::atomic<bool> hasError_;
+    std::exception_ptr error_;
+    size_t droppedCount_;
+};
+
+
+} // end namespace detail
+
+
 class VideoOutput : public Output
 {
 public:
@@ -36,46 +450,25 @@ public:
         Output(outputContext, (*outputContext)->oformat->video_codec),
         options_(videoOptions)
     {
-        codecOptions.Set(
-            "preset",
-            presetStrings[static_cast<size_t>(videoOptions.preset)]);
-
-        if (videoOptions.qualityFactor >= 0)
-        {
-            codecOptions.Set(
-                "crf",
-                std::to_string(videoOptions.qualityFactor).c_str());
-        }
+        ConfigureVideoEncoder(
+            this->codecContext_,
+            codecOptions,
+            videoOptions);
 
-        this->codecContext_->profile = videoOptions.profile;
-
-        if (videoOptions.bitRate > 0)
+        if (videoOptions.threadCount <= 0)
         {
-            this->codecContext_->bit_rate = videoOptions.bitRate;
+            this->codecContext_->thread_count =
+                static_cast<int>(this->threadLease_.GetShare());
         }
 
-        // Resolution must be a multiple of two.
-        assert(videoOptions.height % 2 == 0);
-        assert(videoOptions.width % 2 == 0);
-
-        this->codecContext_->height = videoOptions.height;
-        this->codecContext_->width = videoOptions.width;
-
         /* timebase: This is the fundamental unit of time (in seconds) in
          * terms of which frame timestamps are represented. For fixed-fps
          * content, timebase should be 1/framerate and timestamp increments
          * should be identical to 1. */
-        this->stream_->time_base = AVRational{1, videoOptions.framesPerSecond};
-        this->codecContext_->time_base = this->stream_->time_base;
+        this->stream_->time_base = this->codecContext_->time_base;
 
         this->timeStamp_ = clip::TimeStamp(0, this->codecContext_->time_base);
 
-        this->codecContext_->gop_size = videoOptions.gopSize;
-
-        this->codecContext_->pix_fmt = videoOptions.outPixelFormat;
-        // this->codecContext_->level = videoOptions.level;
-        // this->codecContext_->codec_id = videoOptions.codecId;
-
         this->frame_ = Frame(
             videoOptions.outPixelFormat,
             videoOptions.height,
@@ -84,11 +477,8 @@ public:
         if (videoOptions.outPixelFormat != videoOptions.inPixelFormat)
         {
             // The input and output formats do not match.
-            // A Reformat instance and a temporary frame is needed.
-            this->reformat = Reformat(
-                this->codecContext_,
-                videoOptions.inPixelFormat,
-                scaleFlag);
+            // A converter and a temporary frame is needed.
+            this->converter_ = detail::FrameConverter(videoOptions);
 
             this->intermediate_ = Frame(
                 videoOptions.inPixelFormat,
@@ -96,23 +486,20 @@ public:
                 videoOptions.width);
         }
 
-        AVCodecContext *codecContext = this->codecContext_;
-
-        int result = avcodec_open2(
-            codecContext,
-            this->codec_,
-            codecOptions.Get());
-
-        if (result < 0)
+        if (videoOptions.encoderQueueDepth > 0)
         {
-            throw VideoError(
-                DescribeError("Could not open video codec", result));
+            // Frames are filled in the ring, and the conversion to the
+            // output format happens on the encoder thread.
+            this->encoderQueue_ =
+                std::make_unique<detail::EncoderQueue>(videoOptions);
         }
 
+        OpenVideoEncoder(this->codecContext_, this->codec_, codecOptions);
+
         /* copy the stream parameters to the muxer */
-        result = avcodec_parameters_from_context(
+        int result = avcodec_parameters_from_context(
             this->stream_->codecpar,
-            codecContext);
+            this->codecContext_);
 
         if (result < 0)
         {
@@ -125,8 +512,18 @@ public:
         return {this->options_.width, this->options_.height};
     }
 
+    const VideoOptions & GetOptions() const
+    {
+        return this->options_;
+    }
+
     AVFrame * GetNextFrame()
     {
+        if (this->encoderQueue_)
+        {
+            return this->encoderQueue_->Acquire();
+        }
+
         // The encoder may still be using the last frame passed to it.
         // Create a new frame if necessary.
         this->frame_.MakeWritable();
@@ -145,6 +542,11 @@ public:
 
     size_t GetStride() const
     {
+        if (this->encoderQueue_)
+        {
+            return this->encoderQueue_->GetStride();
+        }
+
         if (this->options_.inPixelFormat != this->options_.outPixelFormat)
         {
             // The frame must be transcoded to the output format.
@@ -162,10 +564,158 @@ public:
      */
     void WriteFrame()
     {
+        if (this->encoderQueue_)
+        {
+            this->encoderQueue_->Submit(
+                this->timeStamp_.Count(),
+                [this](Frame &frame)
+                {
+                    this->EncodeFrame_(frame);
+                });
+
+            ++this->timeStamp_;
+            this->UpdateQueueStatistics_();
+
+            return;
+        }
+
         this->FinishFrame_();
         this->WriteFrame_(this->frame_);
     }
 
+    /**
+     ** Encode a frame that is already in outPixelFormat at the output
+     ** resolution.
+     **
+     ** The encoder takes its own reference to the frame's buffers, so nothing
+     ** is copied. The frame's pts is replaced with the next time stamp.
+     **/
+    void WriteFrame(AVFrame *frame)
+    {
+        this->WriteFrame(frame, this->timeStamp_.Count());
+    }
+
+    /**
+     ** Encode a frame at pts, in the time base of GetTimeStamp(), instead of
+     ** at the next time stamp. Later frames follow pts.
+     **
+     ** pts may skip time stamps, but must not precede GetTimeStamp().
+     **/
+    void WriteFrame(AVFrame *frame, int64_t pts)
+    {
+        if (this->encoderQueue_)
+        {
+            throw std::logic_error(
+                "External frames cannot be written with an encoder queue.");
+        }
+
+        if (
+            frame->format != this->options_.outPixelFormat
+            || frame->width != this->options_.width
+            || frame->height != this->options_.height)
+        {
+            throw VideoError("Frame does not match the output format.");
+        }
+
+        if (pts < this->timeStamp_.Count())
+        {
+            throw TimeStampError("Frame timestamps must increase.");
+        }
+
+        frame->pts = pts;
+        this->timeStamp_ = pts;
+        ++this->timeStamp_;
+        this->WriteFrame_(frame);
+    }
+
+    /**
+     ** Drain the encoder queue, if any, and then the encoder.
+     **/
+    void Flush()
+    {
+        if (this->encoderQueue_)
+        {
+            this->encoderQueue_->Stop();
+            this->encoderQueue_->ThrowIfFailed();
+        }
+
+        Output::Flush();
+    }
+
+    /**
+     ** @return The count of frames waiting for the encoder thread.
+     **/
+    size_t GetQueueDepth() const
+    {
+        if (!this->encoderQueue_)
+        {
+            return 0;
+        }
+
+        return this->encoderQueue_->GetDepth();
+    }
+
+    /**
+     ** @return The count of frames discarded with Backpressure::dropOldest.
+     **/
+    size_t GetDroppedFrameCount() const
+    {
+        if (!this->encoderQueue_)
+        {
+            return 0;
+        }
+
+        return this->encoderQueue_->GetDroppedCount();
+    }
+
+    /**
+     ** Borrow the buffer that will be handed to the encoder.
+     **
+     ** The returned map covers the visible bytes of each row in the input
+     ** pixel format, and skips the padding that the encoder expects between
+     ** rows. Fill it in place, then call Commit().
+     **
+     ** Only packed input formats, like AV_PIX_FMT_RGB24, are supported. A
+     ** planar format would need a map for each plane.
+     **
+     ** The map is only valid until Commit() is called.
+     **/
+    VideoFrameMap AcquireFrame()
+    {
+        if (av_pix_fmt_count_planes(this->options_.inPixelFormat) != 1)
+        {
+            throw VideoError(
+                "AcquireFrame requires a packed input pixel format.");
+        }
+
+        AVFrame *avFrame = this->GetNextFrame();
+
+        int dataWidth = av_image_get_linesize(
+            this->options_.inPixelFormat,
+            this->options_.width,
+            0);
+
+        if (dataWidth < 0)
+        {
+            throw VideoError(
+                DescribeError("Unable to compute frame data width", dataWidth));
+        }
+
+        return VideoFrameMap(
+            avFrame->data[0],
+            this->options_.height,
+            dataWidth,
+            Eigen::OuterStride<>(avFrame->linesize[0]));
+    }
+
+    /**
+     ** Send the frame filled through AcquireFrame() to the encoder.
+     **/
+    void Commit()
+    {
+        this->WriteFrame();
+    }
+
     TimeStamp GetTimeStamp() const
     {
         return this->timeStamp_;
@@ -180,19 +730,62 @@ private:
         if (this->options_.inPixelFormat != this->options_.outPixelFormat)
         {
             // The frame must be transcoded to the output format.
-            this->reformat(this->intermediate_, this->frame_);
+            this->Convert_(this->intermediate_);
+        }
+    }
+
+    void Convert_(const Frame &source)
+    {
+        this->statistics_->Time(
+            OutputStatistics::Stage::reformat,
+            [&]()
+            {
+                this->converter_(source, this->frame_);
+            });
+    }
+
+    void UpdateQueueStatistics_()
+    {
+        this->statistics_->SetQueueDepth(this->encoderQueue_->GetDepth());
+
+        this->statistics_->SetDroppedFrameCount(
+            this->encoderQueue_->GetDroppedCount());
+    }
+
+    // Runs on the encoder thread.
+    void EncodeFrame_(Frame &input)
+    {
+        this->statistics_->SetQueueDepth(this->encoderQueue_->GetDepth());
+
+        if (this->options_.inPixelFormat == this->options_.outPixelFormat)
+        {
+            this->WriteFrame_(input);
+
+            return;
         }
+
+        // The encoder may still be using the last converted frame.
+        this->frame_.MakeWritable();
+        this->Convert_(input);
+        this->frame_->pts = input->pts;
+        this->WriteFrame_(this->frame_);
     }
 
 
 private:
     VideoOptions options_;
-    Reformat reformat;
+    detail::FrameConverter converter_;
     Frame frame_;
     Frame intermediate_;
 
     // Presentation time stamp of the next frame that will be generated.
     clip::TimeStamp timeStamp_;
+
+    // Only present when frames are encoded on a dedicated thread.
+    // The encoder thread uses the members above, so it must be stopped first.
+    // An asynchronous VideoOutput must not be moved between its first frame
+    // and Flush().
+    std::unique_ptr<detail::EncoderQueue> encoderQueue_;
 };
 
 
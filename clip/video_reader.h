@@ -0,0 +1,313 @@
+/**
+  * @file video_reader.h
+  *
+  * @brief Decodes a video stream into row-major Eigen matrices.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "tau/eigen.h"
+#include "clip/decoder.h"
+#include "clip/frame.h"
+#include "clip/input_context.h"
+#include "clip/keyframe_index.h"
+#include "clip/pixel_format.h"
+#include "clip/reformat.h"
+#include "clip/resolution.h"
+
+
+namespace clip
+{
+
+
+/**
+ ** Reads the best video stream of a file, converted to pixelFormat.
+ **
+ ** Each row of Matrix holds one row of pixels, with PixelTraits::colorCount
+ ** values per pixel. With a single channel format, like AV_PIX_FMT_GRAY8 or
+ ** AV_PIX_FMT_GRAY16, a VideoReader is a Reader for WriteColorMapped.
+ **
+ ** The decoder uses frame threading, so several frames are decoded at once.
+ ** Decoded frames are kept in a pool and reused.
+ **/
+template<AVPixelFormat pixelFormat = AV_PIX_FMT_RGB24>
+class VideoReader
+{
+public:
+    using Traits = PixelTraits<pixelFormat>;
+    using Color = typename Traits::Color;
+
+    using Matrix = Eigen::Matrix
+        <
+            Color,
+            Eigen::Dynamic,
+            Eigen::Dynamic,
+            Eigen::RowMajor
+        >;
+
+    // Any row-major buffer of the right size, with or without row padding.
+    using FrameMap = Eigen::Map<Matrix, 0, Eigen::OuterStride<>>;
+
+    VideoReader(
+        const std::string &fileName,
+        const DecoderOptions &decoderOptions = DecoderOptions::MakeDefault())
+        :
+        inputContext_(fileName),
+        streamIndex_(FindVideoStream_(this->inputContext_)),
+        decoder_(
+            this->inputContext_.GetStream(this->streamIndex_),
+            decoderOptions),
+        packet_(),
+        pool_(),
+        decoded_(),
+        target_(Frame::MakeEmpty()),
+        reformat_(),
+        sourceFormat_(AV_PIX_FMT_NONE),
+        isFlushing_(false)
+    {
+        // The demuxer skips the packets of every other stream.
+        this->inputContext_.SelectStreams({this->streamIndex_});
+        this->packet_ = this->inputContext_.GetPackets().begin();
+    }
+
+    size_t GetHeight_pixels() const
+    {
+        return static_cast<size_t>(this->decoder_->height);
+    }
+
+    size_t GetWidth_pixels() const
+    {
+        return static_cast<size_t>(this->decoder_->width);
+    }
+
+    Resolution GetResolution() const
+    {
+        return {this->decoder_->width, this->decoder_->height};
+    }
+
+    const AVStream * GetStream() const
+    {
+        return this->inputContext_.GetStream(this->streamIndex_);
+    }
+
+    bool HasFrame()
+    {
+        while (this->decoded_.empty() && !this->decoder_.GetIsDrained())
+        {
+            this->Decode_();
+        }
+
+        return !this->decoded_.empty();
+    }
+
+    /**
+     ** Convert the next frame into target, which must have
+     ** GetHeight_pixels() rows and GetWidth_pixels() * colorCount columns.
+     **
+     ** @return The presentation time stamp of the frame, in the time base of
+     ** GetStream().
+     **/
+    int64_t ReadFrame(FrameMap target)
+    {
+        if (!this->HasFrame())
+        {
+            throw DecoderError("No frames remain.");
+        }
+
+        if (
+            static_cast<size_t>(target.rows()) != this->GetHeight_pixels()
+            || static_cast<size_t>(target.cols())
+                != this->GetWidth_pixels() * Traits::colorCount)
+        {
+            throw DecoderError("Target does not match the frame size.");
+        }
+
+        const Frame &frame = this->decoded_.front();
+        int64_t pts = frame->best_effort_timestamp;
+
+        this->Convert_(frame, target);
+
+        // Return the decoder's buffer, and keep the AVFrame for reuse.
+        this->Recycle_();
+
+        return pts;
+    }
+
+    /**
+     ** Make frameIndex, counted in presentation order, the next frame read.
+     **
+     ** The demuxer jumps to the preceding keyframe, and at most one group of
+     ** pictures is decoded to reach the frame.
+     **/
+    void SeekToFrame(const KeyframeIndex &index, size_t frameIndex)
+    {
+        if (index.GetStreamIndex() != this->streamIndex_)
+        {
+            throw DecoderError("The index describes a different stream.");
+        }
+
+        int64_t target = index[frameIndex].pts;
+        const IndexEntry &keyframe = index[index.FindKeyframe(frameIndex)];
+
+        // Release the demuxer's packet before seeking.
+        this->packet_ = InputContext::PacketIterator();
+        this->inputContext_.Seek(this->streamIndex_, keyframe.pts);
+        this->packet_ = this->inputContext_.GetPackets().begin();
+
+        this->decoder_.Reset();
+        this->isFlushing_ = false;
+
+        while (!this->decoded_.empty())
+        {
+            this->Recycle_();
+        }
+
+        // Discard the frames that lead up to the target.
+        while (this->HasFrame())
+        {
+            if (this->decoded_.front()->best_effort_timestamp >= target)
+            {
+                return;
+            }
+
+            this->Recycle_();
+        }
+    }
+
+    Matrix GetNextFrameData()
+    {
+        Matrix result(
+            this->GetHeight_pixels(),
+            this->GetWidth_pixels() * Traits::colorCount);
+
+        this->ReadFrame(
+            FrameMap(
+                result.data(),
+                result.rows(),
+                result.cols(),
+                Eigen::OuterStride<>(result.cols())));
+
+        return result;
+    }
+
+private:
+    static int FindVideoStream_(const InputContext &inputContext)
+    {
+        auto streamIndex = inputContext.FindBestStream(AVMEDIA_TYPE_VIDEO);
+
+        if (!streamIndex)
+        {
+            throw DecoderError("Unable to find a video stream.");
+        }
+
+        return *streamIndex;
+    }
+
+    void Decode_()
+    {
+        if (!this->isFlushing_)
+        {
+            if (this->packet_ == InputContext::PacketIterator())
+            {
+                // The input is exhausted.
+                this->decoder_.Send(NULL);
+                this->isFlushing_ = true;
+            }
+            else
+            {
+                this->decoder_.Send(*this->packet_);
+                ++this->packet_;
+            }
+        }
+
+        while (true)
+        {
+            Frame frame = this->AcquireFrame_();
+
+            if (!this->decoder_.Receive(frame))
+            {
+                this->pool_.push_back(std::move(frame));
+
+                return;
+            }
+
+            this->decoded_.push_back(std::move(frame));
+        }
+    }
+
+    void Recycle_()
+    {
+        Frame frame = std::move(this->decoded_.front());
+        this->decoded_.pop_front();
+
+        av_frame_unref(frame);
+        this->pool_.push_back(std::move(frame));
+    }
+
+    Frame AcquireFrame_()
+    {
+        if (this->pool_.empty())
+        {
+            return Frame::MakeEmpty();
+        }
+
+        Frame frame = std::move(this->pool_.back());
+        this->pool_.pop_back();
+
+        return frame;
+    }
+
+    void Convert_(const Frame &frame, FrameMap target)
+    {
+        auto sourceFormat = static_cast<AVPixelFormat>(frame->format);
+
+        if (!this->reformat_ || sourceFormat != this->sourceFormat_)
+        {
+            Resolution resolution = this->GetResolution();
+
+            this->reformat_ = Reformat(
+                resolution,
+                sourceFormat,
+                resolution,
+                pixelFormat,
+                SWS_BICUBIC);
+
+            this->sourceFormat_ = sourceFormat;
+        }
+
+        // Point the target frame at the caller's buffer.
+        this->target_->data[0] = reinterpret_cast<uint8_t *>(target.data());
+
+        this->target_->linesize[0] =
+            static_cast<int>(target.outerStride() * sizeof(Color));
+
+        this->reformat_(frame, this->target_);
+    }
+
+    InputContext inputContext_;
+    int streamIndex_;
+    Decoder decoder_;
+    InputContext::PacketIterator packet_;
+
+    // Decoded frames are returned to the pool once they are converted.
+    std::vector<Frame> pool_;
+    std::deque<Frame> decoded_;
+
+    Frame target_;
+    Reformat reformat_;
+    AVPixelFormat sourceFormat_;
+    bool isFlushing_;
+};
+
+
+} // end namespace clip
@@ -14,6 +14,8 @@
 
 #include "clip/error.h"
 #include "clip/video_output.h"
+#include "clip/color_lookup.h"
+#include "clip/yuv_lookup.h"
 #include "tau/color_map.h"
 
 
@@ -84,64 +86,75 @@ private:
 };
 
 
+/**
+ ** How StrideVideoWriter moves the data into the encoder's frame.
+ **
+ ** buffered is the original behavior, and remains the default until
+ ** clip_bench's stride_video_writer_direct and stride_video_writer_buffered
+ ** show that direct is faster.
+ **/
+enum class StrideMode: uint8_t
+{
+    // Assign the data through a map of the encoder's frame.
+    direct,
+
+    // Assign the data to a padded buffer, then copy the whole buffer to the
+    // encoder's frame.
+    buffered
+};
+
+
 struct StrideVideoWriter
 {
 public:
-    using VideoFrame =
-        Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
-
-    using StrideMap = Eigen::Map<VideoFrame, 0, Eigen::OuterStride<>>;
+    using VideoFrame = clip::VideoFrame;
+    using StrideMap = VideoFrameMap;
 
     StrideVideoWriter(
             size_t height_pixels,
             size_t dataWidth,
-            VideoOutput &output)
+            VideoOutput &output,
+            StrideMode mode = StrideMode::buffered)
         :
         output_(output),
+        mode_(mode),
         height_(static_cast<Eigen::Index>(height_pixels)),
         dataWidth_(static_cast<Eigen::Index>(dataWidth)),
         stride_(static_cast<Eigen::Index>(output.GetStride())),
         fieldSize_(GetFieldSize(height_pixels, output)),
-
-        // Create a frame with the stride expected by the encoder.
-        withStride_(this->height_, this->stride_),
-
-        // Create a map with the expected stride.
-        // This allows assignment to withStride through strideMap.
-        // height x dataWidth data will be copied to withStride, and stride
-        // count bytes will be left between each row of data.
-        strideMap_(
-            this->withStride_.data(),
-            this->height_,
-            this->dataWidth_,
-            Eigen::OuterStride<>(this->stride_))
+        withStride_()
     {
         if (this->stride_ < this->dataWidth_)
         {
             throw VideoError("stride must be larger than dataWidth");
         }
 
+        if (mode == StrideMode::buffered)
+        {
+            this->withStride_.resize(this->height_, this->stride_);
+        }
     }
 
     template<typename Derived>
     void operator()(const Eigen::DenseBase<Derived> &data)
     {
-        // strideMap maps onto withStride.
-        // Assigning to it moves the values into place to match the encoder.
-        this->strideMap_ =
-            Eigen::Reshaped<
-                const Derived,
-                Eigen::Dynamic,
-                Eigen::Dynamic,
-                Eigen::RowMajor>(
-                    data.derived(),
-                    this->height_,
-                    this->dataWidth_);
+        if (this->mode_ == StrideMode::buffered)
+        {
+            this->WriteBuffered_(data);
+            return;
+        }
 
-        // Copy bytes to avFrame
-        AVFrame *avFrame = this->output_.GetNextFrame();
-        memcpy(avFrame->data[0], this->withStride_.data(), this->fieldSize_);
-        this->output_.WriteFrame();
+        // The map views the encoder's frame with its stride.
+        // Assigning to it moves the values directly into place, leaving the
+        // padding at the end of each row untouched.
+        StrideMap strideMap = this->output_.AcquireFrame();
+
+        assert(strideMap.rows() == this->height_);
+        assert(strideMap.cols() >= this->dataWidth_);
+
+        strideMap.leftCols(this->dataWidth_) = this->Reshape_(data);
+
+        this->output_.Commit();
     }
 
     TimeStamp GetTimeStamp() const
@@ -155,13 +168,39 @@ public:
     }
 
 private:
+    template<typename Derived>
+    auto Reshape_(const Eigen::DenseBase<Derived> &data) const
+    {
+        return Eigen::Reshaped<
+            const Derived,
+            Eigen::Dynamic,
+            Eigen::Dynamic,
+            Eigen::RowMajor>(
+                data.derived(),
+                this->height_,
+                this->dataWidth_);
+    }
+
+    template<typename Derived>
+    void WriteBuffered_(const Eigen::DenseBase<Derived> &data)
+    {
+        this->withStride_.leftCols(this->dataWidth_) = this->Reshape_(data);
+
+        // Copy bytes to avFrame
+        AVFrame *avFrame = this->output_.GetNextFrame();
+        memcpy(avFrame->data[0], this->withStride_.data(), this->fieldSize_);
+        this->output_.WriteFrame();
+    }
+
     VideoOutput &output_;
+    StrideMode mode_;
     Eigen::Index height_;
     Eigen::Index dataWidth_;
     Eigen::Index stride_;
     size_t fieldSize_;
+
+    // Only allocated in StrideMode::buffered.
     VideoFrame withStride_;
-    StrideMap strideMap_;
 };
 
 
@@ -192,4 +231,188 @@ private:
 };
 
 
+/**
+ ** Applies the color map row by row directly into the encoder's frame.
+ **
+ ** Unlike ColorMappedVideoWriter, there is no intermediate Colors matrix and
+ ** no second copy. Each scalar is read once, and each pixel is written once
+ ** with the stride expected by the encoder.
+ **
+ ** Value is the scalar type of the data, which indexes a ColorLookup, and
+ ** has at most 16 bits.
+ **/
+template<typename ColorMap, typename Value>
+struct FusedColorMappedVideoWriter
+{
+public:
+    FusedColorMappedVideoWriter(VideoOutput &output, const ColorMap &colorMap)
+        :
+        output_(output),
+        lookup_(colorMap)
+    {
+
+    }
+
+    template<typename Derived>
+    void operator()(const Eigen::DenseBase<Derived> &data)
+    {
+        static_assert(
+            std::is_same_v<typename Derived::Scalar, Value>,
+            "Expected the value type of the lookup table.");
+
+        // Evaluating a plain matrix returns a reference without a copy.
+        const auto &values = data.derived().eval();
+
+        static_assert(
+            std::remove_cvref_t<decltype(values)>::IsRowMajor,
+            "Expected row major data to match AVFrame.");
+
+        auto resolution = this->output_.GetResolution();
+        auto width = static_cast<Eigen::Index>(resolution.width);
+        auto height = static_cast<Eigen::Index>(resolution.height);
+
+        assert(values.size() == width * height);
+
+        VideoFrameMap frame = this->output_.AcquireFrame();
+
+        assert(
+            frame.cols()
+            == width * static_cast<Eigen::Index>(Lookup::pixelSizeBytes));
+
+        this->lookup_.MapFrame(
+            values.data(),
+            height,
+            width,
+            frame.data(),
+            frame.outerStride());
+
+        this->output_.Commit();
+    }
+
+    TimeStamp GetTimeStamp() const
+    {
+        return this->output_.GetTimeStamp();
+    }
+
+    void Flush()
+    {
+        this->output_.Flush();
+    }
+
+private:
+    using Lookup = ColorLookup<ColorMap, Value>;
+
+    VideoOutput &output_;
+    Lookup lookup_;
+};
+
+
+/**
+ ** @return true when the frames passed to output are yuv420p or yuv444p,
+ **     and are not converted before encoding.
+ **/
+inline bool IsPlanarYuvOutput(const VideoOutput &output)
+{
+    const auto &options = output.GetOptions();
+
+    return (options.inPixelFormat == options.outPixelFormat)
+        && (options.inPixelFormat == AV_PIX_FMT_YUV420P
+            || options.inPixelFormat == AV_PIX_FMT_YUV444P);
+}
+
+
+/**
+ ** Writes the planes of a yuv420p or yuv444p frame directly from scalar
+ ** data, so neither an RGB frame nor a Reformat is needed.
+ **
+ ** The VideoOutput must be configured with the same YUV format for input
+ ** and output. Value is the scalar type of the data, and has at most 16
+ ** bits.
+ **/
+template<typename ColorMap, typename Value>
+struct YuvColorMappedVideoWriter
+{
+public:
+    YuvColorMappedVideoWriter(VideoOutput &output, const ColorMap &colorMap)
+        :
+        output_(output),
+        lookup_(colorMap, output.GetOptions().colorMatrix)
+    {
+        if (!IsPlanarYuvOutput(output))
+        {
+            throw VideoError("Expected yuv420p or yuv444p input and output");
+        }
+    }
+
+    template<typename Derived>
+    void operator()(const Eigen::DenseBase<Derived> &data)
+    {
+        static_assert(
+            std::is_same_v<typename Derived::Scalar, Value>,
+            "Expected the value type of the lookup tables.");
+
+        // Evaluating a plain matrix returns a reference without a copy.
+        const auto &values = data.derived().eval();
+
+        static_assert(
+            std::remove_cvref_t<decltype(values)>::IsRowMajor,
+            "Expected row major data to match AVFrame.");
+
+        auto resolution = this->output_.GetResolution();
+        auto width = static_cast<Eigen::Index>(resolution.width);
+        auto height = static_cast<Eigen::Index>(resolution.height);
+
+        assert(values.size() == width * height);
+
+        AVFrame *frame = this->output_.GetNextFrame();
+        auto *y = frame->data[0];
+        auto *u = frame->data[1];
+        auto *v = frame->data[2];
+
+        if (frame->format == AV_PIX_FMT_YUV444P)
+        {
+            for (Eigen::Index row = 0; row < height; ++row)
+            {
+                this->lookup_.MapRow444(
+                    values.data() + row * width,
+                    width,
+                    y + row * frame->linesize[0],
+                    u + row * frame->linesize[1],
+                    v + row * frame->linesize[2]);
+            }
+        }
+        else
+        {
+            for (Eigen::Index row = 0; row < height; row += 2)
+            {
+                this->lookup_.MapRows420(
+                    values.data() + row * width,
+                    values.data() + (row + 1) * width,
+                    width,
+                    y + row * frame->linesize[0],
+                    y + (row + 1) * frame->linesize[0],
+                    u + (row / 2) * frame->linesize[1],
+                    v + (row / 2) * frame->linesize[2]);
+            }
+        }
+
+        this->output_.Commit();
+    }
+
+    TimeStamp GetTimeStamp() const
+    {
+        return this->output_.GetTimeStamp();
+    }
+
+    void Flush()
+    {
+        this->output_.Flush();
+    }
+
+private:
+    VideoOutput &output_;
+    YuvLookup<ColorMap, Value> lookup_;
+};
+
+
 } // end namespace clip
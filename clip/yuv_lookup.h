@@ -0,0 +1,152 @@
+/**
+  * @file yuv_lookup.h
+  *
+  * @brief Caches the Y, U, and V values of a color map for every integral
+  *     input value.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#pragma once
+
+
+#include <limits>
+#include <vector>
+#include "clip/color_lookup.h"
+#include "clip/video_options.h"
+#include "clip/detail/rgb_to_yuv_kernels.h"
+
+
+namespace clip
+{
+
+
+template<typename ColorMap>
+inline constexpr bool isRgb24ColorMap =
+    std::is_same_v<typename ColorMap::Colors::Scalar, uint8_t>
+    && tau::MatrixTraits<typename ColorMap::Colors>::columns == 3;
+
+
+/**
+ ** Holds the Y, U, and V values of every possible input value, so that
+ ** planar frames can be written from scalar data without an RGB
+ ** intermediate.
+ **
+ ** The tables are built once, and hold 3 * 2^16 bytes for 16-bit values.
+ **/
+template<typename ColorMap, typename Value>
+class YuvLookup
+{
+public:
+    static_assert(
+        isRgb24ColorMap<ColorMap>,
+        "Expected an RGB24 color map.");
+
+    static_assert(
+        isLookupIndex<Value>,
+        "Expected unsigned integral values of 16 bits or fewer.");
+
+    static constexpr size_t valueCount =
+        static_cast<size_t>(std::numeric_limits<Value>::max()) + 1;
+
+    YuvLookup(const ColorMap &colorMap, ColorMatrix colorMatrix)
+        :
+        y_(valueCount),
+        u_(valueCount),
+        v_(valueCount)
+    {
+        Eigen::Matrix<Value, 1, Eigen::Dynamic> ramp(valueCount);
+
+        for (size_t i = 0; i < valueCount; ++i)
+        {
+            ramp(static_cast<Eigen::Index>(i)) = static_cast<Value>(i);
+        }
+
+        ColorMap mapColors(colorMap);
+        typename ColorMap::Colors colors;
+        mapColors(ramp, &colors);
+
+        // The colors are row-major RGB24, the same layout as a row of
+        // pixels.
+        detail::RgbToYuv444Scalar(
+            colors.data(),
+            static_cast<int>(valueCount),
+            this->y_.data(),
+            this->u_.data(),
+            this->v_.data(),
+            (colorMatrix == ColorMatrix::bt709)
+                ? detail::bt709Coefficients
+                : detail::bt601Coefficients);
+    }
+
+    /**
+     ** Full resolution chroma.
+     **/
+    void MapRow444(
+        const Value *values,
+        Eigen::Index count,
+        uint8_t *y,
+        uint8_t *u,
+        uint8_t *v) const
+    {
+        for (Eigen::Index i = 0; i < count; ++i)
+        {
+            auto value = static_cast<size_t>(values[i]);
+            y[i] = this->y_[value];
+            u[i] = this->u_[value];
+            v[i] = this->v_[value];
+        }
+    }
+
+    /**
+     ** Maps two rows at once. Chroma is the rounded mean of the chroma
+     ** entries of each 2x2 block. count must be even.
+     **/
+    void MapRows420(
+        const Value *values0,
+        const Value *values1,
+        Eigen::Index count,
+        uint8_t *y0,
+        uint8_t *y1,
+        uint8_t *u,
+        uint8_t *v) const
+    {
+        for (Eigen::Index i = 0; i < count; i += 2)
+        {
+            auto a = static_cast<size_t>(values0[i]);
+            auto b = static_cast<size_t>(values0[i + 1]);
+            auto c = static_cast<size_t>(values1[i]);
+            auto d = static_cast<size_t>(values1[i + 1]);
+
+            y0[i] = this->y_[a];
+            y0[i + 1] = this->y_[b];
+            y1[i] = this->y_[c];
+            y1[i + 1] = this->y_[d];
+
+            *u++ = static_cast<uint8_t>(
+                detail::Average4(
+                    this->u_[a],
+                    this->u_[b],
+                    this->u_[c],
+                    this->u_[d]));
+
+            *v++ = static_cast<uint8_t>(
+                detail::Average4(
+                    this->v_[a],
+                    this->v_[b],
+                    this->v_[c],
+                    this->v_[d]));
+        }
+    }
+
+private:
+    std::vector<uint8_t> y_;
+    std::vector<uint8_t> u_;
+    std::vector<uint8_t> v_;
+};
+
+
+} // end namespace clip
@@ -1,4 +1,3 @@
-
 #include <cstdlib>
 #include <iostream>
 #include <optional>
@@ -9,13 +8,12 @@ FFMPEG_SHIM_PUSH_IGNORES
 extern "C"
 {
 
-#include <libavformat/avformat.h>
 #include <libavutil/dict.h>
 
 }
 FFMPEG_SHIM_POP_IGNORES
 
-#include <clip/error.h>
+#include <clip/input_context.h>
 
 
 
@@ -27,114 +25,75 @@ int main(int count, char **args)
         return EXIT_FAILURE;
     }
 
-    AVFormatContext *context = NULL;
-
-    int result = avformat_open_input(&context, args[1], NULL, NULL);
-
-    if (result != 0)
+    try
     {
-        std::cerr << clip::DescribeError("Failed to open file", result)
-            << std::endl;
-
-        return EXIT_FAILURE;
-    }
-
-    result = avformat_find_stream_info(context, NULL);
+        clip::InputContext context(args[1]);
 
-    if (result < 0)
-    {
-        std::cerr << clip::DescribeError("Failed to find stream info", result)
-            << std::endl;
+        std::optional<int> videoStream =
+            context.FindBestStream(AVMEDIA_TYPE_VIDEO);
 
-        return EXIT_FAILURE;
-    }
-
-    std::optional<size_t> videoStream;
-
-    for (size_t i = 0; i < context->nb_streams; ++i)
-    {
-        if (context->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        if (!videoStream)
         {
-            videoStream = i;
-            break;
+            std::cerr << "Unable to find video stream" << std::endl;
+            return EXIT_FAILURE;
         }
-    }
 
-    if (!videoStream)
-    {
-        std::cerr << "Unable to find video stream" << std::endl;
-        return EXIT_FAILURE;
-    }
+        const AVCodecParameters *codecParameters =
+            context.GetStream(*videoStream)->codecpar;
 
-    AVCodecParameters *codecParameters =
-        context->streams[*videoStream]->codecpar;
+        std::cout << "width: " << codecParameters->width << std::endl;
+        std::cout << "height: " << codecParameters->height << std::endl;
 
-    if (!codecParameters)
-    {
-        std::cerr << "Codec not found" << std::endl;
-        return EXIT_FAILURE;
-    }
-
-    std::cout << "width: " << codecParameters->width << std::endl;
-    std::cout << "height: " << codecParameters->height << std::endl;
-
-    std::cout << avcodec_get_name(codecParameters->codec_id) << std::endl;
-    std::cout << "AVPixelFormat: " << codecParameters->format << std::endl;
+        std::cout << avcodec_get_name(codecParameters->codec_id) << std::endl;
+        std::cout << "AVPixelFormat: " << codecParameters->format << std::endl;
 
-#if 1
-    AVPacket packet{};
+        // Packets of the other streams are skipped by the demuxer.
+        context.SelectStreams({*videoStream});
 
-    size_t frameCount = 0;
-
-    while (true)
-    {
-        result = av_read_frame(context, &packet);
+        size_t frameCount = 0;
 
-        if (result != 0)
+        for (auto &packet: context.GetPackets())
         {
-            std::cerr << clip::DescribeError("Read frame", result)
+            std::cout << "pts: " << packet->pts << std::endl;
+
+            std::cout << std::dec << frameCount << " frame has "
+                << packet->buf->size
+                << " bytes at " << static_cast<void *>(packet->buf->data)
+                << " buffer at " << static_cast<void *>(packet->buf->buffer)
                 << std::endl;
 
-            break;
+            ++frameCount;
         }
 
-        size_t frameDataSize = packet.buf->size;
+        std::cout << "iformat->name: " << context->iformat->name << std::endl;
 
-        std::cout << "pts: " << packet.pts << std::endl;
+        std::cout << "iformat->long_name: "
+            << context->iformat->long_name << std::endl;
 
-        std::cout << std::dec << frameCount << " frame has " << frameDataSize
-            << " bytes at " << static_cast<void *>(packet.buf->data)
-            << " buffer at " << static_cast<void *>(packet.buf->buffer)
-            << std::endl;
+        if (context->iformat->mime_type)
+        {
+            std::cout << "iformat->mime_type: "
+                << context->iformat->mime_type << std::endl;
+        }
 
-        ++frameCount;
-    }
-#endif
+        std::cout << "metadata: " << std::endl;
 
-    std::cout << "iformat->name: " << context->iformat->name << std::endl;
+        const AVDictionaryEntry *entry =
+            av_dict_iterate(context->metadata, NULL);
 
-    std::cout << "iformat->long_name: "
-        << context->iformat->long_name << std::endl;
+        while (entry != NULL)
+        {
+            std::cout << "key: " << entry->key
+                << ", value: " << entry->value << std::endl;
 
-    if (context->iformat->mime_type)
-    {
-        std::cout << "iformat->mime_type: "
-            << context->iformat->mime_type << std::endl;
+            entry = av_dict_iterate(context->metadata, entry);
+        }
     }
-
-    std::cout << "metadata: " << std::endl;
-
-    const AVDictionaryEntry *entry = av_dict_iterate(context->metadata, NULL);
-
-    while (entry != NULL)
+    catch (clip::ClipError &error)
     {
-        std::cout << "key: " << entry->key
-            << ", value: " << entry->value << std::endl;
-
-        entry = av_dict_iterate(context->metadata, entry);
+        std::cerr << error.what() << std::endl;
+        return EXIT_FAILURE;
     }
 
-    avformat_close_input(&context);
-
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,50 @@
+/**
+  * @file remux.cpp
+  *
+  * @brief Copies the streams of a file into an mp4, without decoding.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+#include "clip/format.h"
+#include "clip/remuxer.h"
+
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " input output.mp4" << std::endl;
+
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        auto outputContext = std::make_shared<clip::OutputContext>(
+            clip::format::Mp4::Get(),
+            argv[2]);
+
+        clip::Remuxer remuxer(argv[1], outputContext);
+
+        clip::Dictionary formatOptions;
+        outputContext->Initialize(formatOptions);
+        remuxer.Run();
+        outputContext->Finalize();
+    }
+    catch (clip::ClipError &error)
+    {
+        std::cerr << error.what() << std::endl;
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+/**
+  * @file transcode.cpp
+  *
+  * @brief Transcodes the video stream of a file to h264 in an mp4, and copies
+  *     its audio.
+  *
+  * @author Jive Helix (jivehelix@gmail.com)
+  * @date 11 Feb 2022
+  * @copyright Jive Helix
+  * Licensed under the MIT license. See LICENSE file.
+**/
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+#include "clip/format.h"
+#include "clip/input_context.h"
+#include "clip/transcoder.h"
+
+
+static void PrintStage(const char *name, const clip::StageOccupancy &stage)
+{
+    std::cout << name << ": " << stage.itemCount << " items, "
+        << stage.busyTime.count() / 1000000 << " ms busy, "
+        << stage.queued << "/" << stage.capacity << " queued" << std::endl;
+}
+
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " input output.mp4" << std::endl;
+
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        clip::Resolution resolution{0, 0};
+
+        {
+            clip::InputContext input(argv[1]);
+            auto streamIndex = input.FindBestStream(AVMEDIA_TYPE_VIDEO);
+
+            if (!streamIndex)
+            {
+                std::cerr << "Unable to find video stream" << std::endl;
+
+                return EXIT_FAILURE;
+            }
+
+            const AVCodecParameters *parameters =
+                input.GetStream(*streamIndex)->codecpar;
+
+            // The encoder requires even dimensions.
+            resolution.width = parameters->width & ~1;
+            resolution.height = parameters->height & ~1;
+        }
+
+        clip::Dictionary codecOptions;
+
+        auto outputContext = std::make_shared<clip::OutputContext>(
+            clip::format::Mp4::Get(),
+            argv[2]);
+
+        outputContext->EnableMuxThread();
+
+        auto videoOptions = clip::VideoOptions::MakeDefault(resolution);
+
+        // Keep the input's frame rate.
+        videoOptions.framesPerSecond = 0;
+
+        clip::Transcoder transcoder(
+            argv[1],
+            outputContext,
+            codecOptions,
+            videoOptions);
+
+        outputContext->Initialize(codecOptions);
+        transcoder.Run();
+        outputContext->Finalize();
+
+        auto occupancy = transcoder.GetOccupancy();
+        PrintStage("demux", occupancy.demux);
+        PrintStage("decode", occupancy.decode);
+        PrintStage("reformat", occupancy.reformat);
+        PrintStage("encode", occupancy.encode);
+    }
+    catch (clip::ClipError &error)
+    {
+        std::cerr << error.what() << std::endl;
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
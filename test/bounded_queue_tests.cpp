@@ -0,0 +1,84 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <thread>
+#include "clip/detail/bounded_queue.h"
+
+
+TEST_CASE("Values remain after closing", "[bounded_queue]")
+{
+    clip::detail::BoundedQueue<std::unique_ptr<int>> queue(3);
+
+    REQUIRE(queue.Push(std::make_unique<int>(1)));
+    REQUIRE(queue.Push(std::make_unique<int>(2)));
+    REQUIRE(queue.GetSize() == 2);
+
+    queue.Close();
+    REQUIRE_FALSE(queue.Push(std::make_unique<int>(3)));
+
+    REQUIRE(**queue.Pop() == 1);
+    REQUIRE(**queue.Pop() == 2);
+    REQUIRE(!queue.Pop());
+    REQUIRE(queue.GetSize() == 0);
+}
+
+
+TEST_CASE("Closing releases a blocked producer", "[bounded_queue]")
+{
+    clip::detail::BoundedQueue<int> queue(1);
+
+    REQUIRE(queue.Push(1));
+
+    bool isPushed = true;
+
+    std::thread producer(
+        [&]()
+        {
+            isPushed = queue.Push(2);
+        });
+
+    queue.Close();
+    producer.join();
+
+    REQUIRE_FALSE(isPushed);
+    REQUIRE(*queue.TryPop() == 1);
+    REQUIRE(!queue.TryPop());
+}
+
+
+TEST_CASE("Consumer receives every value in order", "[bounded_queue]")
+{
+    static constexpr int count = 100000;
+    clip::detail::BoundedQueue<int> queue(4);
+
+    std::thread producer(
+        [&]()
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                queue.Push(int(i));
+            }
+
+            queue.Close();
+        });
+
+    int expected = 0;
+    bool isOrdered = true;
+
+    while (auto value = queue.Pop())
+    {
+        isOrdered = isOrdered && (*value == expected);
+        ++expected;
+    }
+
+    producer.join();
+
+    REQUIRE(isOrdered);
+    REQUIRE(expected == count);
+}
@@ -0,0 +1,50 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include "clip/circle_gradient.h"
+
+
+TEST_CASE("CircleGradient matches GetDistance", "[circle_gradient]")
+{
+    using Gradient = clip::CircleGradient<uint16_t>;
+
+    auto threadCount = GENERATE(1u, 4u);
+    auto height = GENERATE(2, 90, 480);
+    auto width = GENERATE(2, 64, 642);
+
+    Gradient gradient(height, width, 30, 0.5, threadCount);
+
+    for (int frame = 0; frame < 8; ++frame)
+    {
+        auto values = gradient.GetNext();
+
+        // The distance is zero at the path point.
+        Eigen::Index pointY;
+        Eigen::Index pointX;
+        REQUIRE(values.minCoeff(&pointY, &pointX) == 0);
+
+        for (int i = 0; i < height; ++i)
+        {
+            for (int j = 0; j < width; ++j)
+            {
+                auto expected = Gradient::GetDistance(
+                    j - static_cast<int>(pointX),
+                    i - static_cast<int>(pointY));
+
+                if (values(i, j) != expected)
+                {
+                    FAIL("Mismatch at row " << i << ", column " << j);
+                }
+            }
+        }
+
+        // Move the path point further between checks.
+        gradient.Tick();
+        gradient.Tick();
+    }
+}
@@ -0,0 +1,134 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <limits>
+#include <vector>
+#include "clip/color_lookup.h"
+
+
+namespace
+{
+
+
+// Maps each value to an arbitrary, but repeatable, color.
+struct ScrambleColorMap
+{
+    using Colors =
+        Eigen::Matrix<uint8_t, Eigen::Dynamic, 3, Eigen::RowMajor>;
+
+    template<typename Derived>
+    void operator()(const Eigen::DenseBase<Derived> &values, Colors *colors)
+        const
+    {
+        colors->resize(values.size(), 3);
+
+        for (Eigen::Index i = 0; i < values.size(); ++i)
+        {
+            auto value = static_cast<int>(values(i));
+            (*colors)(i, 0) = static_cast<uint8_t>(value * 7);
+            (*colors)(i, 1) = static_cast<uint8_t>(255 - (value >> 8));
+            (*colors)(i, 2) = static_cast<uint8_t>(value * 13 + 5);
+        }
+    }
+};
+
+
+template<typename Value>
+void RequireMatchesColorMap(Eigen::Index padding)
+{
+    static constexpr Eigen::Index height = 5;
+    static constexpr Eigen::Index width = 6;
+    static constexpr uint8_t paddingByte = 0xA5;
+
+    using Values =
+        Eigen::Matrix<Value, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+    Values values(height, width);
+
+    for (Eigen::Index i = 0; i < values.size(); ++i)
+    {
+        // Spread the values across the whole range of Value.
+        values(i) = static_cast<Value>(i * 7919 + 3);
+    }
+
+    values(0) = std::numeric_limits<Value>::max();
+    values(1) = 0;
+
+    ScrambleColorMap colorMap;
+    clip::ColorLookup<ScrambleColorMap, Value> lookup(colorMap);
+
+    Eigen::Index dataWidth = width * 3;
+    Eigen::Index stride = dataWidth + padding;
+
+    std::vector<uint8_t> frame(
+        static_cast<size_t>(height * stride),
+        paddingByte);
+
+    lookup.MapFrame(values.data(), height, width, frame.data(), stride);
+
+    ScrambleColorMap::Colors expected;
+    colorMap(values.template reshaped<Eigen::RowMajor>(), &expected);
+
+    for (Eigen::Index row = 0; row < height; ++row)
+    {
+        const uint8_t *mapped = frame.data() + row * stride;
+
+        for (Eigen::Index column = 0; column < width; ++column)
+        {
+            for (Eigen::Index color = 0; color < 3; ++color)
+            {
+                REQUIRE(
+                    mapped[column * 3 + color]
+                    == expected(row * width + column, color));
+            }
+        }
+
+        for (Eigen::Index i = dataWidth; i < stride; ++i)
+        {
+            REQUIRE(mapped[i] == paddingByte);
+        }
+    }
+}
+
+
+} // end anonymous namespace
+
+
+TEST_CASE("ColorLookup matches the color map", "[color_lookup]")
+{
+    SECTION("uint8_t without padding")
+    {
+        RequireMatchesColorMap<uint8_t>(0);
+    }
+
+    SECTION("uint8_t with padding")
+    {
+        RequireMatchesColorMap<uint8_t>(14);
+    }
+
+    SECTION("uint16_t without padding")
+    {
+        RequireMatchesColorMap<uint16_t>(0);
+    }
+
+    SECTION("uint16_t with padding")
+    {
+        RequireMatchesColorMap<uint16_t>(14);
+    }
+}
+
+
+TEST_CASE("Only narrow unsigned values are indexed", "[color_lookup]")
+{
+    STATIC_REQUIRE(clip::isLookupIndex<uint8_t>);
+    STATIC_REQUIRE(clip::isLookupIndex<uint16_t>);
+    STATIC_REQUIRE_FALSE(clip::isLookupIndex<uint32_t>);
+    STATIC_REQUIRE_FALSE(clip::isLookupIndex<uint64_t>);
+    STATIC_REQUIRE_FALSE(clip::isLookupIndex<int16_t>);
+    STATIC_REQUIRE_FALSE(clip::isLookupIndex<bool>);
+}
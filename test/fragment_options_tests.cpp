@@ -0,0 +1,44 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+#include "clip/fragment_options.h"
+
+
+TEST_CASE("Fragments start at keyframes by default", "[fragment_options]")
+{
+    clip::Dictionary options;
+    clip::FragmentOptions::MakeDefault().AddTo(options);
+
+    REQUIRE(
+        options["movflags"] == "empty_moov+default_base_moof+frag_keyframe");
+
+    REQUIRE_THROWS_AS(options["frag_duration"], std::out_of_range);
+}
+
+
+TEST_CASE("Fragment duration is in microseconds", "[fragment_options]")
+{
+    auto fragmentOptions = clip::FragmentOptions::MakeDefault();
+    fragmentOptions.fragmentOnKeyframe = false;
+    fragmentOptions.fragmentDuration = std::chrono::seconds(2);
+
+    clip::Dictionary options;
+    fragmentOptions.AddTo(options);
+
+    REQUIRE(options["movflags"] == "empty_moov+default_base_moof");
+    REQUIRE(options["frag_duration"] == "2000000");
+}
+
+
+TEST_CASE("Fragments need a boundary", "[fragment_options]")
+{
+    auto fragmentOptions = clip::FragmentOptions::MakeDefault();
+    fragmentOptions.fragmentOnKeyframe = false;
+
+    clip::Dictionary options;
+    REQUIRE_THROWS_AS(fragmentOptions.AddTo(options), clip::ClipError);
+}
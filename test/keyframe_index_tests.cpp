@@ -0,0 +1,85 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include "clip/keyframe_index.h"
+
+
+static std::vector<clip::IndexEntry> MakeEntries()
+{
+    static constexpr uint32_t key = clip::IndexEntry::keyframe;
+
+    // In decoding order, as a stream with B-frames is stored.
+    return {
+        {0, -2, 48, 9000, key},
+        {4, -1, 9048, 700, 0},
+        {2, 0, 9748, 300, 0},
+        {1, 1, 10048, 200, 0},
+        {3, 2, 10248, 200, 0},
+        {5, 3, 10448, 8000, key},
+        {6, 4, 18448, 600, 0}};
+}
+
+
+TEST_CASE("Entries are in presentation order", "[keyframe_index]")
+{
+    clip::KeyframeIndex index(0, AVRational{1, 30}, MakeEntries());
+
+    REQUIRE(index.GetCount() == 7);
+
+    for (size_t i = 0; i < index.GetCount(); ++i)
+    {
+        REQUIRE(index[i].pts == static_cast<int64_t>(i));
+    }
+
+    REQUIRE(index[1].position == 10048);
+    REQUIRE_THROWS_AS(index[7], clip::IndexError);
+}
+
+
+TEST_CASE("Frames are found from the preceding keyframe", "[keyframe_index]")
+{
+    clip::KeyframeIndex index(0, AVRational{1, 30}, MakeEntries());
+
+    REQUIRE(index.FindKeyframe(0) == 0);
+    REQUIRE(index.FindKeyframe(4) == 0);
+    REQUIRE(index.FindKeyframe(5) == 5);
+    REQUIRE(index.FindKeyframe(6) == 5);
+}
+
+
+TEST_CASE("Saved index is mapped unchanged", "[keyframe_index]")
+{
+    std::string fileName = "keyframe_index_test.idx";
+
+    clip::KeyframeIndex(2, AVRational{1, 90000}, MakeEntries())
+        .Save(fileName);
+
+    {
+        auto index = clip::KeyframeIndex::Load(fileName);
+
+        REQUIRE(index.GetStreamIndex() == 2);
+        REQUIRE(index.GetTimeBase().num == 1);
+        REQUIRE(index.GetTimeBase().den == 90000);
+        REQUIRE(index.GetCount() == 7);
+        REQUIRE(index[3].size == 200);
+        REQUIRE(index[5].GetIsKeyframe());
+        REQUIRE(index.FindKeyframe(6) == 5);
+    }
+
+    // A partial entry is rejected.
+    {
+        std::ofstream output(fileName, std::ios::binary | std::ios::app);
+        output.write("x", 1);
+    }
+
+    REQUIRE_THROWS_AS(clip::KeyframeIndex::Load(fileName), clip::IndexError);
+
+    std::remove(fileName.c_str());
+}
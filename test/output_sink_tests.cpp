@@ -0,0 +1,57 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+#include "clip/output_sink.h"
+
+
+TEST_CASE("MemorySink appends writes", "[output_sink]")
+{
+    clip::MemorySink sink;
+    std::vector<uint8_t> first{1, 2, 3};
+    std::vector<uint8_t> second{4, 5};
+
+    sink.Write(first.data(), first.size());
+    sink.Write(second.data(), second.size());
+
+    REQUIRE(sink.GetData() == std::vector<uint8_t>{1, 2, 3, 4, 5});
+    REQUIRE(sink.Seek(0, AVSEEK_SIZE) == 5);
+}
+
+
+TEST_CASE("MemorySink overwrites after seeking back", "[output_sink]")
+{
+    clip::MemorySink sink;
+    std::vector<uint8_t> data{1, 2, 3, 4};
+    std::vector<uint8_t> patch{9, 9};
+
+    sink.Write(data.data(), data.size());
+
+    REQUIRE(sink.Seek(1, SEEK_SET) == 1);
+    sink.Write(patch.data(), patch.size());
+    REQUIRE(sink.GetData() == std::vector<uint8_t>{1, 9, 9, 4});
+
+    REQUIRE(sink.Seek(0, SEEK_END) == 4);
+    REQUIRE(sink.Seek(-1, SEEK_CUR) == 3);
+    REQUIRE(sink.Seek(-5, SEEK_CUR) < 0);
+}
+
+
+TEST_CASE("MemorySink fills gaps with zeros", "[output_sink]")
+{
+    clip::MemorySink sink;
+    std::vector<uint8_t> data{7};
+
+    REQUIRE(sink.Seek(2, SEEK_SET) == 2);
+    sink.Write(data.data(), data.size());
+    REQUIRE(sink.GetData() == std::vector<uint8_t>{0, 0, 7});
+
+    auto released = sink.Release();
+    REQUIRE(released.size() == 3);
+    REQUIRE(sink.GetData().empty());
+}
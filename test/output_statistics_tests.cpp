@@ -0,0 +1,86 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <thread>
+#include <vector>
+#include "clip/output_statistics.h"
+
+
+TEST_CASE("OutputStatistics counts from many threads", "[statistics]")
+{
+    using Stage = clip::OutputStatistics::Stage;
+
+    clip::OutputStatistics statistics;
+
+    static constexpr int threadCount = 4;
+    static constexpr int iterations = 1000;
+
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back(
+            [&statistics]()
+            {
+                for (int j = 0; j < iterations; ++j)
+                {
+                    statistics.AddFrame();
+                    statistics.AddPacket(10);
+
+                    statistics.AddTime(
+                        Stage::write,
+                        std::chrono::microseconds(1));
+                }
+            });
+    }
+
+    for (auto &thread: threads)
+    {
+        thread.join();
+    }
+
+    auto snapshot = statistics.GetSnapshot();
+
+    REQUIRE(snapshot.frameCount == threadCount * iterations);
+    REQUIRE(snapshot.packetCount == threadCount * iterations);
+    REQUIRE(snapshot.byteCount == 10 * threadCount * iterations);
+
+    REQUIRE(
+        snapshot.writeTime
+        == std::chrono::microseconds(threadCount * iterations));
+
+    REQUIRE(snapshot.sendTime.count() == 0);
+
+    auto total = snapshot;
+    total += snapshot;
+    REQUIRE(total.frameCount == 2 * snapshot.frameCount);
+    REQUIRE(total.elapsed == snapshot.elapsed);
+}
+
+
+TEST_CASE("OutputStatistics times a call", "[statistics]")
+{
+    using Stage = clip::OutputStatistics::Stage;
+
+    clip::OutputStatistics statistics;
+
+    int result = statistics.Time(
+        Stage::reformat,
+        []()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+            return 42;
+        });
+
+    REQUIRE(result == 42);
+
+    REQUIRE(
+        statistics.GetSnapshot().reformatTime
+        >= std::chrono::milliseconds(2));
+}
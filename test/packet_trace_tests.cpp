@@ -0,0 +1,135 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "clip/packet_trace.h"
+
+
+TEST_CASE("PacketTrace keeps the most recent packets", "[packet_trace]")
+{
+    AVPacket *packet = av_packet_alloc();
+    REQUIRE(packet != NULL);
+
+    clip::PacketTrace trace(5);
+    REQUIRE(trace.GetCapacity() == 8);
+
+    for (int i = 0; i < 12; ++i)
+    {
+        packet->pts = i;
+        packet->dts = i - 1;
+        packet->duration = 1;
+        packet->size = 100 + i;
+        packet->stream_index = i % 2;
+        packet->flags = (i % 4 == 0) ? AV_PKT_FLAG_KEY : 0;
+
+        trace.Record(packet);
+    }
+
+    av_packet_free(&packet);
+
+    auto records = trace.GetRecords();
+
+    REQUIRE(records.size() == 8);
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const auto &record = records[i];
+        auto expected = static_cast<int64_t>(i + 4);
+
+        REQUIRE(record.sequence == static_cast<uint64_t>(expected));
+        REQUIRE(record.pts == expected);
+        REQUIRE(record.dts == expected - 1);
+        REQUIRE(record.size == 100 + expected);
+        REQUIRE(record.streamIndex == expected % 2);
+        REQUIRE(record.isKeyframe == (expected % 4 == 0));
+    }
+
+    REQUIRE(records.front().recordedNanoseconds
+        <= records.back().recordedNanoseconds);
+}
+
+
+TEST_CASE("Concurrent writers never mix records", "[packet_trace]")
+{
+    static constexpr int writerCount = 8;
+    static constexpr int packetCount = 100000;
+
+    // A small ring, so that writers often meet at the same slot.
+    clip::PacketTrace trace(2);
+    std::atomic<bool> isDone{false};
+    std::vector<std::thread> writers;
+
+    for (int writer = 0; writer < writerCount; ++writer)
+    {
+        writers.emplace_back(
+            [&trace, writer]()
+            {
+                AVPacket *packet = av_packet_alloc();
+
+                for (int i = 0; i < packetCount; ++i)
+                {
+                    // Every field is derived from the same value.
+                    int64_t value = writer * packetCount + i;
+                    packet->pts = value;
+                    packet->dts = value;
+                    packet->duration = value;
+                    packet->size = static_cast<int>(value);
+                    packet->stream_index = writer;
+
+                    trace.Record(packet);
+                }
+
+                av_packet_free(&packet);
+            });
+    }
+
+    // Catch2 assertions are only made on this thread.
+    size_t mixedCount = 0;
+
+    std::thread reader(
+        [&]()
+        {
+            while (!isDone.load())
+            {
+                for (const auto &record: trace.GetRecords())
+                {
+                    bool isMixed =
+                        record.dts != record.pts
+                        || record.duration != record.pts
+                        || record.size != record.pts
+                        || record.streamIndex != record.pts / packetCount;
+
+                    if (isMixed)
+                    {
+                        ++mixedCount;
+                    }
+                }
+            }
+        });
+
+    for (auto &writer: writers)
+    {
+        writer.join();
+    }
+
+    isDone.store(true);
+    reader.join();
+
+    REQUIRE(mixedCount == 0);
+
+    auto records = trace.GetRecords();
+    REQUIRE(records.size() == trace.GetCapacity());
+
+    for (const auto &record: records)
+    {
+        REQUIRE(record.dts == record.pts);
+        REQUIRE(record.size == record.pts);
+    }
+}
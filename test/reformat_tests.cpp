@@ -0,0 +1,109 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <cstring>
+#include <random>
+#include "clip/reformat.h"
+
+
+namespace
+{
+
+
+clip::Frame MakeRandomFrame(const clip::Resolution &resolution)
+{
+    clip::Frame frame(
+        AV_PIX_FMT_RGB24,
+        resolution.height,
+        resolution.width);
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> distribution(0, 255);
+
+    for (int row = 0; row < resolution.height; ++row)
+    {
+        uint8_t *data = frame->data[0] + row * frame->linesize[0];
+
+        for (int i = 0; i < resolution.width * 3; ++i)
+        {
+            data[i] = static_cast<uint8_t>(distribution(generator));
+        }
+    }
+
+    return frame;
+}
+
+
+// Compares the visible bytes of yuv420p frames. The padding at the end of
+// each row is never written, so it is not compared.
+bool PlanesMatch(
+    const clip::Frame &first,
+    const clip::Frame &second,
+    int planeCount)
+{
+    for (int plane = 0; plane < planeCount; ++plane)
+    {
+        // Chroma planes of yuv420p have half as many rows and columns,
+        // rounded up.
+        bool isChroma = (plane > 0);
+        int rowCount = isChroma ? (first->height + 1) / 2 : first->height;
+        int width = isChroma ? (first->width + 1) / 2 : first->width;
+
+        for (int row = 0; row < rowCount; ++row)
+        {
+            if (0 != std::memcmp(
+                    first->data[plane] + row * first->linesize[plane],
+                    second->data[plane] + row * second->linesize[plane],
+                    static_cast<size_t>(width)))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+} // end anonymous namespace
+
+
+TEST_CASE("Threaded reformat matches serial", "[reformat]")
+{
+    clip::Resolution resolution{1920, 1080};
+    auto source = MakeRandomFrame(resolution);
+
+    clip::Reformat serial(
+        resolution,
+        AV_PIX_FMT_RGB24,
+        resolution,
+        AV_PIX_FMT_YUV420P);
+
+    clip::Reformat threaded(
+        resolution,
+        AV_PIX_FMT_RGB24,
+        resolution,
+        AV_PIX_FMT_YUV420P,
+        SWS_BICUBIC,
+        4);
+
+    clip::Frame serialTarget(
+        AV_PIX_FMT_YUV420P,
+        resolution.height,
+        resolution.width);
+
+    clip::Frame threadedTarget(
+        AV_PIX_FMT_YUV420P,
+        resolution.height,
+        resolution.width);
+
+    serial(source, serialTarget);
+    threaded(source, threadedTarget);
+
+    REQUIRE(PlanesMatch(serialTarget, threadedTarget, 3));
+}
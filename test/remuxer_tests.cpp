@@ -0,0 +1,289 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "clip/input_context.h"
+#include "clip/output_context.h"
+#include "clip/packet.h"
+#include "clip/remuxer.h"
+#include "clip/stream.h"
+
+
+namespace
+{
+
+
+constexpr int frameCount = 30;
+constexpr int framesPerSecond = 30;
+
+// 20 ms of 48 kHz audio in each packet, timed in milliseconds.
+constexpr int audioPacketCount = 50;
+constexpr int audioDuration_ms = 20;
+constexpr int sampleRate = 48000;
+constexpr int samplesPerPacket = sampleRate * audioDuration_ms / 1000;
+
+
+struct CrcPacket
+{
+    int streamIndex;
+    int64_t dts;
+    int64_t pts;
+};
+
+
+// framecrc writes one line per packet:
+// stream_index, dts, pts, duration, size, crc
+std::vector<CrcPacket> ReadCrcPackets(const std::string &fileName)
+{
+    std::ifstream input(fileName);
+    REQUIRE(input.is_open());
+
+    std::vector<CrcPacket> result;
+    std::string line;
+
+    while (std::getline(input, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        CrcPacket packet{};
+        char comma;
+
+        fields >> packet.streamIndex >> comma >> packet.dts >> comma
+            >> packet.pts;
+
+        REQUIRE(fields);
+        result.push_back(packet);
+    }
+
+    return result;
+}
+
+
+void WritePacket(
+    clip::OutputContext &outputContext,
+    int streamIndex,
+    int size,
+    int64_t timeStamp,
+    int64_t duration)
+{
+    clip::OutputPacket packet;
+    REQUIRE(av_new_packet(packet, size) == 0);
+
+    std::memset(packet->data, 0, static_cast<size_t>(size));
+    packet->stream_index = streamIndex;
+    packet->pts = timeStamp;
+    packet->dts = timeStamp;
+    packet->duration = duration;
+    packet->flags |= AV_PKT_FLAG_KEY;
+
+    outputContext.WritePacket(packet);
+}
+
+
+// A nut file of tiny uncompressed video, and 16-bit audio in a millisecond
+// time base when hasAudio is set.
+void WriteInput(const std::string &fileName, bool hasAudio)
+{
+    clip::OutputContext outputContext(
+        av_guess_format("nut", NULL, NULL),
+        fileName);
+
+    clip::Stream video(outputContext);
+    video->time_base = AVRational{1, framesPerSecond};
+    video->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    video->codecpar->codec_id = AV_CODEC_ID_RAWVIDEO;
+    video->codecpar->codec_tag =
+        avcodec_pix_fmt_to_codec_tag(AV_PIX_FMT_GRAY8);
+    video->codecpar->format = AV_PIX_FMT_GRAY8;
+    video->codecpar->width = 16;
+    video->codecpar->height = 16;
+
+    if (hasAudio)
+    {
+        clip::Stream audio(outputContext);
+        audio->time_base = AVRational{1, 1000};
+        audio->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+        audio->codecpar->codec_id = AV_CODEC_ID_PCM_S16LE;
+        audio->codecpar->sample_rate = sampleRate;
+        av_channel_layout_default(&audio->codecpar->ch_layout, 1);
+    }
+
+    clip::Dictionary formatOptions;
+    outputContext.Initialize(formatOptions);
+
+    int audioPacket = 0;
+
+    for (int64_t frame = 0; frame < frameCount; ++frame)
+    {
+        WritePacket(outputContext, 0, 16 * 16, frame, 1);
+
+        // Write the audio that starts before the next frame.
+        int64_t nextFrame_ms = (frame + 1) * 1000 / framesPerSecond;
+
+        while (
+            hasAudio
+            && audioPacket < audioPacketCount
+            && audioPacket * audioDuration_ms < nextFrame_ms)
+        {
+            WritePacket(
+                outputContext,
+                1,
+                samplesPerPacket * 2,
+                audioPacket * audioDuration_ms,
+                audioDuration_ms);
+
+            ++audioPacket;
+        }
+    }
+
+    outputContext.Finalize();
+}
+
+
+std::vector<CrcPacket> GetStream(
+    const std::vector<CrcPacket> &packets,
+    int streamIndex)
+{
+    std::vector<CrcPacket> result;
+
+    std::copy_if(
+        packets.begin(),
+        packets.end(),
+        std::back_inserter(result),
+        [streamIndex](const CrcPacket &packet)
+        {
+            return packet.streamIndex == streamIndex;
+        });
+
+    return result;
+}
+
+
+} // end anonymous namespace
+
+
+TEST_CASE("Remuxed packets keep their timestamps", "[remuxer]")
+{
+    std::string inputName = "remuxer_test.nut";
+    std::string outputName = "remuxer_test.crc";
+    WriteInput(inputName, true);
+
+    {
+        auto outputContext = std::make_shared<clip::OutputContext>(
+            av_guess_format("framecrc", NULL, NULL),
+            outputName);
+
+        clip::Remuxer remuxer(inputName, outputContext);
+        REQUIRE(remuxer.GetOutputIndex(0) == 0);
+        REQUIRE(remuxer.GetOutputIndex(1) == 1);
+
+        // The packets must be written after the header.
+        REQUIRE_THROWS_AS(remuxer.Run(), std::logic_error);
+
+        // A muxer may choose its own time base when the header is written.
+        // framecrc keeps whatever it is given, which stands in for one.
+        (*outputContext)->streams[1]->time_base = AVRational{1, sampleRate};
+
+        clip::Dictionary formatOptions;
+        outputContext->Initialize(formatOptions);
+        remuxer.Run();
+        outputContext->Finalize();
+    }
+
+    auto packets = ReadCrcPackets(outputName);
+
+    auto video = GetStream(packets, 0);
+    REQUIRE(video.size() == frameCount);
+
+    for (size_t i = 0; i < video.size(); ++i)
+    {
+        REQUIRE(video[i].pts == static_cast<int64_t>(i));
+        REQUIRE(video[i].dts == static_cast<int64_t>(i));
+    }
+
+    // Rescaled from milliseconds to samples.
+    auto audio = GetStream(packets, 1);
+    REQUIRE(audio.size() == audioPacketCount);
+
+    for (size_t i = 0; i < audio.size(); ++i)
+    {
+        auto expected = static_cast<int64_t>(i) * samplesPerPacket;
+        REQUIRE(audio[i].pts == expected);
+        REQUIRE(audio[i].dts == expected);
+    }
+
+    std::remove(inputName.c_str());
+    std::remove(outputName.c_str());
+}
+
+
+TEST_CASE("Streams the output cannot hold are skipped", "[remuxer]")
+{
+    std::string inputName = "remuxer_skip_test.nut";
+    std::string outputName = "remuxer_skip_test.wav";
+    WriteInput(inputName, true);
+
+    {
+        auto outputContext = std::make_shared<clip::OutputContext>(
+            av_guess_format("wav", NULL, NULL),
+            outputName);
+
+        // wav holds the audio, but not the video.
+        clip::Remuxer remuxer(inputName, outputContext);
+        REQUIRE(!remuxer.GetOutputIndex(0));
+        REQUIRE(remuxer.GetOutputIndex(1) == 0);
+        REQUIRE((*outputContext)->nb_streams == 1);
+
+        clip::Dictionary formatOptions;
+        outputContext->Initialize(formatOptions);
+        remuxer.Run();
+        outputContext->Finalize();
+    }
+
+    clip::InputContext output(outputName);
+    REQUIRE(output.GetStreamCount() == 1);
+
+    REQUIRE(
+        output.GetStream(0)->codecpar->codec_id == AV_CODEC_ID_PCM_S16LE);
+
+    std::remove(inputName.c_str());
+    std::remove(outputName.c_str());
+}
+
+
+TEST_CASE("Remuxer rejects inputs with nothing to copy", "[remuxer]")
+{
+    std::string inputName = "remuxer_reject_test.nut";
+    std::string outputName = "remuxer_reject_test.wav";
+    WriteInput(inputName, false);
+
+    {
+        auto outputContext = std::make_shared<clip::OutputContext>(
+            av_guess_format("wav", NULL, NULL),
+            outputName);
+
+        REQUIRE_THROWS_WITH(
+            clip::Remuxer(inputName, outputContext),
+            Catch::Contains("can be stored in wav"));
+    }
+
+    std::remove(inputName.c_str());
+    std::remove(outputName.c_str());
+}
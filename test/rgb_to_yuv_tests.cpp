@@ -0,0 +1,158 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <random>
+#include <vector>
+#include "clip/detail/rgb_to_yuv_kernels.h"
+
+
+using namespace clip::detail;
+
+
+namespace
+{
+
+
+std::vector<uint8_t> MakeRandomRgb(int width, unsigned seed)
+{
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<int> distribution(0, 255);
+    std::vector<uint8_t> result(static_cast<size_t>(width) * 3);
+
+    for (auto &value: result)
+    {
+        value = static_cast<uint8_t>(distribution(generator));
+    }
+
+    return result;
+}
+
+
+struct Planes
+{
+    Planes(int width, int chromaWidth)
+        :
+        y0(static_cast<size_t>(width)),
+        y1(static_cast<size_t>(width)),
+        u(static_cast<size_t>(chromaWidth)),
+        v(static_cast<size_t>(chromaWidth))
+    {
+
+    }
+
+    bool operator==(const Planes &other) const
+    {
+        return this->y0 == other.y0
+            && this->y1 == other.y1
+            && this->u == other.u
+            && this->v == other.v;
+    }
+
+    std::vector<uint8_t> y0;
+    std::vector<uint8_t> y1;
+    std::vector<uint8_t> u;
+    std::vector<uint8_t> v;
+};
+
+
+} // end anonymous namespace
+
+
+TEST_CASE("Black and white map to the limited range", "[rgb_to_yuv]")
+{
+    std::vector<uint8_t> rgb{0, 0, 0, 255, 255, 255};
+    Planes planes(2, 2);
+
+    RgbToYuv444Scalar(
+        rgb.data(),
+        2,
+        planes.y0.data(),
+        planes.u.data(),
+        planes.v.data(),
+        bt601Coefficients);
+
+    REQUIRE(planes.y0[0] == 16);
+    REQUIRE(planes.y0[1] == 235);
+    REQUIRE(planes.u[0] == 128);
+    REQUIRE(planes.u[1] == 128);
+    REQUIRE(planes.v[0] == 128);
+    REQUIRE(planes.v[1] == 128);
+}
+
+
+TEST_CASE("SIMD kernels match scalar kernels", "[rgb_to_yuv]")
+{
+    auto simdLevel = GetSimdLevel();
+
+    auto level = GENERATE(SimdLevel::sse41, SimdLevel::avx2);
+    auto width = GENERATE(2, 16, 30, 32, 66, 1920);
+
+    auto coefficients =
+        GENERATE(bt601Coefficients, bt709Coefficients);
+
+    if (level > simdLevel)
+    {
+        // This processor cannot run the kernel.
+        return;
+    }
+
+    auto rgb0 = MakeRandomRgb(width, 1);
+    auto rgb1 = MakeRandomRgb(width, 2);
+
+    SECTION("yuv444p")
+    {
+        Planes expected(width, width);
+        Planes actual(width, width);
+
+        RgbToYuv444Scalar(
+            rgb0.data(),
+            width,
+            expected.y0.data(),
+            expected.u.data(),
+            expected.v.data(),
+            coefficients);
+
+        GetRgbToYuv444Kernel(level)(
+            rgb0.data(),
+            width,
+            actual.y0.data(),
+            actual.u.data(),
+            actual.v.data(),
+            coefficients);
+
+        REQUIRE(actual == expected);
+    }
+
+    SECTION("yuv420p")
+    {
+        Planes expected(width, width / 2);
+        Planes actual(width, width / 2);
+
+        RgbToYuv420Scalar(
+            rgb0.data(),
+            rgb1.data(),
+            width,
+            expected.y0.data(),
+            expected.y1.data(),
+            expected.u.data(),
+            expected.v.data(),
+            coefficients);
+
+        GetRgbToYuv420Kernel(level)(
+            rgb0.data(),
+            rgb1.data(),
+            width,
+            actual.y0.data(),
+            actual.y1.data(),
+            actual.u.data(),
+            actual.v.data(),
+            coefficients);
+
+        REQUIRE(actual == expected);
+    }
+}
@@ -0,0 +1,169 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+#include "clip/output_context.h"
+#include "clip/packet.h"
+#include "clip/stream.h"
+
+
+struct CrcPacket
+{
+    int streamIndex;
+    int64_t dts;
+    int64_t pts;
+};
+
+
+// framecrc writes one line per packet:
+// stream_index, dts, pts, duration, size, crc
+static std::vector<CrcPacket> ReadCrcPackets(const std::string &fileName)
+{
+    std::ifstream input(fileName);
+    REQUIRE(input.is_open());
+
+    std::vector<CrcPacket> result;
+    std::string line;
+
+    while (std::getline(input, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        CrcPacket packet{};
+        char comma;
+
+        fields >> packet.streamIndex >> comma >> packet.dts >> comma
+            >> packet.pts;
+
+        REQUIRE(fields);
+        result.push_back(packet);
+    }
+
+    return result;
+}
+
+
+static void WritePacket(
+    clip::OutputContext &outputContext,
+    int streamIndex,
+    int64_t timeStamp,
+    int64_t duration,
+    bool isKeyframe)
+{
+    clip::OutputPacket packet;
+    REQUIRE(av_new_packet(packet, 16) == 0);
+
+    packet->stream_index = streamIndex;
+    packet->pts = timeStamp;
+    packet->dts = timeStamp;
+    packet->duration = duration;
+
+    if (isKeyframe)
+    {
+        packet->flags |= AV_PKT_FLAG_KEY;
+    }
+
+    outputContext.WritePacket(packet);
+}
+
+
+TEST_CASE("Segments start at keyframes from zero", "[rotating_muxer]")
+{
+    using namespace std::chrono_literals;
+
+    std::string pattern = "rotating_muxer_test_{:02}.crc";
+    std::vector<clip::SegmentInfo> segments;
+
+    {
+        clip::OutputContext outputContext(
+            av_guess_format("framecrc", NULL, NULL),
+            clip::RotationOptions{1s, pattern},
+            [&segments](const clip::SegmentInfo &info)
+            {
+                segments.push_back(info);
+            });
+
+        clip::Stream video(outputContext);
+        video->time_base = AVRational{1, 30};
+        video->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+        video->codecpar->codec_id = AV_CODEC_ID_RAWVIDEO;
+        video->codecpar->width = 16;
+        video->codecpar->height = 16;
+
+        clip::Stream audio(outputContext);
+        audio->time_base = AVRational{1, 1000};
+        audio->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+        audio->codecpar->codec_id = AV_CODEC_ID_PCM_S16LE;
+        audio->codecpar->sample_rate = 48000;
+        av_channel_layout_default(&audio->codecpar->ch_layout, 1);
+
+        clip::Dictionary formatOptions;
+        outputContext.Initialize(formatOptions);
+
+        // Three seconds of video, with a keyframe every half second.
+        // Each audio packet starts 10 ms before its video frame, so the
+        // segments that start at video keyframes begin mid-packet.
+        for (int64_t frame = 0; frame < 90; ++frame)
+        {
+            WritePacket(outputContext, 0, frame, 1, frame % 15 == 0);
+            WritePacket(outputContext, 1, frame * 1000 / 30 - 10, 33, true);
+        }
+
+        outputContext.Finalize();
+    }
+
+    REQUIRE(segments.size() == 3);
+
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        const auto &segment = segments[i];
+
+        REQUIRE(segment.index == i);
+        REQUIRE(segment.fileName == fmt::format(fmt::runtime(pattern), i));
+        REQUIRE(segment.start == std::chrono::seconds(i));
+        REQUIRE(segment.duration == 1s);
+
+        auto packets = ReadCrcPackets(segment.fileName);
+        REQUIRE(!packets.empty());
+
+        for (int streamIndex: {0, 1})
+        {
+            std::vector<int64_t> dts;
+
+            for (const auto &packet: packets)
+            {
+                if (packet.streamIndex != streamIndex)
+                {
+                    continue;
+                }
+
+                REQUIRE(packet.pts >= packet.dts);
+                dts.push_back(packet.dts);
+            }
+
+            REQUIRE(!dts.empty());
+            REQUIRE(dts.front() == 0);
+            REQUIRE(std::is_sorted(dts.begin(), dts.end()));
+            REQUIRE(
+                std::adjacent_find(dts.begin(), dts.end()) == dts.end());
+        }
+
+        std::remove(segment.fileName.c_str());
+    }
+}
@@ -0,0 +1,75 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <thread>
+#include "clip/spsc_queue.h"
+
+
+TEST_CASE("Values are popped in order", "[spsc_queue]")
+{
+    clip::SpscQueue<int> queue(3);
+
+    REQUIRE(queue.TryPush(1));
+    REQUIRE(queue.TryPush(2));
+    REQUIRE(queue.TryPush(3));
+    REQUIRE(queue.GetSize() == 3);
+
+    REQUIRE(*queue.TryPop() == 1);
+    REQUIRE(*queue.TryPop() == 2);
+    REQUIRE(*queue.TryPop() == 3);
+    REQUIRE(!queue.TryPop());
+}
+
+
+TEST_CASE("Push fails when full", "[spsc_queue]")
+{
+    clip::SpscQueue<int> queue(2);
+
+    REQUIRE(queue.TryPush(1));
+    REQUIRE(queue.TryPush(2));
+    REQUIRE_FALSE(queue.TryPush(3));
+
+    // Discarding the oldest value makes room.
+    REQUIRE(*queue.TryPop() == 1);
+    REQUIRE(queue.TryPush(3));
+    REQUIRE(*queue.TryPop() == 2);
+    REQUIRE(*queue.TryPop() == 3);
+}
+
+
+TEST_CASE("Consumer thread receives every value", "[spsc_queue]")
+{
+    static constexpr int count = 100000;
+    clip::SpscQueue<int> queue(8);
+
+    int64_t sum = 0;
+    int previous = -1;
+    bool isOrdered = true;
+
+    std::thread consumer(
+        [&]()
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                int value = queue.Pop();
+                isOrdered = isOrdered && (value == previous + 1);
+                previous = value;
+                sum += value;
+            }
+        });
+
+    for (int i = 0; i < count; ++i)
+    {
+        queue.Push(i);
+    }
+
+    consumer.join();
+
+    REQUIRE(isOrdered);
+    REQUIRE(sum == int64_t{count} * (count - 1) / 2);
+}
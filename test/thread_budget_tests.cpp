@@ -0,0 +1,112 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+#include "clip/thread_budget.h"
+
+
+TEST_CASE("Threads are divided among live leases", "[thread_budget]")
+{
+    clip::ThreadBudget budget(16);
+
+    auto first = budget.Acquire();
+    REQUIRE(first.GetShare() == 16);
+
+    {
+        std::vector<clip::ThreadBudget::Lease> leases;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            leases.push_back(budget.Acquire());
+        }
+
+        REQUIRE(budget.GetLiveCount() == 4);
+        REQUIRE(first.GetShare() == 4);
+    }
+
+    // Released leases return their share.
+    REQUIRE(budget.GetLiveCount() == 1);
+    REQUIRE(first.GetShare() == 16);
+}
+
+
+TEST_CASE("Every lease gets at least one thread", "[thread_budget]")
+{
+    clip::ThreadBudget budget(2);
+    std::vector<clip::ThreadBudget::Lease> leases;
+
+    for (int i = 0; i < 5; ++i)
+    {
+        leases.push_back(budget.Acquire());
+    }
+
+    REQUIRE(leases.front().GetShare() == 1);
+}
+
+
+TEST_CASE("Expected count limits the share", "[thread_budget]")
+{
+    clip::ThreadBudget budget(16);
+    budget.SetExpectedCount(8);
+
+    auto lease = budget.Acquire();
+    REQUIRE(lease.GetShare() == 2);
+
+    // A moved lease is only counted once.
+    auto moved = std::move(lease);
+    REQUIRE(budget.GetLiveCount() == 1);
+    REQUIRE(moved.GetShare() == 2);
+}
+
+
+TEST_CASE("Expected count from the constructor", "[thread_budget]")
+{
+    clip::ThreadBudget budget(16, 4);
+
+    auto lease = budget.Acquire();
+    REQUIRE(lease.GetShare() == 4);
+}
+
+
+TEST_CASE("Shares taken at open are not rebalanced", "[thread_budget]")
+{
+    clip::ThreadBudget budget(16);
+
+    // An encoder reads its share once, when it is opened.
+    auto first = budget.Acquire();
+    unsigned firstThreads = first.GetShare();
+
+    auto second = budget.Acquire();
+    unsigned secondThreads = second.GetShare();
+
+    // The first encoder keeps every thread, and the second takes half.
+    REQUIRE(firstThreads == 16);
+    REQUIRE(secondThreads == 8);
+    REQUIRE(firstThreads + secondThreads > budget.GetThreadCount());
+
+    // Declaring both outputs in advance keeps within the budget.
+    clip::ThreadBudget planned(16, 2);
+    auto plannedFirst = planned.Acquire();
+    auto plannedSecond = planned.Acquire();
+
+    REQUIRE(plannedFirst.GetShare() + plannedSecond.GetShare() == 16);
+}
+
+
+TEST_CASE("An empty lease is not counted", "[thread_budget]")
+{
+    clip::ThreadBudget budget(16);
+    auto video = budget.Acquire();
+
+    // Audio outputs hold an empty lease.
+    clip::ThreadBudget::Lease audio;
+
+    REQUIRE(budget.GetLiveCount() == 1);
+    REQUIRE(video.GetShare() == 16);
+    REQUIRE(audio.GetShare() == 1);
+}
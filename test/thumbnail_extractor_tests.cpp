@@ -0,0 +1,172 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "clip/format.h"
+#include "clip/keyframe_index.h"
+#include "clip/output_context.h"
+#include "clip/thumbnail_extractor.h"
+#include "clip/video_output.h"
+#include "clip/video_writer.h"
+
+
+namespace
+{
+
+
+constexpr int frameCount = 40;
+constexpr int gopSize = 8;
+constexpr clip::Resolution resolution{64, 48};
+
+
+// Each frame is a flat gray, so that any thumbnail can be named.
+uint8_t GetLevel(int frameIndex)
+{
+    return static_cast<uint8_t>(20 + 5 * frameIndex);
+}
+
+
+void WriteTestVideo(const std::string &fileName)
+{
+    auto outputContext = std::make_shared<clip::OutputContext>(
+        clip::format::Mp4::Get(),
+        fileName);
+
+    auto options = clip::VideoOptions::MakeLossless(resolution);
+    options.framesPerSecond = 30;
+    options.gopSize = gopSize;
+    options.preset = clip::Preset::superfast;
+
+    clip::Dictionary codecOptions;
+    clip::VideoOutput videoOutput(outputContext, codecOptions, options);
+    outputContext->Initialize(codecOptions);
+
+    auto dataWidth = static_cast<size_t>(resolution.width * 3);
+
+    clip::StrideVideoWriter writer(
+        static_cast<size_t>(resolution.height),
+        dataWidth,
+        videoOutput);
+
+    clip::VideoFrame frame(resolution.height, dataWidth);
+
+    for (int i = 0; i < frameCount; ++i)
+    {
+        frame.setConstant(GetLevel(i));
+        writer(frame);
+    }
+
+    writer.Flush();
+    outputContext->Finalize();
+}
+
+
+} // end anonymous namespace
+
+
+TEST_CASE("Thumbnails keep the aspect ratio", "[thumbnail_extractor]")
+{
+    clip::Resolution maximumSize{160, 120};
+
+    REQUIRE(clip::FitResolution({640, 480}, maximumSize) == maximumSize);
+
+    REQUIRE(
+        clip::FitResolution({1920, 1080}, maximumSize)
+        == clip::Resolution{160, 90});
+
+    REQUIRE(
+        clip::FitResolution({480, 640}, maximumSize)
+        == clip::Resolution{90, 120});
+
+    // Small videos are not enlarged.
+    REQUIRE(
+        clip::FitResolution({100, 50}, maximumSize)
+        == clip::Resolution{100, 50});
+
+    // Neither side is rounded down to nothing.
+    REQUIRE(
+        clip::FitResolution({16000, 10}, maximumSize)
+        == clip::Resolution{160, 1});
+}
+
+
+TEST_CASE("Thumbnails are made of keyframes only", "[thumbnail_extractor]")
+{
+    std::string fileName = "thumbnail_extractor_test.mp4";
+    WriteTestVideo(fileName);
+
+    auto index = clip::KeyframeIndex::Build(fileName);
+    REQUIRE(index.GetCount() == frameCount);
+
+    std::vector<int> keyframes;
+
+    for (size_t i = 0; i < index.GetCount(); ++i)
+    {
+        if (index[i].GetIsKeyframe())
+        {
+            keyframes.push_back(static_cast<int>(i));
+        }
+    }
+
+    REQUIRE(keyframes.size() >= frameCount / gopSize);
+
+    auto options = clip::ThumbnailOptions::MakeDefault();
+    options.maximumSize = {32, 32};
+    options.threadCount = 2;
+
+    // Several batches, so that ordering must hold across them.
+    options.batchSize = 2;
+
+    clip::ThumbnailExtractor extractor(fileName, options);
+    REQUIRE(extractor.GetResolution() == clip::Resolution{32, 24});
+
+    auto thumbnails = extractor.Extract();
+    REQUIRE(thumbnails.size() == keyframes.size());
+
+    for (size_t i = 0; i < thumbnails.size(); ++i)
+    {
+        const auto &thumbnail = thumbnails[i];
+        int frameIndex = keyframes[i];
+
+        INFO("thumbnail " << i << ", frame " << frameIndex);
+
+        // In presentation order, with no frame between keyframes.
+        REQUIRE(thumbnail.pts == index[static_cast<size_t>(frameIndex)].pts);
+
+        REQUIRE(thumbnail.image.rows() == 24);
+        REQUIRE(thumbnail.image.cols() == 32 * 3);
+
+        int level = GetLevel(frameIndex);
+
+        auto difference =
+            (thumbnail.image.cast<int>().array() - level).abs().maxCoeff();
+
+        REQUIRE(difference <= 2);
+    }
+
+    std::remove(fileName.c_str());
+}
+
+
+TEST_CASE("Thumbnail batches must not be empty", "[thumbnail_extractor]")
+{
+    std::string fileName = "thumbnail_extractor_batch_test.mp4";
+    WriteTestVideo(fileName);
+
+    auto options = clip::ThumbnailOptions::MakeDefault();
+    options.batchSize = 0;
+
+    REQUIRE_THROWS_AS(
+        clip::ThumbnailExtractor(fileName, options),
+        clip::ClipError);
+
+    std::remove(fileName.c_str());
+}
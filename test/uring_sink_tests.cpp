@@ -0,0 +1,113 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include "clip/uring_sink.h"
+
+
+#ifdef CLIP_HAS_IO_URING
+
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <vector>
+
+
+static std::vector<uint8_t> ReadFile(const std::filesystem::path &path)
+{
+    std::ifstream input(path, std::ios::binary);
+
+    return std::vector<uint8_t>(
+        std::istreambuf_iterator<char>(input),
+        std::istreambuf_iterator<char>());
+}
+
+
+TEST_CASE("UringFileSink writes every byte in order", "[uring_sink]")
+{
+    auto path =
+        std::filesystem::temp_directory_path() / "clip_uring_sink_test.bin";
+
+    auto options = clip::UringOptions::MakeDefault();
+    options.bufferSize = clip::UringFileSink::alignment;
+    options.bufferCount = 2;
+    options.useDirectIo = GENERATE(false, true);
+
+    // More than bufferCount buffers, and a partial one at the end.
+    std::vector<uint8_t> data(5 * clip::UringFileSink::alignment + 123);
+    std::iota(data.begin(), data.end(), uint8_t{0});
+
+    {
+        clip::UringFileSink sink(path.string(), options);
+
+        // Write in pieces that do not line up with the buffers.
+        size_t offset = 0;
+
+        while (offset < data.size())
+        {
+            size_t count = std::min(size_t{1000}, data.size() - offset);
+            sink.Write(data.data() + offset, count);
+            offset += count;
+        }
+
+        REQUIRE(sink.Seek(0, AVSEEK_SIZE) == static_cast<int64_t>(offset));
+        sink.Close();
+    }
+
+    REQUIRE(ReadFile(path) == data);
+    std::filesystem::remove(path);
+}
+
+
+TEST_CASE("UringFileSink rewrites after seeking back", "[uring_sink]")
+{
+    auto path =
+        std::filesystem::temp_directory_path() / "clip_uring_seek_test.bin";
+
+    auto options = clip::UringOptions::MakeDefault();
+    options.bufferSize = clip::UringFileSink::alignment;
+
+    std::vector<uint8_t> data(3 * clip::UringFileSink::alignment, 1);
+    std::vector<uint8_t> patch{9, 9, 9, 9};
+
+    {
+        clip::UringFileSink sink(path.string(), options);
+        sink.Write(data.data(), data.size());
+
+        // Like the mp4 muxer patching a size field at the start.
+        REQUIRE(sink.Seek(8, SEEK_SET) == 8);
+        sink.Write(patch.data(), patch.size());
+
+        auto end = static_cast<int64_t>(data.size());
+        REQUIRE(sink.Seek(0, SEEK_END) == end);
+        sink.Write(patch.data(), patch.size());
+        sink.Close();
+    }
+
+    std::copy(patch.begin(), patch.end(), data.begin() + 8);
+    data.insert(data.end(), patch.begin(), patch.end());
+
+    REQUIRE(ReadFile(path) == data);
+    std::filesystem::remove(path);
+}
+
+
+#else // CLIP_HAS_IO_URING
+
+
+TEST_CASE("UringFileSink is not built", "[uring_sink]")
+{
+    // Report the gap in every run, instead of compiling to nothing.
+    WARN(
+        "liburing was not found, so UringFileSink and its tests are not "
+        "built.");
+}
+
+
+#endif // CLIP_HAS_IO_URING
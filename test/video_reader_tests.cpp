@@ -0,0 +1,543 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "clip/format.h"
+#include "clip/keyframe_index.h"
+#include "clip/output_context.h"
+#include "clip/packet.h"
+#include "clip/stream.h"
+#include "clip/transcoder.h"
+#include "clip/video_output.h"
+#include "clip/video_reader.h"
+#include "clip/video_writer.h"
+
+
+namespace
+{
+
+
+constexpr int frameCount = 40;
+constexpr int framesPerSecond = 30;
+constexpr clip::Resolution resolution{64, 48};
+
+
+// Each frame is a flat gray, so that any frame read back can be named.
+uint8_t GetLevel(int frameIndex)
+{
+    return static_cast<uint8_t>(20 + 5 * frameIndex);
+}
+
+
+void WriteTestVideo(const std::string &fileName)
+{
+    auto outputContext = std::make_shared<clip::OutputContext>(
+        clip::format::Mp4::Get(),
+        fileName);
+
+    // Lossless, with several groups of pictures and B-frames.
+    auto options = clip::VideoOptions::MakeLossless(resolution);
+    options.framesPerSecond = framesPerSecond;
+    options.gopSize = 8;
+    options.preset = clip::Preset::superfast;
+
+    clip::Dictionary codecOptions;
+    clip::VideoOutput videoOutput(outputContext, codecOptions, options);
+    outputContext->Initialize(codecOptions);
+
+    auto dataWidth = static_cast<size_t>(resolution.width * 3);
+
+    clip::StrideVideoWriter writer(
+        static_cast<size_t>(resolution.height),
+        dataWidth,
+        videoOutput);
+
+    clip::VideoFrame frame(resolution.height, dataWidth);
+
+    for (int i = 0; i < frameCount; ++i)
+    {
+        frame.setConstant(GetLevel(i));
+        writer(frame);
+    }
+
+    writer.Flush();
+    outputContext->Finalize();
+}
+
+
+// @return The frame's pts, after checking that every pixel is its level.
+int64_t ReadFrame(clip::VideoReader<> &reader, int expectedIndex)
+{
+    using Reader = clip::VideoReader<>;
+
+    REQUIRE(reader.HasFrame());
+
+    Reader::Matrix data(
+        reader.GetHeight_pixels(),
+        reader.GetWidth_pixels() * 3);
+
+    int64_t pts = reader.ReadFrame(
+        Reader::FrameMap(
+            data.data(),
+            data.rows(),
+            data.cols(),
+            Eigen::OuterStride<>(data.cols())));
+
+    int level = GetLevel(expectedIndex);
+    auto difference = (data.cast<int>().array() - level).abs().maxCoeff();
+
+    INFO("frame " << expectedIndex);
+    REQUIRE(difference <= 2);
+
+    return pts;
+}
+
+
+constexpr int sampleRate = 48000;
+constexpr int samplesPerFrame = sampleRate / framesPerSecond;
+
+
+// Uncompressed RGB24 video, with a packet of silent audio for each frame
+// when hasAudio is set. The video starts at videoStart frames, and the audio
+// at zero. The video packet at shortPacket is too small for a frame, so
+// decoding it fails.
+void WriteRawVideo(
+    const std::string &fileName,
+    bool hasAudio,
+    int64_t videoStart,
+    std::optional<int> shortPacket = {})
+{
+    clip::OutputContext outputContext(
+        av_guess_format("nut", NULL, NULL),
+        fileName);
+
+    clip::Stream video(outputContext);
+    video->time_base = AVRational{1, framesPerSecond};
+    video->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    video->codecpar->codec_id = AV_CODEC_ID_RAWVIDEO;
+    video->codecpar->codec_tag =
+        avcodec_pix_fmt_to_codec_tag(AV_PIX_FMT_RGB24);
+    video->codecpar->format = AV_PIX_FMT_RGB24;
+    video->codecpar->width = resolution.width;
+    video->codecpar->height = resolution.height;
+
+    if (hasAudio)
+    {
+        clip::Stream audio(outputContext);
+        audio->time_base = AVRational{1, sampleRate};
+        audio->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+        audio->codecpar->codec_id = AV_CODEC_ID_PCM_S16LE;
+        audio->codecpar->sample_rate = sampleRate;
+        av_channel_layout_default(&audio->codecpar->ch_layout, 1);
+    }
+
+    clip::Dictionary formatOptions;
+    outputContext.Initialize(formatOptions);
+
+    int frameSize = resolution.width * resolution.height * 3;
+
+    for (int i = 0; i < frameCount; ++i)
+    {
+        clip::OutputPacket frame;
+        int size = (i == shortPacket) ? 16 : frameSize;
+        REQUIRE(av_new_packet(frame, size) == 0);
+
+        std::memset(frame->data, GetLevel(i), static_cast<size_t>(size));
+        frame->stream_index = 0;
+        frame->pts = videoStart + i;
+        frame->dts = videoStart + i;
+        frame->duration = 1;
+        frame->flags |= AV_PKT_FLAG_KEY;
+        outputContext.WritePacket(frame);
+
+        if (!hasAudio)
+        {
+            continue;
+        }
+
+        clip::OutputPacket samples;
+        REQUIRE(av_new_packet(samples, samplesPerFrame * 2) == 0);
+
+        std::memset(samples->data, 0, static_cast<size_t>(samples->size));
+        samples->stream_index = 1;
+        samples->pts = i * samplesPerFrame;
+        samples->dts = i * samplesPerFrame;
+        samples->duration = samplesPerFrame;
+        samples->flags |= AV_PKT_FLAG_KEY;
+        outputContext.WritePacket(samples);
+    }
+
+    outputContext.Finalize();
+}
+
+
+struct CrcPacket
+{
+    int streamIndex;
+    int64_t dts;
+    int64_t pts;
+};
+
+
+// framecrc writes one line per packet:
+// stream_index, dts, pts, duration, size, crc
+std::vector<CrcPacket> ReadCrcPackets(const std::string &fileName)
+{
+    std::ifstream input(fileName);
+    REQUIRE(input.is_open());
+
+    std::vector<CrcPacket> result;
+    std::string line;
+
+    while (std::getline(input, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        CrcPacket packet{};
+        char comma;
+
+        fields >> packet.streamIndex >> comma >> packet.dts >> comma
+            >> packet.pts;
+
+        REQUIRE(fields);
+        result.push_back(packet);
+    }
+
+    return result;
+}
+
+
+std::vector<int64_t> GetPts(
+    const std::vector<CrcPacket> &packets,
+    int streamIndex)
+{
+    std::vector<int64_t> result;
+
+    for (const auto &packet: packets)
+    {
+        if (packet.streamIndex == streamIndex)
+        {
+            result.push_back(packet.pts);
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+
+    return result;
+}
+
+
+clip::VideoOptions GetTranscodeOptions(int outputFramesPerSecond)
+{
+    auto options = clip::VideoOptions::MakeLossless(resolution);
+    options.framesPerSecond = outputFramesPerSecond;
+    options.preset = clip::Preset::superfast;
+
+    return options;
+}
+
+
+} // end anonymous namespace
+
+
+TEST_CASE("Encoded frames are read back in order", "[video_reader]")
+{
+    std::string fileName = "video_reader_test.mp4";
+    WriteTestVideo(fileName);
+
+    clip::VideoReader<> reader(fileName);
+    REQUIRE(reader.GetResolution() == resolution);
+
+    AVRational timeBase = reader.GetStream()->time_base;
+    std::vector<int64_t> timeStamps;
+
+    for (int i = 0; i < frameCount; ++i)
+    {
+        timeStamps.push_back(ReadFrame(reader, i));
+    }
+
+    REQUIRE(!reader.HasFrame());
+
+    // One frame period apart, in presentation order.
+    for (int i = 0; i < frameCount; ++i)
+    {
+        int64_t frameNumber = av_rescale_q(
+            timeStamps[static_cast<size_t>(i)] - timeStamps.front(),
+            timeBase,
+            AVRational{1, framesPerSecond});
+
+        REQUIRE(frameNumber == i);
+    }
+
+    std::remove(fileName.c_str());
+}
+
+
+TEST_CASE("SeekToFrame reads the requested frame", "[video_reader]")
+{
+    std::string fileName = "video_reader_seek_test.mp4";
+    WriteTestVideo(fileName);
+
+    auto index = clip::KeyframeIndex::Build(fileName);
+    REQUIRE(index.GetCount() == frameCount);
+
+    clip::VideoReader<> reader(fileName);
+
+    // Keyframes, frames within a group of pictures, and backwards.
+    for (int frameIndex: {21, 0, 8, 13, frameCount - 1, 5})
+    {
+        reader.SeekToFrame(index, static_cast<size_t>(frameIndex));
+
+        int64_t pts = ReadFrame(reader, frameIndex);
+        REQUIRE(pts == index[static_cast<size_t>(frameIndex)].pts);
+    }
+
+    std::remove(fileName.c_str());
+}
+
+
+TEST_CASE("Transcoded frames keep their order and levels", "[transcoder]")
+{
+    std::string inputName = "transcoder_test_input.mp4";
+    std::string outputName = "transcoder_test_output.mp4";
+    WriteTestVideo(inputName);
+
+    {
+        auto outputContext = std::make_shared<clip::OutputContext>(
+            clip::format::Mp4::Get(),
+            outputName);
+
+        // Keep the input's frame rate, through the smallest queues.
+        clip::Dictionary codecOptions;
+        auto options = clip::TranscodeOptions::MakeDefault();
+        options.queueDepth = 1;
+
+        clip::Transcoder transcoder(
+            inputName,
+            outputContext,
+            codecOptions,
+            GetTranscodeOptions(0),
+            options);
+
+        REQUIRE(
+            transcoder.GetVideoOutput().GetOptions().framesPerSecond
+            == framesPerSecond);
+
+        outputContext->Initialize(codecOptions);
+        transcoder.Run();
+        outputContext->Finalize();
+
+        auto occupancy = transcoder.GetOccupancy();
+        REQUIRE(occupancy.demux.itemCount == frameCount);
+        REQUIRE(occupancy.decode.itemCount == frameCount);
+        REQUIRE(occupancy.reformat.itemCount == frameCount);
+        REQUIRE(occupancy.encode.itemCount == frameCount);
+        REQUIRE(occupancy.encode.queued == 0);
+        REQUIRE(occupancy.encode.capacity == 1);
+    }
+
+    clip::VideoReader<> reader(outputName);
+    AVRational timeBase = reader.GetStream()->time_base;
+    std::optional<int64_t> firstPts;
+
+    for (int i = 0; i < frameCount; ++i)
+    {
+        int64_t pts = ReadFrame(reader, i);
+
+        if (!firstPts)
+        {
+            firstPts = pts;
+        }
+
+        int64_t frameNumber = av_rescale_q(
+            pts - *firstPts,
+            timeBase,
+            AVRational{1, framesPerSecond});
+
+        REQUIRE(frameNumber == i);
+    }
+
+    REQUIRE(!reader.HasFrame());
+
+    std::remove(inputName.c_str());
+    std::remove(outputName.c_str());
+}
+
+
+TEST_CASE("Transcoding to a lower rate drops frames", "[transcoder]")
+{
+    std::string inputName = "transcoder_rate_test_input.mp4";
+    std::string outputName = "transcoder_rate_test_output.mp4";
+    WriteTestVideo(inputName);
+
+    int outputFramesPerSecond = framesPerSecond / 2;
+
+    {
+        auto outputContext = std::make_shared<clip::OutputContext>(
+            clip::format::Mp4::Get(),
+            outputName);
+
+        clip::Dictionary codecOptions;
+
+        clip::Transcoder transcoder(
+            inputName,
+            outputContext,
+            codecOptions,
+            GetTranscodeOptions(outputFramesPerSecond));
+
+        outputContext->Initialize(codecOptions);
+        transcoder.Run();
+        outputContext->Finalize();
+    }
+
+    // Input frame i is at i / 2 output frames, rounded half away from zero,
+    // so every odd frame is kept, and each even frame but the first
+    // duplicates the time stamp before it.
+    int expectedCount = frameCount / 2 + 1;
+
+    clip::VideoReader<> reader(outputName);
+    AVRational timeBase = reader.GetStream()->time_base;
+    std::optional<int64_t> firstPts;
+
+    for (int i = 0; i < expectedCount; ++i)
+    {
+        int64_t pts = ReadFrame(reader, (i == 0) ? 0 : 2 * i - 1);
+
+        if (!firstPts)
+        {
+            firstPts = pts;
+        }
+
+        int64_t frameNumber = av_rescale_q(
+            pts - *firstPts,
+            timeBase,
+            AVRational{1, outputFramesPerSecond});
+
+        REQUIRE(frameNumber == i);
+    }
+
+    REQUIRE(!reader.HasFrame());
+
+    std::remove(inputName.c_str());
+    std::remove(outputName.c_str());
+}
+
+
+TEST_CASE("Transcoder copies audio in sync with the video", "[transcoder]")
+{
+    std::string inputName = "transcoder_audio_test.nut";
+    std::string outputName = "transcoder_audio_test.crc";
+
+    // The video starts two frames after the audio.
+    int64_t videoStart = 2;
+    WriteRawVideo(inputName, true, videoStart);
+
+    auto audioMode = GENERATE(clip::AudioMode::copy, clip::AudioMode::drop);
+
+    {
+        auto outputContext = std::make_shared<clip::OutputContext>(
+            av_guess_format("framecrc", NULL, NULL),
+            outputName);
+
+        clip::Dictionary codecOptions;
+        auto options = clip::TranscodeOptions::MakeDefault();
+        options.audioMode = audioMode;
+
+        clip::Transcoder transcoder(
+            inputName,
+            outputContext,
+            codecOptions,
+            GetTranscodeOptions(framesPerSecond),
+            options);
+
+        outputContext->Initialize(codecOptions);
+        transcoder.Run();
+        outputContext->Finalize();
+    }
+
+    auto packets = ReadCrcPackets(outputName);
+    auto video = GetPts(packets, 0);
+    REQUIRE(video.size() == frameCount);
+
+    for (size_t i = 0; i < video.size(); ++i)
+    {
+        REQUIRE(video[i] == static_cast<int64_t>(i));
+    }
+
+    auto audio = GetPts(packets, 1);
+
+    if (audioMode == clip::AudioMode::drop)
+    {
+        REQUIRE(audio.empty());
+    }
+    else
+    {
+        // The packets that end before the first frame are dropped, and the
+        // rest are shifted by the same start time as the video.
+        REQUIRE(
+            audio.size() == static_cast<size_t>(frameCount - videoStart));
+
+        for (size_t i = 0; i < audio.size(); ++i)
+        {
+            REQUIRE(audio[i] == static_cast<int64_t>(i) * samplesPerFrame);
+        }
+    }
+
+    std::remove(inputName.c_str());
+    std::remove(outputName.c_str());
+}
+
+
+TEST_CASE("Transcoder rethrows the error from a stage", "[transcoder]")
+{
+    std::string inputName = "transcoder_error_test.nut";
+    std::string outputName = "transcoder_error_test.crc";
+
+    // The decoder fails halfway, while every queue is full.
+    WriteRawVideo(inputName, false, 0, frameCount / 2);
+
+    {
+        auto outputContext = std::make_shared<clip::OutputContext>(
+            av_guess_format("framecrc", NULL, NULL),
+            outputName);
+
+        clip::Dictionary codecOptions;
+        auto options = clip::TranscodeOptions::MakeDefault();
+        options.queueDepth = 1;
+
+        clip::Transcoder transcoder(
+            inputName,
+            outputContext,
+            codecOptions,
+            GetTranscodeOptions(framesPerSecond),
+            options);
+
+        outputContext->Initialize(codecOptions);
+
+        // Returns instead of waiting on the stopped stages.
+        REQUIRE_THROWS_AS(transcoder.Run(), clip::DecoderError);
+
+        auto occupancy = transcoder.GetOccupancy();
+        REQUIRE(occupancy.encode.itemCount <= frameCount / 2);
+    }
+
+    std::remove(inputName.c_str());
+    std::remove(outputName.c_str());
+}
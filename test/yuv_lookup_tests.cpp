@@ -0,0 +1,145 @@
+/**
+ * @author Jive Helix (jivehelix@gmail.com)
+ * @copyright 2022 Jive Helix
+ * Licensed under the MIT license. See LICENSE file.
+ */
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+#include "clip/yuv_lookup.h"
+
+
+namespace
+{
+
+
+// Maps each value to an arbitrary, but repeatable, color.
+struct ScrambleColorMap
+{
+    using Colors =
+        Eigen::Matrix<uint8_t, Eigen::Dynamic, 3, Eigen::RowMajor>;
+
+    template<typename Derived>
+    void operator()(const Eigen::DenseBase<Derived> &values, Colors *colors)
+        const
+    {
+        colors->resize(values.size(), 3);
+
+        for (Eigen::Index i = 0; i < values.size(); ++i)
+        {
+            auto value = static_cast<int>(values(i));
+            (*colors)(i, 0) = static_cast<uint8_t>(value * 7);
+            (*colors)(i, 1) = static_cast<uint8_t>(255 - value * 3);
+            (*colors)(i, 2) = static_cast<uint8_t>(value * 13 + 5);
+        }
+    }
+};
+
+
+} // end anonymous namespace
+
+
+TEST_CASE("YuvLookup matches converting the mapped colors", "[yuv_lookup]")
+{
+    using namespace clip::detail;
+
+    ScrambleColorMap colorMap;
+    clip::YuvLookup<ScrambleColorMap, uint16_t> lookup(
+        colorMap,
+        clip::ColorMatrix::bt709);
+
+    std::vector<uint16_t> values0{3, 1, 0, 200, 17, 17};
+    std::vector<uint16_t> values1{999, 4, 5, 6, 65535, 2};
+    int width = static_cast<int>(values0.size());
+
+    std::vector<uint8_t> y0(values0.size());
+    std::vector<uint8_t> y1(values0.size());
+    std::vector<uint8_t> u(values0.size());
+    std::vector<uint8_t> v(values0.size());
+
+    SECTION("yuv444p")
+    {
+        lookup.MapRow444(values0.data(), width, y0.data(), u.data(), v.data());
+
+        for (size_t i = 0; i < values0.size(); ++i)
+        {
+            ScrambleColorMap::Colors rgb;
+            Eigen::Matrix<uint16_t, 1, 1> value(values0[i]);
+            colorMap(value, &rgb);
+
+            uint8_t y;
+            uint8_t expectedU;
+            uint8_t expectedV;
+
+            RgbToYuv444Scalar(
+                rgb.data(),
+                1,
+                &y,
+                &expectedU,
+                &expectedV,
+                bt709Coefficients);
+
+            REQUIRE(y0[i] == y);
+            REQUIRE(u[i] == expectedU);
+            REQUIRE(v[i] == expectedV);
+        }
+    }
+
+    SECTION("yuv420p")
+    {
+        lookup.MapRows420(
+            values0.data(),
+            values1.data(),
+            width,
+            y0.data(),
+            y1.data(),
+            u.data(),
+            v.data());
+
+        std::vector<uint8_t> upperU(values0.size());
+        std::vector<uint8_t> upperV(values0.size());
+        std::vector<uint8_t> expectedY(values0.size());
+
+        lookup.MapRow444(
+            values0.data(),
+            width,
+            expectedY.data(),
+            upperU.data(),
+            upperV.data());
+
+        REQUIRE(y0 == expectedY);
+
+        std::vector<uint8_t> lowerU(values0.size());
+        std::vector<uint8_t> lowerV(values0.size());
+
+        lookup.MapRow444(
+            values1.data(),
+            width,
+            expectedY.data(),
+            lowerU.data(),
+            lowerV.data());
+
+        REQUIRE(y1 == expectedY);
+
+        for (size_t i = 0; i < values0.size() / 2; ++i)
+        {
+            auto left = 2 * i;
+            auto right = left + 1;
+
+            REQUIRE(
+                u[i] == Average4(
+                    upperU[left],
+                    upperU[right],
+                    lowerU[left],
+                    lowerU[right]));
+
+            REQUIRE(
+                v[i] == Average4(
+                    upperV[left],
+                    upperV[right],
+                    lowerV[left],
+                    lowerV[right]));
+        }
+    }
+}